@@ -0,0 +1,567 @@
+#include "Archive.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Word.h"
+
+static const char HEADER_MAGIC[4] = {'F', 'C', 'A', 'R'};
+static const char FOOTER_MAGIC[4] = {'F', 'C', 'A', 'I'};
+
+// ---------------- little-endian helpers ----------------
+
+static void put_le(std::vector<char>& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+static uint64_t get_le(const char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+static uint32_t fnv1a(const uint32_t* words, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; ++i) {
+        for (int b = 0; b < 4; ++b) {
+            h ^= (words[i] >> (8 * b)) & 0xff;
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+// ---------------- bit I/O ----------------
+
+namespace {
+
+class BitWriter {
+public:
+    void put(uint64_t value, int bits) {
+        while (bits > 0) {
+            int n = std::min(bits, 32);
+            acc |= (value & ((uint64_t(1) << n) - 1)) << fill;
+            fill += n;
+            value >>= n;
+            bits -= n;
+            while (fill >= 8) {
+                out.push_back(static_cast<char>(acc & 0xff));
+                acc >>= 8;
+                fill -= 8;
+            }
+        }
+    }
+
+    std::vector<char>& finish() {
+        if (fill > 0) out.push_back(static_cast<char>(acc & 0xff));
+        acc = 0;
+        fill = 0;
+        return out;
+    }
+
+    void clear() { out.clear(); }
+
+private:
+    std::vector<char> out;
+    uint64_t acc = 0;
+    int fill = 0;
+};
+
+class BitReader {
+public:
+    BitReader(const char* data, size_t size) : data(data), size(size) {}
+
+    uint64_t get(int bits) {
+        uint64_t value = 0;
+        int done = 0;
+        while (done < bits) {
+            if (fill == 0) {
+                if (pos >= size) throw std::runtime_error("Corrupt archive block: unexpected end of data");
+                acc = static_cast<unsigned char>(data[pos++]);
+                fill = 8;
+            }
+            int n = std::min(bits - done, fill);
+            value |= (acc & ((uint64_t(1) << n) - 1)) << done;
+            acc >>= n;
+            fill -= n;
+            done += n;
+        }
+        return value;
+    }
+
+private:
+    const char* data;
+    size_t size;
+    size_t pos = 0;
+    uint64_t acc = 0;
+    int fill = 0;
+};
+
+// Adaptive Rice parameter: k tracks log2 of the running mean magnitude
+struct RiceModel {
+    uint32_t sum = 4;
+    uint32_t count = 1;
+
+    int k() const {
+        int k = 0;
+        while ((uint64_t(count) << k) < sum && k < 28) ++k;
+        return k;
+    }
+    void update(uint32_t v) {
+        sum += v;
+        if (++count == 32) {
+            sum >>= 1;
+            count >>= 1;
+        }
+    }
+};
+
+// Quotients up to this length are coded in unary, longer ones escape to 32 raw bits
+constexpr uint32_t RICE_ESCAPE = 24;
+
+static uint32_t sign_extend(uint32_t v, int bits) {
+    uint32_t m = uint32_t(1) << (bits - 1);
+    return (v ^ m) - m;
+}
+
+static uint32_t zigzag(int32_t v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+static int32_t unzigzag(uint32_t u) { return static_cast<int32_t>(u >> 1) ^ -static_cast<int32_t>(u & 1); }
+
+static uint32_t mask(int bits) { return bits >= 32 ? ~uint32_t(0) : (uint32_t(1) << bits) - 1; }
+
+// Encoding and decoding share one model (code_word below), written against a
+// coder whose calls take the value to encode and return the coded value.
+class Encoder {
+public:
+    explicit Encoder(BitWriter& w) : w(w) {}
+
+    uint32_t raw(uint32_t v, int bits) {
+        w.put(v, bits);
+        return v;
+    }
+    // 1 bit if v equals the prediction, otherwise 1 + `bits` raw bits
+    uint32_t same(uint32_t v, uint32_t pred, int bits) {
+        if (v == pred) {
+            w.put(0, 1);
+        } else {
+            w.put(1, 1);
+            w.put(v, bits);
+        }
+        return v;
+    }
+    // Signed difference to the prediction (modulo 2^bits), Rice-coded
+    uint32_t delta(uint32_t v, uint32_t pred, int bits, RiceModel& m) {
+        uint32_t u = zigzag(static_cast<int32_t>(sign_extend((v - pred) & mask(bits), bits)));
+        int k = m.k();
+        uint32_t q = u >> k;
+        if (q < RICE_ESCAPE) {
+            w.put(mask(q), q + 1);  // q ones, then a zero
+            w.put(u, k);
+        } else {
+            w.put(mask(RICE_ESCAPE), RICE_ESCAPE);
+            w.put(u, 32);
+        }
+        m.update(u);
+        return v;
+    }
+    // Rank of v in a move-to-front list: 0, 10, 110, 111 + 4 raw bits
+    uint32_t symbol(uint32_t v, std::array<uint8_t, 16>& mtf) {
+        size_t r = std::find(mtf.begin(), mtf.end(), v) - mtf.begin();
+        if (r < 3) w.put(mask(r), r + 1);
+        else {
+            w.put(0x7, 3);
+            w.put(v, 4);
+        }
+        std::rotate(mtf.begin(), mtf.begin() + r, mtf.begin() + r + 1);
+        return v;
+    }
+
+private:
+    BitWriter& w;
+};
+
+class Decoder {
+public:
+    explicit Decoder(BitReader& r) : r(r) {}
+
+    uint32_t raw(uint32_t, int bits) { return static_cast<uint32_t>(r.get(bits)); }
+    uint32_t same(uint32_t, uint32_t pred, int bits) {
+        return r.get(1) ? static_cast<uint32_t>(r.get(bits)) : pred;
+    }
+    uint32_t delta(uint32_t, uint32_t pred, int bits, RiceModel& m) {
+        int k = m.k();
+        uint32_t q = 0;
+        while (q < RICE_ESCAPE && r.get(1)) ++q;
+        uint32_t u = q < RICE_ESCAPE ? (q << k) | static_cast<uint32_t>(r.get(k)) : static_cast<uint32_t>(r.get(32));
+        m.update(u);
+        return (pred + static_cast<uint32_t>(unzigzag(u))) & mask(bits);
+    }
+    uint32_t symbol(uint32_t, std::array<uint8_t, 16>& mtf) {
+        size_t rank = 0;
+        while (rank < 3 && r.get(1)) ++rank;
+        uint32_t v = rank < 3 ? mtf[rank] : static_cast<uint32_t>(r.get(4));
+        size_t pos = std::find(mtf.begin(), mtf.end(), v) - mtf.begin();
+        std::rotate(mtf.begin(), mtf.begin() + pos, mtf.begin() + pos + 1);
+        return v;
+    }
+
+private:
+    BitReader& r;
+};
+
+// Prediction state, reset at the start of every block
+struct CodingContext {
+    std::array<std::array<uint8_t, 16>, 16> mtf;  // word IDs seen after each word ID
+    uint32_t prev_id = OCB_PACKET_TRAILER;
+    uint32_t last[16] = {};                       // last payload per word ID
+    uint32_t board = 0;                           // board_id of the current FEB packet
+    uint32_t gts_tag = 0;
+    uint32_t channel = 0;                         // channel of the last hit time/amplitude
+    uint32_t hit_time = 0;
+    uint32_t gate_low[2] = {};                    // per gate header type
+    uint32_t amplitude[8] = {};                   // per amplitude_id
+    RiceModel rice[16];                           // per word ID
+    RiceModel channel_rice, hit_time_rice, amplitude_rice, gate_rice[2], count_rice;
+
+    CodingContext() {
+        for (auto& list : mtf) {
+            for (uint8_t i = 0; i < 16; ++i) list[i] = i;
+        }
+    }
+};
+
+static uint32_t field(uint32_t word, int start, int bits) { return (word >> start) & mask(bits); }
+
+// The context model of one word, shared by encoder (Coder = Encoder, `word`
+// is the input) and decoder (Coder = Decoder, `word` is ignored).
+template <class Coder>
+static uint32_t code_word(Coder& c, CodingContext& ctx, uint32_t word) {
+    uint32_t id = c.symbol(word >> 28, ctx.mtf[ctx.prev_id]);
+    uint32_t out = 0;
+
+    switch (id) {
+        case GATE_HEADER: {
+            uint32_t board = c.same(field(word, 20, 8), ctx.board, 8);
+            uint32_t type = c.raw(field(word, 19, 1), 1);
+            uint32_t low = c.delta(field(word, 0, 19), ctx.gate_low[type], 19, ctx.gate_rice[type]);
+            ctx.board = board;
+            ctx.gate_low[type] = low;
+            out = (board << 20) | (type << 19) | low;
+            break;
+        }
+        case GTS_HEADER: {
+            // GTS tags normally advance by one window
+            out = c.delta(field(word, 0, 28), ctx.gts_tag + 1, 28, ctx.rice[id]);
+            ctx.gts_tag = out;
+            break;
+        }
+        case GTS_TRAILER1: {
+            out = c.delta(field(word, 0, 28), ctx.gts_tag, 28, ctx.rice[id]);
+            ctx.gts_tag = out;
+            break;
+        }
+        case HIT_TIME:
+        case HIT_AMPLITUDE: {
+            uint32_t channel = c.delta(field(word, 20, 8), ctx.channel, 8, ctx.channel_rice);
+            uint32_t hit_id = c.raw(field(word, 17, 3), 3);
+            uint32_t tag_id = c.same(field(word, 15, 2), ctx.gts_tag & 0x3, 2);
+            uint32_t low;
+            if (id == HIT_TIME) {
+                uint32_t edge = c.raw(field(word, 14, 1), 1);
+                uint32_t spare = c.same(field(word, 13, 1), 0, 1);
+                uint32_t time = c.delta(field(word, 0, 13), ctx.hit_time, 13, ctx.hit_time_rice);
+                ctx.hit_time = time;
+                low = (edge << 14) | (spare << 13) | time;
+            } else {
+                uint32_t amp_id = c.same(field(word, 12, 3), field(ctx.last[id], 12, 3), 3);
+                uint32_t value = c.delta(field(word, 0, 12), ctx.amplitude[amp_id], 12, ctx.amplitude_rice);
+                ctx.amplitude[amp_id] = value;
+                low = (amp_id << 12) | value;
+            }
+            ctx.channel = channel;
+            out = (channel << 20) | (hit_id << 17) | (tag_id << 15) | low;
+            break;
+        }
+        case OCB_PACKET_HEADER: {
+            // Event numbers and gate tags count up
+            uint32_t prev = ctx.last[id];
+            uint32_t high = c.same(field(word, 25, 3), field(prev, 25, 3), 3);
+            uint32_t tag = c.same(field(word, 23, 2), (field(prev, 23, 2) + 1) & 0x3, 2);
+            uint32_t event = c.delta(field(word, 0, 23), field(prev, 0, 23) + 1, 23, ctx.rice[id]);
+            out = (high << 25) | (tag << 23) | event;
+            break;
+        }
+        case OCB_PACKET_TRAILER: {
+            // Gate type and tag repeat those of the packet header
+            uint32_t high = c.same(field(word, 23, 5), field(ctx.last[OCB_PACKET_HEADER], 23, 5), 5);
+            uint32_t low = c.same(field(word, 0, 23), 0, 23);
+            out = (high << 23) | low;
+            break;
+        }
+        case HOLD_TIME:
+        case EVENT_DONE:
+        case FEB_DATA_PACKET_TRAILER: {
+            uint32_t board = c.same(field(word, 20, 8), ctx.board, 8);
+            uint32_t low;
+            if (id == EVENT_DONE) {
+                uint32_t gate = c.same(field(word, 16, 4), field(ctx.last[id], 16, 4), 4);
+                uint32_t count = c.delta(field(word, 0, 16), field(ctx.last[id], 0, 16), 16, ctx.count_rice);
+                low = (gate << 16) | count;
+            } else {
+                low = c.delta(field(word, 0, 20), field(ctx.last[id], 0, 20), 20, ctx.rice[id]);
+            }
+            ctx.board = board;
+            out = (board << 20) | low;
+            break;
+        }
+        case GTS_TRAILER2:
+        case GATE_TRAILER:
+        case GATE_TIME:
+        default: {
+            out = c.delta(field(word, 0, 28), ctx.last[id], 28, ctx.rice[id]);
+            break;
+        }
+    }
+
+    ctx.last[id] = out;
+    ctx.prev_id = id;
+    return (id << 28) | out;
+}
+
+} // namespace
+
+// ---------------- writer ----------------
+
+ArchiveStats write_archive(ByteSource& in, const std::string& path, size_t packets_per_block) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Failed to create archive: " + path);
+
+    ArchiveStats stats;
+    std::vector<char> header(HEADER_MAGIC, HEADER_MAGIC + 4);
+    put_le(header, ArchiveConfig::VERSION, 4);
+    put_le(header, 0, 8);
+    out.write(header.data(), header.size());
+    uint64_t offset = header.size();
+
+    std::vector<ArchiveBlock> blocks;
+    std::vector<uint32_t> block_words;
+    uint32_t block_packets = 0;
+    BitWriter bits;
+
+    auto flush_block = [&]() {
+        if (block_words.empty()) return;
+        CodingContext ctx;
+        Encoder enc(bits);
+        bits.clear();
+        for (uint32_t w : block_words) code_word(enc, ctx, w);
+        const std::vector<char>& coded = bits.finish();
+        out.write(coded.data(), coded.size());
+
+        ArchiveBlock b;
+        b.offset = offset;
+        b.bytes = static_cast<uint32_t>(coded.size());
+        b.words = static_cast<uint32_t>(block_words.size());
+        b.first_packet = stats.packets;
+        b.packets = block_packets;
+        b.checksum = fnv1a(block_words.data(), block_words.size());
+        blocks.push_back(b);
+
+        offset += coded.size();
+        stats.packets += block_packets;
+        stats.words += block_words.size();
+        block_words.clear();
+        block_packets = 0;
+    };
+
+    std::vector<char> buf(1 << 20);
+    size_t have = 0;
+    size_t n;
+    while ((n = in.read(buf.data() + have, buf.size() - have)) > 0) {
+        stats.input_bytes += n;
+        have += n;
+        size_t whole = have / 4 * 4;
+        for (size_t i = 0; i < whole; i += 4) {
+            uint32_t w = static_cast<uint32_t>(get_le(buf.data() + i, 4));
+            // Blocks start at an OCB packet header, so packets never span blocks
+            if ((w >> 28) == OCB_PACKET_HEADER) {
+                if (block_packets >= packets_per_block) flush_block();
+                block_packets++;
+            }
+            block_words.push_back(w);
+        }
+        std::memmove(buf.data(), buf.data() + whole, have - whole);
+        have -= whole;
+    }
+    flush_block();
+
+    std::vector<char> trailer;
+    for (const auto& b : blocks) {
+        put_le(trailer, b.offset, 8);
+        put_le(trailer, b.bytes, 4);
+        put_le(trailer, b.words, 4);
+        put_le(trailer, b.first_packet, 8);
+        put_le(trailer, b.packets, 4);
+        put_le(trailer, b.checksum, 4);
+    }
+    put_le(trailer, offset, 8);
+    put_le(trailer, blocks.size(), 8);
+    put_le(trailer, stats.packets, 8);
+    put_le(trailer, stats.words, 8);
+    put_le(trailer, have, 4);
+    for (size_t i = 0; i < 4; ++i) trailer.push_back(i < have ? buf[i] : 0);
+    trailer.insert(trailer.end(), FOOTER_MAGIC, FOOTER_MAGIC + 4);
+    out.write(trailer.data(), trailer.size());
+    out.close();
+    if (!out) throw std::runtime_error("Failed to write archive: " + path);
+
+    stats.blocks = blocks.size();
+    stats.output_bytes = offset + trailer.size();
+    return stats;
+}
+
+// ---------------- reader ----------------
+
+ArchiveReader::ArchiveReader(const std::string& path) : path(path) {
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+    try {
+        off_t size = ::lseek(fd, 0, SEEK_END);
+        if (size < static_cast<off_t>(ArchiveConfig::HEADER_SIZE + ArchiveConfig::FOOTER_SIZE))
+            throw std::runtime_error("Not an archive (too short): " + path);
+
+        char footer[ArchiveConfig::FOOTER_SIZE];
+        read_at(static_cast<uint64_t>(size) - sizeof(footer), footer, sizeof(footer));
+        if (std::memcmp(footer + 40, FOOTER_MAGIC, 4) != 0) throw std::runtime_error("Not an archive (bad footer): " + path);
+
+        uint64_t index_offset = get_le(footer, 8);
+        uint64_t n_blocks = get_le(footer + 8, 8);
+        n_packets = get_le(footer + 16, 8);
+        n_words = get_le(footer + 24, 8);
+        uint32_t tail_len = static_cast<uint32_t>(get_le(footer + 32, 4));
+        if (tail_len > 3 || index_offset + n_blocks * ArchiveConfig::INDEX_ENTRY_SIZE + sizeof(footer) != static_cast<uint64_t>(size))
+            throw std::runtime_error("Corrupt archive index: " + path);
+        tail.assign(footer + 36, footer + 36 + tail_len);
+
+        std::vector<char> index(n_blocks * ArchiveConfig::INDEX_ENTRY_SIZE);
+        read_at(index_offset, index.data(), index.size());
+        blocks.resize(n_blocks);
+        for (size_t i = 0; i < n_blocks; ++i) {
+            const char* p = index.data() + i * ArchiveConfig::INDEX_ENTRY_SIZE;
+            blocks[i].offset = get_le(p, 8);
+            blocks[i].bytes = static_cast<uint32_t>(get_le(p + 8, 4));
+            blocks[i].words = static_cast<uint32_t>(get_le(p + 12, 4));
+            blocks[i].first_packet = get_le(p + 16, 8);
+            blocks[i].packets = static_cast<uint32_t>(get_le(p + 24, 4));
+            blocks[i].checksum = static_cast<uint32_t>(get_le(p + 28, 4));
+            if (blocks[i].offset + blocks[i].bytes > index_offset) throw std::runtime_error("Corrupt archive index: " + path);
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+ArchiveReader::~ArchiveReader() {
+    if (fd >= 0) ::close(fd);
+}
+
+void ArchiveReader::read_at(uint64_t offset, void* buf, size_t n) const {
+    char* p = static_cast<char*>(buf);
+    while (n > 0) {
+        ssize_t r = ::pread(fd, p, n, static_cast<off_t>(offset));
+        if (r <= 0) throw std::runtime_error("Failed to read archive: " + path);
+        p += r;
+        offset += static_cast<uint64_t>(r);
+        n -= static_cast<size_t>(r);
+    }
+}
+
+void ArchiveReader::read_block(size_t i, std::vector<uint32_t>& words) const {
+    const ArchiveBlock& b = blocks.at(i);
+    std::vector<char> coded(b.bytes);
+    read_at(b.offset, coded.data(), coded.size());
+
+    BitReader bits(coded.data(), coded.size());
+    Decoder dec(bits);
+    CodingContext ctx;
+    words.resize(b.words);
+    for (uint32_t k = 0; k < b.words; ++k) words[k] = code_word(dec, ctx, 0);
+
+    if (fnv1a(words.data(), words.size()) != b.checksum) {
+        throw std::runtime_error("Archive block " + std::to_string(i) + " checksum mismatch: " + path);
+    }
+}
+
+// Keep the words of block `b` that belong to packets [first, end); words before
+// the first header of a block belong to the packet of the previous block.
+// Returns true once packet `end` was reached.
+static bool select_packets(const ArchiveBlock& b, const std::vector<uint32_t>& block_words,
+                           uint64_t first, uint64_t end, std::vector<uint32_t>& out) {
+    int64_t packet = static_cast<int64_t>(b.first_packet) - 1;
+    for (uint32_t w : block_words) {
+        if ((w >> 28) == OCB_PACKET_HEADER) ++packet;
+        if (packet >= static_cast<int64_t>(end)) return true;
+        if (packet >= static_cast<int64_t>(first)) out.push_back(w);
+    }
+    return false;
+}
+
+// First block that may hold words of packet `first`
+static size_t find_block(const std::vector<ArchiveBlock>& blocks, uint64_t first) {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), first,
+                               [](uint64_t p, const ArchiveBlock& b) { return p < b.first_packet; });
+    return it == blocks.begin() ? 0 : static_cast<size_t>(it - blocks.begin() - 1);
+}
+
+void ArchiveReader::read_packets(uint64_t first, uint64_t count, std::vector<uint32_t>& words) const {
+    if (first >= n_packets) return;
+    uint64_t end = first + std::min(count, n_packets - first);
+    std::vector<uint32_t> block_words;
+    for (size_t i = find_block(blocks, first); i < blocks.size(); ++i) {
+        read_block(i, block_words);
+        if (select_packets(blocks[i], block_words, first, end, words)) break;
+    }
+}
+
+// ---------------- ArchiveSource ----------------
+
+ArchiveSource::ArchiveSource(const std::string& path, uint64_t first_packet, uint64_t packet_count)
+    : reader(path), first(first_packet), count(packet_count) {
+    next_block = find_block(reader.get_blocks(), first);
+}
+
+bool ArchiveSource::refill() {
+    const bool full = first == 0 && count == ALL;
+    const uint64_t end = first + std::min(count, ALL - first);
+    bytes.clear();
+    pos = 0;
+    while (bytes.empty() && next_block < reader.get_blocks().size()) {
+        std::vector<uint32_t> block_words;
+        reader.read_block(next_block, block_words);
+        words.clear();
+        if (full) words.swap(block_words);
+        else if (select_packets(reader.get_blocks()[next_block], block_words, first, end, words)) {
+            next_block = reader.get_blocks().size();  // range complete
+        }
+        if (next_block < reader.get_blocks().size()) ++next_block;
+        for (uint32_t w : words) put_le(bytes, w, 4);
+    }
+    if (bytes.empty() && full && !tail_done) {
+        tail_done = true;
+        bytes = reader.get_tail();
+    }
+    return !bytes.empty();
+}
+
+size_t ArchiveSource::read(void* buf, size_t n) {
+    if (pos >= bytes.size() && !refill()) return 0;
+    size_t k = std::min(n, bytes.size() - pos);
+    std::memcpy(buf, bytes.data() + pos, k);
+    pos += k;
+    return k;
+}
@@ -0,0 +1,109 @@
+// ========================= Archive.h =========================
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "InputSource.h"
+
+// Compact lossless archive of a raw OCB word stream (".fca").
+//
+// Every word is re-encoded with a context model: the word ID is coded by its
+// rank among the IDs seen after the previous ID, and the payload fields are
+// predicted from earlier words (board_id of the FEB packet, GTS tag + 1,
+// tag_id from the current GTS tag, ...) and written as "same" flags or as
+// adaptive Rice-coded deltas, bit-packed. Words are grouped in blocks of whole
+// OCB packets, each coded independently, so a block index gives random access
+// at packet granularity. Decoding reproduces the input bytes exactly.
+//
+// Layout (little-endian):
+//   header  "FCAR" u32 version u64 reserved
+//   blocks  bit-packed words
+//   index   per block: u64 offset, u32 bytes, u32 words, u64 first packet, u32 packets, u32 checksum
+//   footer  u64 index offset, u64 blocks, u64 packets, u64 words, u32 tail length, u8[4] tail, "FCAI"
+namespace ArchiveConfig {
+    inline constexpr uint32_t VERSION = 1;
+    inline constexpr size_t HEADER_SIZE = 16;
+    inline constexpr size_t INDEX_ENTRY_SIZE = 32;
+    inline constexpr size_t FOOTER_SIZE = 44;
+    inline constexpr size_t DEFAULT_PACKETS_PER_BLOCK = 256;
+}
+
+struct ArchiveBlock {
+    uint64_t offset = 0;        // file offset of the coded block
+    uint32_t bytes = 0;         // coded size
+    uint32_t words = 0;         // number of raw words
+    uint64_t first_packet = 0;  // index of the first OCB packet header in the block
+    uint32_t packets = 0;       // OCB packet headers in the block
+    uint32_t checksum = 0;      // FNV-1a of the raw words
+};
+
+struct ArchiveStats {
+    uint64_t packets = 0;
+    uint64_t words = 0;
+    uint64_t blocks = 0;
+    uint64_t input_bytes = 0;
+    uint64_t output_bytes = 0;
+};
+
+// Re-encode the whole byte stream of `in` into an archive at `path`.
+ArchiveStats write_archive(ByteSource& in, const std::string& path,
+                           size_t packets_per_block = ArchiveConfig::DEFAULT_PACKETS_PER_BLOCK);
+
+// Random-access reader of an archive.
+class ArchiveReader {
+public:
+    explicit ArchiveReader(const std::string& path);
+    ~ArchiveReader();
+    ArchiveReader(const ArchiveReader&) = delete;
+    ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+    uint64_t get_packets() const { return n_packets; }
+    uint64_t get_words() const { return n_words; }
+    const std::vector<ArchiveBlock>& get_blocks() const { return blocks; }
+    // Bytes after the last whole 32-bit word of the original file
+    const std::vector<char>& get_tail() const { return tail; }
+
+    // Decode block `i` into `words` (replacing its content); verifies the checksum
+    void read_block(size_t i, std::vector<uint32_t>& words) const;
+
+    // Append the words of OCB packets [first, first + count) to `words`: from the
+    // header of packet `first` up to (excluding) the header of packet first + count
+    void read_packets(uint64_t first, uint64_t count, std::vector<uint32_t>& words) const;
+
+private:
+    std::string path;
+    int fd = -1;
+    std::vector<ArchiveBlock> blocks;
+    uint64_t n_packets = 0;
+    uint64_t n_words = 0;
+    std::vector<char> tail;
+
+    void read_at(uint64_t offset, void* buf, size_t n) const;
+};
+
+// Byte stream of an archive, optionally restricted to a range of OCB packets.
+// The full range reproduces the original file byte for byte.
+class ArchiveSource : public ByteSource {
+public:
+    static constexpr uint64_t ALL = ~uint64_t(0);
+
+    explicit ArchiveSource(const std::string& path, uint64_t first_packet = 0, uint64_t packet_count = ALL);
+
+    size_t read(void* buf, size_t n) override;
+
+private:
+    ArchiveReader reader;
+    uint64_t first;
+    uint64_t count;
+    size_t next_block = 0;
+    bool tail_done = false;
+    std::vector<uint32_t> words;
+    std::vector<char> bytes;
+    size_t pos = 0;
+
+    bool refill();
+};
+
+#endif // ARCHIVE_H
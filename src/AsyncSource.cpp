@@ -0,0 +1,295 @@
+#include "AsyncSource.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+
+// O_DIRECT requires buffers, offsets and lengths aligned to the logical block size
+static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+// ---------------- io_uring ----------------
+
+#ifdef HAVE_IO_URING
+
+// Minimal io_uring instance driven through the raw syscalls (no liburing):
+// one submitter and one reaper, both the calling thread.
+struct AsyncFileSource::Ring {
+    int fd = -1;
+    void* sq_ptr = MAP_FAILED;
+    void* cq_ptr = MAP_FAILED;
+    size_t sq_size = 0, cq_size = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe* cqes;
+
+    // Returns false (leaving nothing allocated) if io_uring is not available
+    bool init(unsigned entries) {
+        io_uring_params p{};
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+        if (fd < 0) return false;
+
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_size = cq_size = std::max(sq_size, cq_size);
+
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) return release();
+        cq_ptr = single ? sq_ptr : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) return release();
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return release();
+
+        char* sq = static_cast<char*>(sq_ptr);
+        char* cq = static_cast<char*>(cq_ptr);
+        sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    bool release() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+        if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_size);
+        if (fd >= 0) ::close(fd);
+        sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        cq_ptr = sq_ptr = MAP_FAILED;
+        fd = -1;
+        return false;
+    }
+
+    ~Ring() { release(); }
+
+    void submit_read(int file_fd, void* buf, size_t len, uint64_t offset, uint64_t user_data) {
+        unsigned tail = *sq_tail;
+        unsigned idx = tail & *sq_mask;
+        io_uring_sqe& sqe = sqes[idx];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file_fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buf);
+        sqe.len = static_cast<unsigned>(len);
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array[idx] = idx;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        int ret;
+        do {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0));
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+    }
+
+    // Block until at least one completion is available, then hand all of them to `f`
+    template <class F>
+    void reap(F&& f) {
+        unsigned head = *cq_head;
+        while (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            int ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (ret < 0 && errno != EINTR) throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & *cq_mask];
+            f(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+};
+
+#else
+
+struct AsyncFileSource::Ring {
+    bool init(unsigned) { return false; }
+    void submit_read(int, void*, size_t, uint64_t, uint64_t) {}
+    template <class F> void reap(F&&) {}
+};
+
+#endif
+
+// ---------------- AsyncFileSource ----------------
+
+AsyncFileSource::AsyncFileSource(const std::string& path, const ReadConfig& config)
+    : path(path), config(config) {
+    if (this->config.block_size == 0 || this->config.block_size % DIRECT_ALIGNMENT != 0) {
+        throw std::runtime_error("Read block size must be a multiple of " + std::to_string(DIRECT_ALIGNMENT));
+    }
+    this->config.queue_depth = std::max(1u, this->config.queue_depth);
+    open_file(config.direct);
+
+    slots.resize(this->config.queue_depth);
+    for (auto& s : slots) {
+        void* p = nullptr;
+        if (posix_memalign(&p, DIRECT_ALIGNMENT, this->config.block_size) != 0) {
+            for (auto& t : slots) std::free(t.buffer);
+            ::close(fd);
+            throw std::runtime_error("Failed to allocate read buffers");
+        }
+        s.buffer = static_cast<char*>(p);
+    }
+
+    try {
+        // Some filesystems accept O_DIRECT at open() but fail the reads: probe once
+        if (direct && file_size > 0) {
+            ssize_t r = ::pread(fd, slots[0].buffer, this->config.block_size, 0);
+            if (r < 0 && errno == EINVAL) open_file(false);
+        }
+        if (config.direct && !direct) {
+            static std::once_flag warned;
+            std::call_once(warned, [&] { std::cerr << "Warning: O_DIRECT not supported for " << path << ", using buffered reads\n"; });
+        }
+
+        ring = new Ring();
+        if (!ring->init(this->config.queue_depth)) {
+            delete ring;
+            ring = nullptr;
+            static std::once_flag warned;
+            std::call_once(warned, [] { std::cerr << "Warning: io_uring not available, falling back to pread\n"; });
+        }
+
+        // Fill the read-ahead window
+        for (auto& s : slots) submit(s);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+AsyncFileSource::~AsyncFileSource() {
+    release();
+}
+
+void AsyncFileSource::release() {
+    // The kernel may still write into the buffers of reads in flight
+    if (ring) {
+        try {
+            for (auto& s : slots) wait(s);
+        } catch (const std::runtime_error&) {
+        }
+        delete ring;
+        ring = nullptr;
+    }
+    for (auto& s : slots) std::free(s.buffer);
+    slots.clear();
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+void AsyncFileSource::open_file(bool try_direct) {
+    if (fd >= 0) ::close(fd);
+    direct = false;
+    fd = -1;
+    if (try_direct) {
+        fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+        direct = fd >= 0;
+    }
+    if (fd < 0) fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        fd = -1;
+        throw std::runtime_error("Failed to stat file: " + path);
+    }
+    file_size = static_cast<uint64_t>(st.st_size);
+    if (!direct) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+std::string AsyncFileSource::get_backend() const {
+    return std::string(ring ? "io_uring" : "pread") + (direct ? "+O_DIRECT" : "");
+}
+
+void AsyncFileSource::submit(Slot& slot) {
+    slot.length = 0;
+    slot.pending = false;
+    slot.offset = next_offset;
+    if (next_offset >= file_size) return;  // past end of file: stays empty
+    next_offset += config.block_size;
+    if (ring) {
+        // Always a full aligned block; the read is short at end of file
+        ring->submit_read(fd, slot.buffer, config.block_size, slot.offset, static_cast<uint64_t>(&slot - slots.data()));
+        slot.pending = true;
+    }
+}
+
+void AsyncFileSource::wait(Slot& slot) {
+    while (slot.pending) {
+        ring->reap([this](uint64_t index, int res) {
+            Slot& s = slots[index];
+            s.pending = false;
+            s.result = res;
+        });
+    }
+}
+
+void AsyncFileSource::read_sync(Slot& slot) {
+    // Complete the block with synchronous reads (pread backend, or a short read)
+    while (slot.offset + slot.length < file_size && slot.length < config.block_size) {
+        ssize_t r = ::pread(fd, slot.buffer + slot.length, config.block_size - slot.length, static_cast<off_t>(slot.offset + slot.length));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) throw std::runtime_error("Failed to read " + path + ": " + std::strerror(errno));
+        if (r == 0) break;  // file truncated meanwhile
+        slot.length += static_cast<size_t>(r);
+    }
+}
+
+size_t AsyncFileSource::read(void* buf, size_t n) {
+    size_t done = 0;
+    char* out = static_cast<char*>(buf);
+    while (done < n) {
+        Slot& slot = slots[head];
+        if (!head_ready) {
+            if (slot.offset >= file_size) break;  // end of file
+            if (ring) {
+                wait(slot);
+                if (slot.result < 0) {
+                    throw std::runtime_error("Failed to read " + path + ": " + std::strerror(-slot.result));
+                }
+                slot.length = static_cast<size_t>(slot.result);
+            }
+            read_sync(slot);
+            if (slot.length == 0) break;
+            head_ready = true;
+            pos = 0;
+        }
+
+        size_t k = std::min(n - done, slot.length - pos);
+        std::memcpy(out + done, slot.buffer + pos, k);
+        pos += k;
+        done += k;
+
+        if (pos == slot.length) {
+            // Block consumed: reuse its buffer for the next read ahead
+            head_ready = false;
+            submit(slot);
+            head = (head + 1) % slots.size();
+        }
+    }
+    return done;
+}
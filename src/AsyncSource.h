@@ -0,0 +1,60 @@
+// ========================= AsyncSource.h =========================
+#ifndef ASYNCSOURCE_H
+#define ASYNCSOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "InputSource.h"
+
+// Plain file read ahead of the consumer with io_uring (raw syscalls): up to
+// `queue_depth` block-sized reads are kept in flight, into aligned buffers so
+// the file can be opened with O_DIRECT and bypass the page cache. Blocks are
+// handed out in file order. Falls back to buffered I/O if the filesystem
+// refuses O_DIRECT, and to synchronous pread() if io_uring is unavailable
+// (old kernel, seccomp, io_uring_disabled).
+class AsyncFileSource : public ByteSource {
+public:
+    AsyncFileSource(const std::string& path, const ReadConfig& config);
+    ~AsyncFileSource() override;
+
+    AsyncFileSource(const AsyncFileSource&) = delete;
+    AsyncFileSource& operator=(const AsyncFileSource&) = delete;
+
+    size_t read(void* buf, size_t n) override;
+
+    // "io_uring" or "pread", with "+O_DIRECT" if the page cache is bypassed
+    std::string get_backend() const;
+
+private:
+    struct Slot {
+        char* buffer = nullptr;
+        uint64_t offset = 0;
+        size_t length = 0;     // bytes valid once completed
+        bool pending = false;  // read submitted, not completed
+        int result = 0;        // completion result (bytes or -errno)
+    };
+
+    struct Ring;  // io_uring submission/completion queues
+
+    std::string path;
+    ReadConfig config;
+    int fd = -1;
+    bool direct = false;
+    uint64_t file_size = 0;
+    uint64_t next_offset = 0;  // offset of the next block to submit
+    std::vector<Slot> slots;
+    size_t head = 0;           // slot being consumed
+    size_t pos = 0;            // read position within the head slot
+    bool head_ready = false;
+    Ring* ring = nullptr;
+
+    void open_file(bool try_direct);
+    void release();
+    void submit(Slot& slot);
+    void wait(Slot& slot);
+    void read_sync(Slot& slot);
+};
+
+#endif // ASYNCSOURCE_H
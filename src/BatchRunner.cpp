@@ -0,0 +1,309 @@
+#include "BatchRunner.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include "InputSource.h"
+#include "OCBFramer.h"
+#include "Pipeline.h"
+#include "ThreadPool.h"
+
+namespace fs = std::filesystem;
+
+std::vector<std::string> collect_batch_inputs(const std::string& list_or_dir) {
+    std::vector<std::string> files;
+    if (fs::is_directory(list_or_dir)) {
+        for (const auto& entry : fs::directory_iterator(list_or_dir)) {
+            if (entry.is_regular_file()) files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    std::ifstream list(list_or_dir);
+    if (!list) throw std::runtime_error("Failed to open batch list: " + list_or_dir);
+    std::string line;
+    while (std::getline(list, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t b = line.find_first_not_of(" \t\r");
+        size_t e = line.find_last_not_of(" \t\r");
+        if (b != std::string::npos) files.push_back(line.substr(b, e - b + 1));
+    }
+    return files;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// State of one file being processed. Only one framing step of a file is ever
+// queued or running; decode tasks of its chunks run concurrently and hand
+// their text back in `ready`, which is flushed to the output in order.
+struct FileJob {
+    FileResult result;
+    Clock::time_point start;
+    std::unique_ptr<ByteSource> source;
+    std::unique_ptr<OCBFramer> framer;
+    std::ofstream out;
+    std::shared_ptr<const CalibrationTable> calibration;  // table of the whole file
+
+    std::mutex mtx;  // guards everything below
+    struct Chunk {
+        std::string text;
+        size_t n_events = 0;
+        std::exception_ptr error;
+    };
+    std::map<uint64_t, Chunk> ready;
+    uint64_t n_chunks = 0;       // chunks handed out by the framer
+    uint64_t n_framed = 0;       // packets in those chunks
+    uint64_t n_completed = 0;    // chunks decoded (written or not)
+    uint64_t next_write = 0;
+    bool framing_running = false;
+    bool framing_done = false;
+    bool paused = false;         // framer waiting for the output to catch up
+    bool failed = false;
+    bool finalized = false;
+};
+
+class Campaign {
+public:
+    Campaign(const BatchConfig& config, const std::function<void(PacketBatch&)>& decode_hook, std::ostream& status)
+        : config(config), decode_hook(decode_hook), status(status), pool(config.threads, config.pin_threads) {}
+
+    std::vector<FileResult> run(const std::vector<std::string>& files);
+
+private:
+    const BatchConfig& config;
+    const std::function<void(PacketBatch&)>& decode_hook;
+    std::ostream& status;
+    std::mutex status_mtx;
+    std::vector<std::shared_ptr<FileJob>> jobs;
+    ThreadPool pool;
+
+    void open_file(const std::shared_ptr<FileJob>& job);
+    void frame_step(const std::shared_ptr<FileJob>& job);
+    void decode_chunk(const std::shared_ptr<FileJob>& job, std::shared_ptr<PacketBatch> batch);
+    void fail(FileJob& job, std::exception_ptr error);
+    static std::exception_ptr write_error(const FileJob& job);
+    void maybe_finalize(FileJob& job);
+};
+
+std::vector<FileResult> Campaign::run(const std::vector<std::string>& files) {
+    // Unique output names, even for equal basenames from different directories
+    std::set<std::string> used;
+    for (const auto& path : files) {
+        auto job = std::make_shared<FileJob>();
+        job->result.path = path;
+        std::string name = fs::path(path).filename().string();
+        std::string candidate = name;
+        for (int n = 1; !used.insert(candidate).second; ++n) candidate = name + "_" + std::to_string(n);
+        job->result.output_path = (fs::path(config.output_dir) / (candidate + ".txt")).string();
+        jobs.push_back(job);
+    }
+
+    // Largest files first, so they do not end up alone at the tail
+    std::vector<std::shared_ptr<FileJob>> order = jobs;
+    auto file_size = [](const std::string& p) {
+        std::error_code ec;
+        auto size = fs::file_size(p, ec);
+        return ec ? 0 : size;
+    };
+    std::stable_sort(order.begin(), order.end(), [&](const auto& a, const auto& b) {
+        return file_size(a->result.path) > file_size(b->result.path);
+    });
+    for (auto& job : order) pool.submit([this, job] { open_file(job); });
+    pool.wait_idle();
+
+    std::vector<FileResult> results;
+    for (auto& job : jobs) results.push_back(job->result);
+    return results;
+}
+
+void Campaign::open_file(const std::shared_ptr<FileJob>& job) {
+    job->start = Clock::now();
+    try {
+        job->source = open_input(job->result.path, config.read);
+        job->framer = std::make_unique<OCBFramer>(*job->source);
+        job->out.open(job->result.output_path);
+        if (!job->out) throw std::runtime_error("Failed to open output file: " + job->result.output_path);
+        if (config.calibration) job->calibration = config.calibration->current();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job->mtx);
+        fail(*job, std::current_exception());
+        job->framing_done = true;
+        maybe_finalize(*job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(job->mtx);
+        job->framing_running = true;
+    }
+    frame_step(job);
+}
+
+// Frame the next chunk of packets, then queue its decode task and the next
+// framing step. The continuation is queued first, so the own worker decodes
+// the chunk (LIFO) while idle workers steal the framing of the file.
+void Campaign::frame_step(const std::shared_ptr<FileJob>& job) {
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(job->mtx);
+        if (job->failed) {
+            job->framing_running = false;
+            maybe_finalize(*job);
+            return;
+        }
+        if (job->n_chunks - job->next_write >= config.max_chunks_ahead) {
+            job->framing_running = false;
+            job->paused = true;
+            return;
+        }
+        seq = job->n_chunks;
+    }
+
+    auto batch = std::make_shared<PacketBatch>();
+    batch->seq = seq;
+    batch->calibration = job->calibration;
+    bool more = true;
+    try {
+        std::vector<uint32_t> words;
+        while (batch->packets.size() < config.chunk_packets && (more = job->framer->next(words))) {
+            batch->packets.push_back(std::move(words));
+        }
+    } catch (...) {
+        batch->error = std::current_exception();
+        batch->error_index = batch->packets.size();
+        more = false;
+    }
+
+    std::lock_guard<std::mutex> lock(job->mtx);
+    if (batch->packets.empty() && !batch->error) {
+        job->framing_done = true;
+        job->framing_running = false;
+        job->result.words = job->framer->get_words_read();
+        maybe_finalize(*job);
+        return;
+    }
+    job->n_chunks++;
+    batch->first_packet = job->n_framed;
+    job->n_framed += batch->packets.size();
+    if (more) {
+        pool.submit([this, job] { frame_step(job); });
+    } else {
+        job->framing_done = true;
+        job->framing_running = false;
+        job->result.words = job->framer->get_words_read();
+    }
+    pool.submit([this, job, batch] { decode_chunk(job, batch); });
+}
+
+void Campaign::decode_chunk(const std::shared_ptr<FileJob>& job, std::shared_ptr<PacketBatch> batch) {
+    bool skip;
+    {
+        std::lock_guard<std::mutex> lock(job->mtx);
+        skip = job->failed;
+    }
+    std::string text;
+    if (!skip) {
+        decode_batch(*batch, config.layout, config.mask);
+        if (decode_hook) decode_hook(*batch);
+        std::ostringstream os;
+        try {
+            print_batch(os, *batch);
+        } catch (...) {
+            if (!batch->error) batch->error = std::current_exception();
+        }
+        text = os.str();
+    }
+
+    std::lock_guard<std::mutex> lock(job->mtx);
+    job->n_completed++;
+    job->ready[batch->seq] = FileJob::Chunk{std::move(text), batch->events.size(), batch->error};
+
+    // Write every chunk whose predecessors are all written
+    while (!job->failed && !job->ready.empty() && job->ready.begin()->first == job->next_write) {
+        FileJob::Chunk& chunk = job->ready.begin()->second;
+        job->out << chunk.text;
+        job->result.packets += chunk.n_events;
+        if (chunk.error) fail(*job, chunk.error);
+        if (!job->out) fail(*job, write_error(*job));
+        job->ready.erase(job->ready.begin());
+        job->next_write++;
+    }
+
+    // Resume a framer that was waiting for the output to catch up
+    if (job->paused && !job->failed && job->n_chunks - job->next_write < config.max_chunks_ahead) {
+        job->paused = false;
+        job->framing_running = true;
+        pool.submit([this, job] { frame_step(job); });
+    }
+    maybe_finalize(*job);
+}
+
+std::exception_ptr Campaign::write_error(const FileJob& job) {
+    return std::make_exception_ptr(std::runtime_error("Failed to write output file: " + job.result.output_path));
+}
+
+// Called with job.mtx held
+void Campaign::fail(FileJob& job, std::exception_ptr error) {
+    if (job.failed) return;
+    job.failed = true;
+    job.paused = false;
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        job.result.error = e.what();
+    } catch (...) {
+        job.result.error = "unknown error";
+    }
+}
+
+// Called with job.mtx held
+void Campaign::maybe_finalize(FileJob& job) {
+    if (job.finalized || job.framing_running) return;
+    if (!job.framing_done && !job.failed) return;
+    if (job.n_completed != job.n_chunks) return;
+    job.finalized = true;
+
+    if (!job.failed) {
+        job.out << "Number of OCB packets: " << (int) job.result.packets << '\n';
+    }
+    if (job.out.is_open()) {
+        job.out.close();
+        if (!job.out) fail(job, write_error(job));
+    }
+    job.result.ok = !job.failed;
+    job.ready.clear();
+    job.result.seconds = std::chrono::duration<double>(Clock::now() - job.start).count();
+    if (job.framer) job.result.words = std::max<uint64_t>(job.result.words, job.framer->get_words_read());
+    job.framer.reset();
+    job.source.reset();
+    job.calibration.reset();
+    // Between files: later files pick up an updated table, the ones in flight keep theirs
+    if (config.calibration) config.calibration->reload_if_changed();
+
+    std::lock_guard<std::mutex> lock(status_mtx);
+    if (job.result.ok) {
+        status << "[ OK ] " << job.result.path << " -> " << job.result.output_path << ": "
+               << job.result.packets << " OCB packets, " << job.result.words << " words, "
+               << job.result.seconds << " s\n";
+    } else {
+        status << "[FAIL] " << job.result.path << ": " << job.result.error
+               << " (after " << job.result.packets << " OCB packets)\n";
+    }
+    status.flush();
+}
+
+} // namespace
+
+std::vector<FileResult> BatchRunner::run(const std::vector<std::string>& files, std::ostream& status) {
+    Campaign campaign(config, decode_hook, status);
+    return campaign.run(files);
+}
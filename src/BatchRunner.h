@@ -0,0 +1,64 @@
+// ========================= BatchRunner.h =========================
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Calibration.h"
+#include "ChannelMask.h"
+#include "InputSource.h"
+#include "OCBLayout.h"
+
+struct PacketBatch;
+
+struct BatchConfig {
+    size_t threads = 1;            // worker threads of the work-stealing pool
+    size_t chunk_packets = 256;    // OCB packets per intra-file decode task
+    size_t max_chunks_ahead = 8;   // per file: chunks framed but not yet written
+    bool pin_threads = false;
+    std::string output_dir = ".";
+    ReadConfig read;               // how plain input files are read
+    OCBLayoutId layout = OCBLayoutId::DEFAULT;
+    const ChannelMask* mask = nullptr;  // noisy channels whose hit words are dropped undecoded
+    // Calibration stage: every file keeps the table current when it started;
+    // the table is reloaded (if its file changed) whenever a file finishes
+    CalibrationManager* calibration = nullptr;
+};
+
+struct FileResult {
+    std::string path;
+    std::string output_path;
+    bool ok = false;
+    std::string error;
+    uint64_t packets = 0;
+    uint64_t words = 0;
+    double seconds = 0;
+};
+
+// Expand a directory (all regular files in it) or a list file (one path per
+// line, '#' starts a comment) into the list of raw files to process.
+std::vector<std::string> collect_batch_inputs(const std::string& list_or_dir);
+
+// Decodes a campaign of raw files on a work-stealing thread pool. Every file
+// is framed incrementally into chunks of OCB packets that are decoded as
+// separate tasks, so a few big files still keep all cores busy. Each file
+// gets its own output file, written in input order, and one status line on
+// `status` when it finishes. A corrupt file fails alone.
+class BatchRunner {
+public:
+    explicit BatchRunner(const BatchConfig& config) : config(config) {}
+
+    // Optional extra work done by the worker that decoded a chunk (e.g. monitoring)
+    void set_decode_hook(std::function<void(PacketBatch&)> hook) { decode_hook = std::move(hook); }
+
+    std::vector<FileResult> run(const std::vector<std::string>& files, std::ostream& status);
+
+private:
+    BatchConfig config;
+    std::function<void(PacketBatch&)> decode_hook;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,121 @@
+#include "Calibration.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "Kernels.h"
+
+// ---------------- CalibrationTable ----------------
+
+CalibrationTable::CalibrationTable()
+    : ped_lg(CalibConfig::NUM_ENTRIES + 1, 0.f),
+      gain_lg(CalibConfig::NUM_ENTRIES + 1, 1.f),
+      ped_hg(CalibConfig::NUM_ENTRIES + 1, 0.f),
+      gain_hg(CalibConfig::NUM_ENTRIES + 1, 1.f),
+      hg_saturation(CalibConfig::NUM_ENTRIES + 1, CalibConfig::DEFAULT_HG_SATURATION) {}
+
+uint64_t CalibrationTable::digest() const {
+    uint64_t h = 14695981039346656037ull;
+    for (const auto* column : {&ped_lg, &gain_lg, &ped_hg, &gain_hg, &hg_saturation}) {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(column->data());
+        for (size_t i = 0; i < column->size() * sizeof(float); ++i) {
+            h = (h ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+std::shared_ptr<CalibrationTable> CalibrationTable::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Failed to open calibration file: " + path);
+
+    auto table = std::make_shared<CalibrationTable>();
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        int board, channel;
+        float pl, gl, ph, gh, sat;
+        if (!(fields >> board)) continue;  // blank or comment line
+        if (!(fields >> channel >> pl >> gl >> ph >> gh >> sat)) {
+            throw std::runtime_error("Malformed calibration entry at " + path + ":" + std::to_string(line_number));
+        }
+        size_t i = index(board, channel);
+        if (i == CalibConfig::NUM_ENTRIES) {
+            throw std::runtime_error("Calibration entry for invalid board/channel at " + path + ":" + std::to_string(line_number));
+        }
+        table->ped_lg[i] = pl;
+        table->gain_lg[i] = gl;
+        table->ped_hg[i] = ph;
+        table->gain_hg[i] = gh;
+        table->hg_saturation[i] = sat;
+    }
+    return table;
+}
+
+// ---------------- CalibratedHits ----------------
+
+void CalibratedHits::clear() {
+    board.clear();
+    channel.clear();
+    amplitude_lg.clear();
+    amplitude_hg.clear();
+    energy.clear();
+    gain.clear();
+}
+
+void CalibratedHits::append(const OCBDataPacket& event) {
+    for (size_t b = 0; b < event.get_Nfebs_in_ocb(); ++b) {
+        if (!event.hasData(b)) continue;
+        for (const auto& hit : event[b].get_hit_amplitudes()) {
+            board.push_back(hit.get_board_id());
+            channel.push_back(hit.get_channel_id());
+            amplitude_lg.push_back(hit.get_amplitude_lg());
+            amplitude_hg.push_back(hit.get_amplitude_hg());
+        }
+    }
+}
+
+// ---------------- calibrate ----------------
+
+void calibrate(const CalibrationTable& table, CalibratedHits& hits) {
+    hits.energy.resize(hits.size());
+    hits.gain.resize(hits.size());
+    // Gathers and selects in the widest vectors the CPU supports
+    kernels().calibrate(table, hits);
+}
+
+// ---------------- CalibrationManager ----------------
+
+static int64_t mtime_ns(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return -1;
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+CalibrationManager::CalibrationManager(std::string path) : path(std::move(path)) {
+    loaded_mtime_ns = mtime_ns(this->path);
+    set(CalibrationTable::load(this->path));
+}
+
+std::shared_ptr<const CalibrationTable> CalibrationManager::run_table() {
+    if (boundary.exchange(false, std::memory_order_relaxed) && reload_if_changed()) {
+        std::cerr << "Calibration reloaded from " << path << " at a run boundary\n";
+    }
+    return current();
+}
+
+bool CalibrationManager::reload_if_changed() {
+    std::lock_guard<std::mutex> lock(reload_mtx);
+    int64_t mtime = mtime_ns(path);
+    if (mtime < 0 || mtime == loaded_mtime_ns) return false;
+    try {
+        set(CalibrationTable::load(path));
+    } catch (const std::runtime_error& e) {
+        // Keep the previous table if the new file is broken (e.g. still being written)
+        std::cerr << "Warning: calibration not reloaded: " << e.what() << "\n";
+        return false;
+    }
+    loaded_mtime_ns = mtime;
+    return true;
+}
@@ -0,0 +1,98 @@
+// ========================= Calibration.h =========================
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "OCBDecoder.h"
+
+namespace CalibConfig {
+    inline constexpr int NUM_CHANNELS = 256;  // channel_id is 8 bits
+    inline constexpr int NUM_ENTRIES = OCBConfig::MAX_FEBS_PER_OCB * NUM_CHANNELS;
+    // Default saturation threshold of the 12-bit high-gain ADC
+    inline constexpr float DEFAULT_HG_SATURATION = 4095.f;
+}
+
+// Which amplitude a calibrated energy was computed from
+enum CalibGain : uint8_t { GAIN_NONE = 0, GAIN_LG = 1, GAIN_HG = 2 };
+
+// Per-(board, channel) pedestal, gain and high-gain saturation constants,
+// stored as one array per constant. Index = board * NUM_CHANNELS + channel;
+// one extra entry at the end holds the defaults for out-of-range channels.
+class CalibrationTable {
+public:
+    CalibrationTable();
+
+    // Text file, one channel per line (missing channels keep the defaults):
+    //   board channel ped_lg gain_lg ped_hg gain_hg hg_saturation
+    // '#' starts a comment.
+    static std::shared_ptr<CalibrationTable> load(const std::string& path);
+
+    static size_t index(int board, int channel) {
+        if (board < 0 || board >= OCBConfig::MAX_FEBS_PER_OCB || channel < 0 || channel >= CalibConfig::NUM_CHANNELS)
+            return CalibConfig::NUM_ENTRIES;
+        return static_cast<size_t>(board) * CalibConfig::NUM_CHANNELS + static_cast<size_t>(channel);
+    }
+
+    // FNV-1a of all constants: identifies the table in checkpoints
+    uint64_t digest() const;
+
+    std::vector<float> ped_lg, gain_lg, ped_hg, gain_hg, hg_saturation;
+};
+
+// Column (structure-of-arrays) view of the amplitude hits of decoded events,
+// and the calibrated energy computed for each of them.
+struct CalibratedHits {
+    // Inputs
+    std::vector<int32_t> board, channel, amplitude_lg, amplitude_hg;
+    // Outputs of calibrate()
+    std::vector<float> energy;
+    std::vector<uint8_t> gain;  // CalibGain
+
+    size_t size() const { return board.size(); }
+    void clear();
+    // Append the amplitude hits of all FEBs of one event
+    void append(const OCBDataPacket& event);
+};
+
+// Bulk pedestal subtraction and gain selection:
+//   HG below saturation:  energy = (amplitude_hg - ped_hg) * gain_hg
+//   otherwise, LG:        energy = (amplitude_lg - ped_lg) * gain_lg
+//   no amplitude:         energy = 0, gain = GAIN_NONE
+void calibrate(const CalibrationTable& table, CalibratedHits& hits);
+
+// Holds the calibration table in use. Tables are immutable and swapped
+// atomically. A file or run takes one table and keeps it for all of its
+// batches (PacketBatch::calibration), so a table is only ever replaced
+// between runs: after a file of a batch job, or at an explicit run boundary
+// of a live input.
+class CalibrationManager {
+public:
+    explicit CalibrationManager(std::string path);
+
+    std::shared_ptr<const CalibrationTable> current() const { return std::atomic_load(&table); }
+    void set(std::shared_ptr<const CalibrationTable> t) { std::atomic_store(&table, std::move(t)); }
+
+    // Reload the table if its file was modified since it was last loaded.
+    // Returns true if the table was swapped. Safe to call from any thread.
+    bool reload_if_changed();
+
+    // Mark a run boundary of a live input: the next run_table() reloads the
+    // table if its file changed. Async-signal-safe (e.g. from a SIGHUP handler).
+    void mark_run_boundary() { boundary.store(true, std::memory_order_relaxed); }
+    // Table of the current run, for the next batch
+    std::shared_ptr<const CalibrationTable> run_table();
+
+private:
+    std::string path;
+    std::shared_ptr<const CalibrationTable> table;
+    std::mutex reload_mtx;
+    int64_t loaded_mtime_ns = 0;
+    std::atomic<bool> boundary{false};
+};
+
+#endif // CALIBRATION_H
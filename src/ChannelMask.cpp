@@ -0,0 +1,114 @@
+#include "ChannelMask.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "OCBFramer.h"
+#include "OCBStreamDecoder.h"
+
+ChannelMask ChannelMask::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Failed to open channel mask file: " + path);
+
+    ChannelMask mask;
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        int board, channel;
+        if (!(fields >> board)) continue;  // blank or comment line
+        if (!(fields >> channel)) {
+            throw std::runtime_error("Malformed channel mask entry at " + path + ":" + std::to_string(line_number));
+        }
+        if (board < 0 || board >= OCBConfig::MAX_FEBS_PER_OCB || channel < 0 || channel >= CalibConfig::NUM_CHANNELS) {
+            throw std::runtime_error("Channel mask entry out of range at " + path + ":" + std::to_string(line_number));
+        }
+        mask.set(board, channel);
+    }
+    return mask;
+}
+
+ChannelMask ChannelMask::learn(ByteSource& source, uint64_t n_events, double threshold, OCBLayoutId layout) {
+    using ocb_stream_detail::expect_word;
+    const uint32_t num_febs = static_cast<uint32_t>(get_layout_info(layout).num_febs);
+    constexpr int N = OCBConfig::MAX_FEBS_PER_OCB * CalibConfig::NUM_CHANNELS;
+    std::vector<uint64_t> occupancy(N, 0);
+    std::vector<uint64_t> last_event(N, ~uint64_t(0));  // counts each channel once per event
+
+    OCBFramer framer(source);
+    std::vector<uint32_t> words;
+    uint64_t events = 0;
+    try {
+        while (events < n_events && framer.next(words)) {
+            if (words.size() < 2) throw std::runtime_error("OCB packet too small");
+            expect_word(words.front(), WordID::OCB_PACKET_HEADER);
+            expect_word(words.back(), WordID::OCB_PACKET_TRAILER);
+            uint32_t board = num_febs;  // none yet
+            for (uint32_t w : words) {
+                switch (get_wordID(w)) {
+                    case WordID::GATE_HEADER:
+                        // A GATE_HEADER of type 0 opens the data of one FEB
+                        if (ocb_stream_detail::bits(w, 19, 1) == 0) board = ocb_stream_detail::bits(w, 20, 8);
+                        break;
+                    case WordID::HIT_TIME:
+                    case WordID::HIT_AMPLITUDE: {
+                        if (board >= num_febs) break;
+                        const int key = static_cast<int>(board * CalibConfig::NUM_CHANNELS + ocb_stream_detail::bits(w, 20, 8));
+                        if (last_event[key] != events) {
+                            last_event[key] = events;
+                            occupancy[key]++;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+            events++;
+        }
+    } catch (const std::runtime_error&) {
+        // Learn from the packets before the error; decoding reports it
+    }
+
+    ChannelMask mask;
+    if (events == 0) return mask;
+    for (int key = 0; key < N; ++key) {
+        if (static_cast<double>(occupancy[key]) > threshold * static_cast<double>(events)) {
+            mask.set(key / CalibConfig::NUM_CHANNELS, key % CalibConfig::NUM_CHANNELS);
+        }
+    }
+    return mask;
+}
+
+void ChannelMask::save(const std::string& path) const {
+    std::ofstream out(path);
+    out << "# board channel\n";
+    for (int board = 0; board < OCBConfig::MAX_FEBS_PER_OCB; ++board) {
+        for (int channel = 0; channel < CalibConfig::NUM_CHANNELS; ++channel) {
+            if (test(board, channel)) out << board << " " << channel << "\n";
+        }
+    }
+    if (!out) throw std::runtime_error("Failed to write channel mask file: " + path);
+}
+
+void ChannelMask::set(int board, int channel) {
+    bits[board * WORDS_PER_BOARD + (channel >> 6)] |= uint64_t(1) << (channel & 63);
+}
+
+size_t ChannelMask::count() const {
+    size_t n = 0;
+    for (uint64_t w : bits) n += static_cast<size_t>(__builtin_popcountll(w));
+    return n;
+}
+
+std::string ChannelMask::to_string() const {
+    std::ostringstream s;
+    for (int board = 0; board < OCBConfig::MAX_FEBS_PER_OCB; ++board) {
+        for (int channel = 0; channel < CalibConfig::NUM_CHANNELS; ++channel) {
+            if (!test(board, channel)) continue;
+            if (s.tellp() > 0) s << ",";
+            s << board << ":" << channel;
+        }
+    }
+    return s.str();
+}
@@ -0,0 +1,57 @@
+// ========================= ChannelMask.h =========================
+#ifndef CHANNELMASK_H
+#define CHANNELMASK_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include "Calibration.h"
+#include "InputSource.h"
+#include "OCBLayout.h"
+
+namespace MaskConfig {
+    inline constexpr uint64_t DEFAULT_LEARN_EVENTS = 1000;
+    inline constexpr double DEFAULT_THRESHOLD = 0.5;  // occupancy above which a channel is noisy
+}
+
+// Set of (board, channel) pairs whose HIT_TIME/HIT_AMPLITUDE words are dropped
+// by the decoder before they are parsed (see decode_feb_packet()). One bit per
+// channel, so the test on a raw word is a shift and a mask.
+class ChannelMask {
+public:
+    // One channel per line, '#' starts a comment:
+    //   board channel
+    static ChannelMask load(const std::string& path);
+
+    // Mask the channels with a hit in more than `threshold` of the first
+    // `n_events` OCB packets of `source` (a scan of the raw words, nothing is
+    // decoded; boards outside `layout` are ignored). Stops early at the end of
+    // the input, at a framing error or at a packet without OCB header and trailer.
+    static ChannelMask learn(ByteSource& source, uint64_t n_events, double threshold,
+                             OCBLayoutId layout = OCBLayoutId::DEFAULT);
+
+    // Write the mask in the format read by load()
+    void save(const std::string& path) const;
+
+    void set(int board, int channel);
+
+    bool test(int board, int channel) const {
+        if (board < 0 || board >= OCBConfig::MAX_FEBS_PER_OCB) return false;
+        return (bits[board * WORDS_PER_BOARD + (channel >> 6)] >> (channel & 63)) & 1;
+    }
+
+    // Test a raw hit word (HIT_TIME or HIT_AMPLITUDE, channel_id in bits 20-27) of `board`
+    bool masks(int board, uint32_t word) const { return test(board, (word >> 20) & 0xFF); }
+
+    size_t count() const;
+    bool empty() const { return count() == 0; }
+
+    // "board:channel" list, e.g. for reports and cache keys
+    std::string to_string() const;
+
+private:
+    static constexpr int WORDS_PER_BOARD = CalibConfig::NUM_CHANNELS / 64;
+    std::array<uint64_t, OCBConfig::MAX_FEBS_PER_OCB * WORDS_PER_BOARD> bits{};
+};
+
+#endif // CHANNELMASK_H
@@ -0,0 +1,88 @@
+#include "Checkpoint.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* const MAGIC = "FASERCal checkpoint";
+
+static uint64_t parse_count(const std::string& path, const std::string& key, const std::string& value) {
+    try {
+        size_t end = 0;
+        uint64_t v = std::stoull(value, &end);
+        if (end == value.size()) return v;
+    } catch (const std::exception&) {
+    }
+    throw std::runtime_error("Malformed checkpoint " + path + ": bad " + key + " '" + value + "'");
+}
+
+bool Checkpoint::load(const std::string& path, CheckpointState& state) {
+    std::ifstream in(path);
+    if (!in) {
+        if (errno == ENOENT) return false;
+        throw std::runtime_error("Failed to open checkpoint " + path + ": " + std::strerror(errno));
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != std::string(MAGIC) + " " + std::to_string(CheckpointConfig::FORMAT_VERSION)) {
+        throw std::runtime_error("Not a checkpoint file (or another format version): " + path);
+    }
+
+    CheckpointState s;
+    int found = 0;
+    while (std::getline(in, line)) {
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+        if (key == "input") s.input = value;
+        else if (key == "options") s.options = value;
+        else if (key == "input_size") s.input_size = parse_count(path, key, value);
+        else if (key == "packets") s.packets = parse_count(path, key, value);
+        else if (key == "input_offset") s.input_offset = parse_count(path, key, value);
+        else if (key == "output_offset") s.output_offset = parse_count(path, key, value);
+        else if (key == "masked_words") s.masked_words = parse_count(path, key, value);
+        else continue;
+        found++;
+    }
+    if (found != 7) throw std::runtime_error("Truncated checkpoint: " + path);
+    state = s;
+    return true;
+}
+
+void Checkpoint::save(const std::string& path, const CheckpointState& state) {
+    std::ostringstream text;
+    text << MAGIC << " " << CheckpointConfig::FORMAT_VERSION << "\n"
+         << "input " << state.input << "\n"
+         << "input_size " << state.input_size << "\n"
+         << "options " << state.options << "\n"
+         << "packets " << state.packets << "\n"
+         << "input_offset " << state.input_offset << "\n"
+         << "output_offset " << state.output_offset << "\n"
+         << "masked_words " << state.masked_words << "\n";
+    const std::string data = text.str();
+
+    const std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) throw std::runtime_error("Failed to write checkpoint " + tmp + ": " + std::strerror(errno));
+    bool ok = ::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()) && ::fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed to write checkpoint " + path + ": " + std::strerror(errno));
+    }
+}
+
+void Checkpoint::sync(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || ::fsync(fd) != 0) {
+        int err = errno;
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Failed to sync " + path + ": " + std::strerror(err));
+    }
+    ::close(fd);
+}
@@ -0,0 +1,49 @@
+// ========================= Checkpoint.h =========================
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+
+namespace CheckpointConfig {
+    inline constexpr int FORMAT_VERSION = 2;
+    inline constexpr double DEFAULT_INTERVAL = 30;  // seconds between checkpoints
+}
+
+// Progress of a decoding job: everything needed to continue it from the last
+// batch that was completely written to the output
+struct CheckpointState {
+    std::string input;           // input file path
+    uint64_t input_size = 0;
+    std::string options;         // decoding options that affect the output
+    uint64_t packets = 0;        // OCB packets written to the output
+    uint64_t input_offset = 0;   // input bytes up to the end of the last written packet
+    uint64_t output_offset = 0;  // output bytes written for them
+    uint64_t masked_words = 0;   // hit words dropped by the channel mask so far
+
+    // Same job (input and options), i.e. safe to resume
+    bool same_job(const CheckpointState& other) const {
+        return input == other.input && input_size == other.input_size && options == other.options;
+    }
+};
+
+// Checkpoint file, one "key value" per line:
+//   FASERCal checkpoint <version>
+//   input <path>
+//   input_size / options / packets / input_offset / output_offset / masked_words <value>
+class Checkpoint {
+public:
+    // Returns false if there is no checkpoint at `path`; throws std::runtime_error
+    // if it cannot be read or is malformed
+    static bool load(const std::string& path, CheckpointState& state);
+
+    // Atomically replace the checkpoint at `path` (temporary file, fsync, rename):
+    // a crash leaves either the previous checkpoint or this one
+    static void save(const std::string& path, const CheckpointState& state);
+
+    // Flush a file's data to disk, so that a checkpoint never points past data
+    // that could still be lost
+    static void sync(const std::string& path);
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,151 @@
+#include "ClusterFinder.h"
+#include <algorithm>
+#include <cstdlib>
+
+// Hit times are 13-bit ticks within a GTS window
+static constexpr int64_t TICKS_PER_GTS = 1 << 13;
+// ADC value of a saturated high-gain amplitude
+static constexpr int HG_SATURATION = 4095;
+
+std::ostream& operator<<(std::ostream& out, const Cluster& c) {
+    out << "hits " << c.n_hits << ", energy " << c.energy << ", centroid (" << c.layer << ", " << c.row << ", "
+        << c.column << "), layers " << c.first_layer << "-" << c.last_layer << ", time " << c.time_first << "-"
+        << c.time_last << '\n';
+    return out;
+}
+
+ClusterFinder::ClusterFinder(const GeometryMap& geometry, const ClusterConfig& config)
+    : geometry(geometry), config(config),
+      n_rows(geometry.get_rows()), n_columns(geometry.get_columns()), n_layers(geometry.get_layers()),
+      grid(n_layers * n_rows * n_columns, -1),
+      channel_time(OCBConfig::MAX_FEBS_PER_OCB * GeometryMap::NUM_CHANNELS, -1),
+      channel_stamp(OCBConfig::MAX_FEBS_PER_OCB * GeometryMap::NUM_CHANNELS, 0) {
+    // At most one amplitude hit per channel of the OCB
+    const size_t max_hits = OCBConfig::MAX_FEBS_PER_OCB * GeometryMap::NUM_CHANNELS;
+    hits.reserve(max_hits);
+    parent.resize(max_hits);
+    cluster_of.resize(max_hits);
+}
+
+int32_t ClusterFinder::root(int32_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];  // path halving
+        i = parent[i];
+    }
+    return i;
+}
+
+void ClusterFinder::try_merge(size_t i, int layer, int row, int column) {
+    if (layer < 0 || row < 0 || column < 0 || layer >= (int)n_layers || row >= (int)n_rows || column >= (int)n_columns) return;
+    int32_t j = grid[(static_cast<size_t>(layer) * n_rows + row) * n_columns + column];
+    if (j < 0) return;
+    const CellHit& a = hits[i];
+    const CellHit& b = hits[j];
+    // Hits without a time only need to be adjacent
+    if (a.time >= 0 && b.time >= 0 && std::abs(a.time - b.time) > config.time_window) return;
+    int32_t ra = root(static_cast<int32_t>(i));
+    int32_t rb = root(j);
+    if (ra != rb) parent[std::max(ra, rb)] = std::min(ra, rb);
+}
+
+void ClusterFinder::find(const OCBDataPacket& event, std::vector<Cluster>& out, const float* energies) {
+    // Earliest rising edge of every channel; stamps avoid clearing the table per event
+    if (++stamp == 0) {
+        std::fill(channel_stamp.begin(), channel_stamp.end(), 0);
+        stamp = 1;
+    }
+    for (size_t board = 0; board < event.get_Nfebs_in_ocb(); ++board) {
+        if (!event.hasData(board)) continue;
+        for (const auto& hit : event[board].get_hit_times()) {
+            if (hit.get_hit_time_rise() < 0 || hit.get_channel_id() >= GeometryMap::NUM_CHANNELS) continue;
+            size_t key = board * GeometryMap::NUM_CHANNELS + hit.get_channel_id();
+            int64_t t = static_cast<int64_t>(hit.get_gts_tag_rise()) * TICKS_PER_GTS + hit.get_hit_time_rise();
+            if (channel_stamp[key] != stamp || t < channel_time[key]) channel_time[key] = t;
+            channel_stamp[key] = stamp;
+        }
+    }
+
+    // Place the hits in the grid
+    hits.clear();
+    size_t k = 0;
+    for (size_t board = 0; board < event.get_Nfebs_in_ocb(); ++board) {
+        if (!event.hasData(board)) continue;
+        for (const auto& hit : event[board].get_hit_amplitudes()) {
+            float energy;
+            if (energies) energy = energies[k];
+            else if (hit.get_amplitude_hg() >= 0 && hit.get_amplitude_hg() < HG_SATURATION) energy = static_cast<float>(hit.get_amplitude_hg());
+            else energy = static_cast<float>(hit.get_amplitude_lg());
+            ++k;
+
+            CellIndex cell = geometry.lookup(config.ocb_id, static_cast<int>(board), hit.get_channel_id());
+            if (!cell.valid() || !(energy > 0) || hits.size() == hits.capacity()) continue;
+
+            size_t key = board * GeometryMap::NUM_CHANNELS + hit.get_channel_id();
+            CellHit h;
+            h.cell = cell;
+            h.grid_index = static_cast<int32_t>((static_cast<size_t>(cell.layer) * n_rows + cell.row) * n_columns + cell.column);
+            h.energy = energy;
+            h.time = channel_stamp[key] == stamp ? channel_time[key] : -1;
+            parent[hits.size()] = static_cast<int32_t>(hits.size());
+            hits.push_back(h);
+        }
+    }
+    for (size_t i = 0; i < hits.size(); ++i) {
+        int32_t& slot = grid[hits[i].grid_index];
+        if (slot >= 0) {
+            // Two channels mapped to the same cell: always the same cluster
+            parent[root(static_cast<int32_t>(i))] = root(slot);
+        } else {
+            slot = static_cast<int32_t>(i);
+        }
+    }
+
+    // Union neighbouring cells
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const CellIndex& c = hits[i].cell;
+        for (int dr = -1; dr <= 1; ++dr) {
+            for (int dc = -1; dc <= 1; ++dc) {
+                if (dr != 0 || dc != 0) try_merge(i, c.layer, c.row + dr, c.column + dc);
+            }
+        }
+        if (config.connect_layers) {
+            try_merge(i, c.layer - 1, c.row, c.column);
+            try_merge(i, c.layer + 1, c.row, c.column);
+        }
+    }
+
+    // Summaries, in order of the first hit of each cluster
+    const size_t first = out.size();
+    for (size_t i = 0; i < hits.size(); ++i) cluster_of[i] = -1;
+    for (size_t i = 0; i < hits.size(); ++i) {
+        const CellHit& h = hits[i];
+        int32_t r = root(static_cast<int32_t>(i));
+        if (cluster_of[r] < 0) {
+            cluster_of[r] = static_cast<int32_t>(out.size());
+            Cluster c;
+            c.event_id = event.get_event_id();
+            c.first_layer = c.last_layer = h.cell.layer;
+            out.push_back(c);
+        }
+        Cluster& c = out[cluster_of[r]];
+        c.n_hits++;
+        c.energy += h.energy;
+        c.layer += h.energy * h.cell.layer;
+        c.row += h.energy * h.cell.row;
+        c.column += h.energy * h.cell.column;
+        c.first_layer = std::min<int>(c.first_layer, h.cell.layer);
+        c.last_layer = std::max<int>(c.last_layer, h.cell.layer);
+        if (h.time >= 0) {
+            if (c.time_first < 0 || h.time < c.time_first) c.time_first = h.time;
+            if (h.time > c.time_last) c.time_last = h.time;
+        }
+    }
+    for (size_t i = first; i < out.size(); ++i) {
+        out[i].layer /= out[i].energy;
+        out[i].row /= out[i].energy;
+        out[i].column /= out[i].energy;
+    }
+
+    // Leave the grid empty for the next event
+    for (const auto& h : hits) grid[h.grid_index] = -1;
+}
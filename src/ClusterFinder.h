@@ -0,0 +1,70 @@
+// ========================= ClusterFinder.h =========================
+#ifndef CLUSTERFINDER_H
+#define CLUSTERFINDER_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "Geometry.h"
+#include "OCBDecoder.h"
+
+struct ClusterConfig {
+    int ocb_id = 0;              // OCB whose geometry entries apply to the decoded packets
+    int64_t time_window = 16;    // max rise-time difference of neighbouring hits, in hit-time ticks
+    bool connect_layers = true;  // same row/column in adjacent layers are neighbours
+};
+
+// Summary of one cluster of neighbouring, time-coincident hits
+struct Cluster {
+    uint32_t event_id = 0;
+    int n_hits = 0;
+    float energy = 0;                             // sum over the hits
+    float layer = 0, row = 0, column = 0;         // energy-weighted centroid
+    int first_layer = 0, last_layer = 0;
+    int64_t time_first = -1, time_last = -1;      // rise times (gts_tag * 2^13 + hit_time), -1 if no hit time
+};
+
+std::ostream& operator<<(std::ostream& out, const Cluster& cluster);
+
+// Finds clusters in one event at a time. A hit is an amplitude hit of a mapped
+// channel with positive energy, timed by the earliest rising edge of its
+// channel. Hits are placed in a fixed 3D grid (layers x rows x columns) and
+// merged with union-find over the 8 in-layer neighbours (and the cells above
+// and below) when their times agree within the window. All buffers are sized
+// once from the geometry, so find() does not allocate; one finder per thread.
+class ClusterFinder {
+public:
+    ClusterFinder(const GeometryMap& geometry, const ClusterConfig& config = ClusterConfig());
+
+    // Append the clusters of `event` to `out`. `energies`, if given, holds one
+    // energy per amplitude hit, in board order (as CalibratedHits::append);
+    // otherwise the raw HG amplitude is used, or LG if HG is saturated.
+    void find(const OCBDataPacket& event, std::vector<Cluster>& out, const float* energies = nullptr);
+
+    const GeometryMap& get_geometry() const { return geometry; }
+
+private:
+    struct CellHit {
+        CellIndex cell;
+        int32_t grid_index;
+        float energy;
+        int64_t time;
+    };
+
+    const GeometryMap& geometry;
+    ClusterConfig config;
+    size_t n_rows, n_columns, n_layers;
+
+    std::vector<int32_t> grid;          // cell -> hit index, -1 if empty
+    std::vector<CellHit> hits;
+    std::vector<int32_t> parent;        // union-find over hits
+    std::vector<int32_t> cluster_of;    // root hit -> index in the output
+    std::vector<int64_t> channel_time;  // board * 256 + channel -> earliest rise time
+    std::vector<uint32_t> channel_stamp;
+    uint32_t stamp = 0;
+
+    int32_t root(int32_t i);
+    void try_merge(size_t i, int layer, int row, int column);
+};
+
+#endif // CLUSTERFINDER_H
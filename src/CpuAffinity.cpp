@@ -0,0 +1,16 @@
+#include "CpuAffinity.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+
+void pin_current_thread(unsigned cpu) {
+    unsigned ncpu = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % ncpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        std::cerr << "Warning: failed to pin thread to CPU " << cpu % ncpu << "\n";
+    }
+}
@@ -0,0 +1,9 @@
+// ========================= CpuAffinity.h =========================
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+
+// Pin the calling thread to one CPU (modulo the number of CPUs). Best effort:
+// a failure only prints a warning.
+void pin_current_thread(unsigned cpu);
+
+#endif // CPUAFFINITY_H
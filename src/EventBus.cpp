@@ -0,0 +1,77 @@
+#include "EventBus.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+EventBus::EventBus(size_t capacity) : ring(std::max<size_t>(1, capacity)) {}
+
+int EventBus::subscribe(const std::string& name, Policy policy) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Subscriber s;
+    s.stats.name = name;
+    s.stats.policy = policy;
+    s.cursor = head;
+    subscribers.push_back(s);
+    return static_cast<int>(subscribers.size() - 1);
+}
+
+void EventBus::unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(mtx);
+    subscribers.at(id).active = false;
+    writable.notify_all();
+}
+
+void EventBus::publish(Batch batch) {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (closed) throw std::runtime_error("Publishing on a closed event bus");
+
+    // The slot about to be reused must have been read by every BLOCK subscriber
+    for (;;) {
+        Subscriber* slowest = nullptr;
+        for (auto& s : subscribers) {
+            if (s.active && s.stats.policy == Policy::BLOCK && head - s.cursor >= ring.size()) slowest = &s;
+        }
+        if (!slowest) break;
+        auto t0 = std::chrono::steady_clock::now();
+        writable.wait(lock);
+        slowest->stats.stalled_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    ring[head % ring.size()] = std::move(batch);
+    ++head;
+    for (auto& s : subscribers) {
+        if (s.active) s.stats.max_lag = std::max(s.stats.max_lag, head - s.cursor);
+    }
+    readable.notify_all();
+}
+
+bool EventBus::next(int id, Batch& batch) {
+    std::unique_lock<std::mutex> lock(mtx);
+    Subscriber& s = subscribers.at(id);
+    readable.wait(lock, [&] { return s.cursor < head || closed; });
+    if (s.cursor == head) return false;
+
+    // Overtaken by the publisher (DROP): continue with the oldest batch still in the ring
+    if (head - s.cursor > ring.size()) {
+        s.stats.dropped += head - ring.size() - s.cursor;
+        s.cursor = head - ring.size();
+    }
+    batch = ring[s.cursor % ring.size()];
+    ++s.cursor;
+    ++s.stats.delivered;
+    if (s.stats.policy == Policy::BLOCK) writable.notify_all();
+    return true;
+}
+
+void EventBus::close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    readable.notify_all();
+}
+
+std::vector<EventBus::SubscriberStats> EventBus::get_stats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<SubscriberStats> out;
+    for (const auto& s : subscribers) out.push_back(s.stats);
+    return out;
+}
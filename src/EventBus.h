@@ -0,0 +1,77 @@
+// ========================= EventBus.h =========================
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Pipeline.h"
+
+// Publish/subscribe fan-out of decoded batches to several consumers (disk
+// writer, monitoring, trigger, ...). Batches are published once as immutable,
+// reference-counted PacketBatch objects into a ring of `capacity` slots; every
+// subscriber reads the ring at its own cursor and only copies the pointer, so
+// adding a consumer adds neither decoding work nor copies of the events.
+//
+// Backpressure is per subscriber: the publisher waits for a BLOCK subscriber
+// that is a full ring behind, while a DROP subscriber that far behind skips
+// its oldest batches (counted in its stats) and never holds the others back.
+class EventBus {
+public:
+    using Batch = std::shared_ptr<const PacketBatch>;
+
+    enum class Policy { BLOCK, DROP };
+
+    struct SubscriberStats {
+        std::string name;
+        Policy policy = Policy::BLOCK;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;         // batches skipped (DROP)
+        uint64_t max_lag = 0;         // most batches published but not yet read
+        double stalled_seconds = 0;   // publisher time spent waiting for this subscriber (BLOCK)
+    };
+
+    explicit EventBus(size_t capacity = 16);
+
+    EventBus(const EventBus&) = delete;
+    EventBus& operator=(const EventBus&) = delete;
+
+    // Register a consumer; it receives the batches published from now on
+    int subscribe(const std::string& name, Policy policy);
+
+    // The consumer stops reading (e.g. it failed): never wait for it again
+    void unsubscribe(int id);
+
+    // Called by the single producer, in stream order
+    void publish(Batch batch);
+
+    // Next batch for subscriber `id`, in publish order. Blocks while there is
+    // none; returns false once the bus is closed and the subscriber has read
+    // everything.
+    bool next(int id, Batch& batch);
+
+    // No more batches will be published: wake up all subscribers
+    void close();
+
+    std::vector<SubscriberStats> get_stats() const;
+
+private:
+    struct Subscriber {
+        SubscriberStats stats;
+        uint64_t cursor = 0;  // sequence number of the next batch to read
+        bool active = true;
+    };
+
+    mutable std::mutex mtx;
+    std::condition_variable readable, writable;
+    std::vector<Batch> ring;
+    uint64_t head = 0;  // sequence number of the next batch to publish
+    bool closed = false;
+    std::deque<Subscriber> subscribers;  // stable references while next() waits
+};
+
+#endif // EVENTBUS_H
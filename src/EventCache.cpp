@@ -0,0 +1,575 @@
+#include "EventCache.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const char MAGIC[4] = {'F', 'C', 'E', 'V'};
+
+static void put_le(uint8_t* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+// ---------------- EventCodec ----------------
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+// Fields are mostly small and non-negative, -1 when absent: zigzag keeps both short
+static void put_signed(std::vector<uint8_t>& out, int64_t v) {
+    put_varint(out, (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+}
+
+// Two small fields in one varint: zigzag values with their bits interleaved
+static uint64_t spread_bits(uint32_t a) {
+    uint64_t x = a;
+    x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+    x = (x | x << 8) & 0x00FF00FF00FF00FFull;
+    x = (x | x << 4) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | x << 2) & 0x3333333333333333ull;
+    x = (x | x << 1) & 0x5555555555555555ull;
+    return x;
+}
+
+static uint32_t gather_bits(uint64_t x) {
+    x &= 0x5555555555555555ull;
+    x = (x | x >> 1) & 0x3333333333333333ull;
+    x = (x | x >> 2) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | x >> 4) & 0x00FF00FF00FF00FFull;
+    x = (x | x >> 8) & 0x0000FFFF0000FFFFull;
+    x = (x | x >> 16) & 0x00000000FFFFFFFFull;
+    return static_cast<uint32_t>(x);
+}
+
+static uint64_t interleave(uint32_t a, uint32_t b) { return spread_bits(a) | spread_bits(b) << 1; }
+
+static uint32_t zigzag(int v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+static int unzigzag(uint32_t u) { return static_cast<int>(u >> 1) ^ -static_cast<int>(u & 1); }
+
+static void put_pair(std::vector<uint8_t>& out, int a, int b) {
+    put_varint(out, interleave(zigzag(a), zigzag(b)));
+}
+
+namespace {
+
+class RecordReader {
+public:
+    RecordReader(const uint8_t* p, size_t n) : p(p), end(p + n) {}
+
+    uint64_t varint() {
+        if (p != end && *p < 0x80) return *p++;  // most fields fit in one byte
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) corrupt();
+            uint8_t b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        corrupt();
+    }
+
+    int64_t signed_varint() {
+        uint64_t u = varint();
+        return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+    }
+
+    int signed_int() { return static_cast<int>(signed_varint()); }
+
+    std::pair<int, int> pair() {
+        uint64_t v = varint();
+        return {unzigzag(gather_bits(v)), unzigzag(gather_bits(v >> 1))};
+    }
+
+    // Element count, bounded by the bytes left (every element takes at least one)
+    size_t count() {
+        uint64_t n = varint();
+        if (n > static_cast<uint64_t>(end - p)) corrupt();
+        return static_cast<size_t>(n);
+    }
+
+    bool done() const { return p == end; }
+
+    [[noreturn]] static void corrupt() { throw std::runtime_error("Corrupt event cache record"); }
+
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+};
+
+}  // namespace
+
+void EventCodec::encode(const OCBDataPacket& event, std::vector<uint8_t>& out) {
+    put_varint(out, event.event.event_id);
+    uint32_t errors = 0;
+    for (size_t i = 0; i < event.ocb_errors.size(); ++i) errors |= static_cast<uint32_t>(event.ocb_errors[i]) << i;
+    put_varint(out, errors);
+    put_varint(out, event.event.n_febs);
+
+    size_t present = 0;
+    for (const auto& feb : event.event.febs) present += feb != nullptr;
+    put_varint(out, present);
+
+    for (size_t b = 0; b < event.event.febs.size(); ++b) {
+        if (!event.event.febs[b]) continue;
+        const FEBDataPacket& f = *event.event.febs[b];
+        put_varint(out, b);
+        put_signed(out, f.board_id);
+        put_signed(out, f.hold_time);
+        put_signed(out, f.gate_time);
+        put_varint(out, static_cast<uint32_t>(f.artificial_trl2) | f.event_done_timeout << 1 | f.d1_fifo_full << 2
+                        | f.d0_fifo_full << 3 | f.rb_cnt_error << 4);
+        put_signed(out, f.nb_decoder_errors);
+        put_varint(out, static_cast<uint64_t>(f.masked_words));
+
+        // GTS tags and times as deltas from the previous window; hit board ids
+        // relative to the FEB's, channels and GTS tags relative to the previous
+        // hit's (hits come sorted by channel), 2-bit tag ids paired
+        int64_t prev_tag = 0, prev_time = 0;
+        put_varint(out, f._gts_tag_map.size());
+        for (const auto& [tag, time] : f._gts_tag_map) {
+            put_signed(out, int64_t(tag) - prev_tag);
+            put_signed(out, int64_t(time) - prev_time);
+            prev_tag = tag;
+            prev_time = time;
+        }
+        int64_t gts = f._gts_tag_map.empty() ? 0 : f._gts_tag_map.begin()->first;
+        int64_t channel = 0;
+        put_varint(out, f._hit_times.size());
+        for (const auto& h : f._hit_times) {
+            put_pair(out, h.get_board_id() - f.board_id, h.get_hit_id());
+            put_signed(out, int64_t(h.get_channel_id()) - channel);
+            put_signed(out, int64_t(h.get_gts_tag_rise()) - gts);
+            put_signed(out, int64_t(h.get_gts_tag_fall()) - h.get_gts_tag_rise());
+            put_pair(out, h.get_tag_id_rise(), h.get_tag_id_fall());
+            put_signed(out, h.get_hit_time_rise());
+            put_signed(out, h.get_hit_time_fall());
+            channel = h.get_channel_id();
+            gts = h.get_gts_tag_rise();
+        }
+        channel = 0;
+        put_varint(out, f._hit_amplitudes.size());
+        for (const auto& h : f._hit_amplitudes) {
+            put_pair(out, h.get_board_id() - f.board_id, h.get_hit_id());
+            put_signed(out, int64_t(h.get_channel_id()) - channel);
+            put_signed(out, int64_t(h.get_gts_tag_lg()) - gts);
+            put_signed(out, int64_t(h.get_gts_tag_hg()) - h.get_gts_tag_lg());
+            put_pair(out, h.get_tag_id_lg(), h.get_tag_id_hg());
+            put_signed(out, h.get_amplitude_lg());
+            put_signed(out, h.get_amplitude_hg());
+            channel = h.get_channel_id();
+            gts = h.get_gts_tag_lg();
+        }
+    }
+}
+
+OCBDataPacket EventCodec::decode(const uint8_t* data, size_t size) {
+    RecordReader r(data, size);
+    OCBDataPacket event;
+    event.event.event_id = static_cast<uint32_t>(r.varint());
+    uint64_t errors = r.varint();
+    for (size_t i = 0; i < event.ocb_errors.size(); ++i) event.ocb_errors[i] = (errors >> i) & 1;
+    event.event.n_febs = r.varint();
+    if (event.event.n_febs > event.event.febs.size()) RecordReader::corrupt();
+
+    size_t present = r.count();
+    for (size_t k = 0; k < present; ++k) {
+        uint64_t b = r.varint();
+        if (b >= event.event.n_febs || event.event.febs[b]) RecordReader::corrupt();
+        auto feb = std::shared_ptr<FEBDataPacket>(new FEBDataPacket());
+        FEBDataPacket& f = *feb;
+        f.board_id = r.signed_int();
+        f.hold_time = r.signed_int();
+        f.gate_time = r.signed_int();
+        uint64_t flags = r.varint();
+        f.artificial_trl2 = flags & 1;
+        f.event_done_timeout = flags & 2;
+        f.d1_fifo_full = flags & 4;
+        f.d0_fifo_full = flags & 8;
+        f.rb_cnt_error = flags & 16;
+        f.nb_decoder_errors = r.signed_int();
+        f.masked_words = static_cast<int>(r.varint());
+
+        int64_t tag = 0, time = 0;
+        for (size_t n = r.count(); n > 0; --n) {
+            tag += r.signed_varint();
+            time += r.signed_varint();
+            f._gts_tag_map.emplace_hint(f._gts_tag_map.end(), static_cast<uint32_t>(tag), static_cast<uint32_t>(time));
+        }
+        int64_t gts = f._gts_tag_map.empty() ? 0 : f._gts_tag_map.begin()->first;
+        int64_t channel = 0;
+        size_t n_times = r.count();
+        f._hit_times.reserve(n_times);
+        for (size_t n = 0; n < n_times; ++n) {
+            auto [board, hit_id] = r.pair();
+            channel += r.signed_varint();
+            HitTimeData& h = f._hit_times.emplace_back(f.board_id + board, static_cast<int>(channel), hit_id);
+            gts += r.signed_varint();
+            h.set_gts_tag_rise(static_cast<int>(gts));
+            h.set_gts_tag_fall(static_cast<int>(gts + r.signed_varint()));
+            auto [tag_rise, tag_fall] = r.pair();
+            h.set_tag_id_rise(tag_rise);
+            h.set_tag_id_fall(tag_fall);
+            h.set_hit_time_rise(r.signed_int());
+            h.set_hit_time_fall(r.signed_int());
+        }
+        channel = 0;
+        size_t n_amplitudes = r.count();
+        f._hit_amplitudes.reserve(n_amplitudes);
+        for (size_t n = 0; n < n_amplitudes; ++n) {
+            auto [board, hit_id] = r.pair();
+            channel += r.signed_varint();
+            HitAmplitudeData& h = f._hit_amplitudes.emplace_back(f.board_id + board, static_cast<int>(channel), hit_id);
+            gts += r.signed_varint();
+            h.set_gts_tag_lg(static_cast<int>(gts));
+            h.set_gts_tag_hg(static_cast<int>(gts + r.signed_varint()));
+            auto [tag_lg, tag_hg] = r.pair();
+            h.set_tag_id_lg(tag_lg);
+            h.set_tag_id_hg(tag_hg);
+            h.set_amplitude_lg(r.signed_int());
+            h.set_amplitude_hg(r.signed_int());
+        }
+        event.event.febs[b] = std::move(feb);
+    }
+    if (!r.done()) RecordReader::corrupt();
+    return event;
+}
+
+// ---------------- EventCacheReader ----------------
+
+std::unique_ptr<EventCacheReader> EventCacheReader::open(const std::string& path, uint64_t input_size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < CacheConfig::HEADER_SIZE) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<EventCacheReader> reader(new EventCacheReader());
+    reader->data = static_cast<const uint8_t*>(p);
+    reader->size = size;
+
+    const uint8_t* h = reader->data;
+    if (std::memcmp(h, MAGIC, 4) != 0 || get_le(h + 4, 4) != CacheConfig::FORMAT_VERSION
+        || get_le(h + 8, 4) != OCBConfig::DECODER_VERSION || get_le(h + 16, 8) != input_size) {
+        return nullptr;
+    }
+    reader->n_events = get_le(h + 24, 8);
+    reader->error_packet = get_le(h + 32, 8);
+    uint64_t message_offset = get_le(h + 40, 8);
+    uint64_t index_offset = get_le(h + 48, 8);
+    if (message_offset < CacheConfig::HEADER_SIZE || message_offset > index_offset || index_offset > size
+        || reader->n_events > (size - index_offset) / 8 || index_offset + reader->n_events * 8 != size) {
+        return nullptr;
+    }
+    reader->records_end = message_offset;
+    reader->error_message.assign(reinterpret_cast<const char*>(h + message_offset), index_offset - message_offset);
+    reader->index = h + index_offset;
+    madvise(p, size, MADV_WILLNEED);
+    return reader;
+}
+
+EventCacheReader::~EventCacheReader() {
+    if (data) munmap(const_cast<uint8_t*>(data), size);
+}
+
+void EventCacheReader::load(PacketBatch& batch) const {
+    const size_t n = batch.error ? batch.error_index : batch.packets.size();
+    batch.events.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        const uint64_t k = batch.first_packet + i;
+        try {
+            if (k == error_packet) throw std::runtime_error(error_message);
+            if (k >= n_events) throw std::runtime_error("Event cache entry has fewer events than the input");
+            uint64_t begin = get_le(index + 8 * k, 8);
+            uint64_t end = k + 1 < n_events ? get_le(index + 8 * (k + 1), 8) : records_end;
+            if (begin < CacheConfig::HEADER_SIZE || begin > end || end > records_end) RecordReader::corrupt();
+            batch.events.push_back(EventCodec::decode(data + begin, end - begin));
+        } catch (...) {
+            batch.error = std::current_exception();
+            batch.error_index = i;
+            break;
+        }
+    }
+}
+
+// ---------------- EventCacheWriter ----------------
+
+EventCacheWriter::EventCacheWriter(const std::string& path, uint64_t input_size)
+    : path(path), tmp_path(path + ".tmp." + std::to_string(::getpid())), input_size(input_size) {
+    fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Failed to create event cache entry: " + tmp_path + ": " + std::strerror(errno));
+    // Header is written last, by commit()
+    uint8_t header[CacheConfig::HEADER_SIZE] = {};
+    write_all(header, sizeof(header));
+}
+
+EventCacheWriter::~EventCacheWriter() {
+    if (fd >= 0) ::close(fd);
+    if (!committed) ::unlink(tmp_path.c_str());
+}
+
+void EventCacheWriter::write_all(const void* p, size_t n) {
+    const char* c = static_cast<const char*>(p);
+    while (n > 0) {
+        ssize_t w = ::write(fd, c, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) throw std::runtime_error("Failed to write event cache entry: " + tmp_path + ": " + std::strerror(errno));
+        c += w;
+        n -= static_cast<size_t>(w);
+    }
+}
+
+void EventCacheWriter::flush() {
+    write_all(buffer.data(), buffer.size());
+    offset += buffer.size();
+    buffer.clear();
+}
+
+void EventCacheWriter::append(const PacketBatch& batch) {
+    if (incomplete || has_decode_error()) return;
+    for (const auto& ev : batch.events) {
+        offsets.push_back(offset + buffer.size());
+        EventCodec::encode(ev, buffer);
+    }
+    if (buffer.size() >= (1 << 20)) flush();
+
+    if (batch.error) {
+        // Decoding failed at a framed packet: remember it. Otherwise reading failed,
+        // and the packets after it are unknown.
+        if (batch.error_index < batch.packets.size() && batch.events.size() == batch.error_index) {
+            error_packet = batch.first_packet + batch.error_index;
+            try {
+                std::rethrow_exception(batch.error);
+            } catch (const std::exception& e) {
+                error_message = e.what();
+            } catch (...) {
+                error_message = "Unknown decoding error";
+            }
+        } else {
+            incomplete = true;
+        }
+    }
+}
+
+bool EventCacheWriter::commit() {
+    if (incomplete || committed) return false;
+    flush();
+    const uint64_t message_offset = offset;
+    write_all(error_message.data(), error_message.size());
+    const uint64_t index_offset = message_offset + error_message.size();
+
+    std::vector<uint8_t> index(offsets.size() * 8);
+    for (size_t i = 0; i < offsets.size(); ++i) put_le(index.data() + 8 * i, offsets[i], 8);
+    write_all(index.data(), index.size());
+
+    uint8_t h[CacheConfig::HEADER_SIZE] = {};
+    std::memcpy(h, MAGIC, 4);
+    put_le(h + 4, CacheConfig::FORMAT_VERSION, 4);
+    put_le(h + 8, OCBConfig::DECODER_VERSION, 4);
+    put_le(h + 16, input_size, 8);
+    put_le(h + 24, offsets.size(), 8);
+    put_le(h + 32, error_packet, 8);
+    put_le(h + 40, message_offset, 8);
+    put_le(h + 48, index_offset, 8);
+    if (::pwrite(fd, h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h))) {
+        throw std::runtime_error("Failed to write event cache entry: " + tmp_path);
+    }
+    ::close(fd);
+    fd = -1;
+    if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Failed to commit event cache entry: " + path + ": " + std::strerror(errno));
+    }
+    committed = true;
+    return true;
+}
+
+// ---------------- EventCache ----------------
+
+namespace {
+
+// Fast 64-bit hash of a byte stream, independent of how it is split into update() calls
+class Hasher {
+public:
+    explicit Hasher(uint64_t seed = 0) : h(seed ^ 0x9E3779B97F4A7C15ull) {}
+
+    void update(const void* data, size_t n) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        length += n;
+        while (n > 0 && pending_len > 0) {
+            pending[pending_len++] = *p++;
+            --n;
+            if (pending_len == 8) {
+                mix(load(pending));
+                pending_len = 0;
+            }
+        }
+        for (; n >= 8; n -= 8, p += 8) mix(load(p));
+        while (n-- > 0) pending[pending_len++] = *p++;
+    }
+
+    void update(const std::string& s) {
+        update(s.data(), s.size());
+        update(uint64_t(s.size()));
+    }
+
+    void update(uint64_t v) { update(&v, sizeof(v)); }
+
+    uint64_t digest() const {
+        uint64_t tail = 0;
+        std::memcpy(&tail, pending, pending_len);
+        uint64_t d = h;
+        d ^= (tail ^ length) * 0xC2B2AE3D27D4EB4Full;
+        d ^= d >> 33;
+        d *= 0xFF51AFD7ED558CCDull;
+        d ^= d >> 33;
+        return d;
+    }
+
+private:
+    uint64_t h;
+    uint64_t length = 0;
+    uint8_t pending[8];
+    size_t pending_len = 0;
+
+    static uint64_t load(const uint8_t* p) {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        return w;
+    }
+
+    void mix(uint64_t w) {
+        h ^= w * 0x87C37B91114253D5ull;
+        h = (h << 31 | h >> 33) * 0x4CF5AD432745937Full;
+    }
+};
+
+}  // namespace
+
+// Hash of the first `limit` bytes of a file
+static uint64_t hash_file(const std::string& path, uint64_t limit) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    Hasher hasher;
+    std::vector<char> buf(1 << 20);
+    uint64_t done = 0;
+    while (done < limit) {
+        ssize_t r = ::read(fd, buf.data(), static_cast<size_t>(std::min<uint64_t>(buf.size(), limit - done)));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read " + path + ": " + std::strerror(errno));
+        }
+        if (r == 0) break;
+        hasher.update(buf.data(), static_cast<size_t>(r));
+        done += static_cast<uint64_t>(r);
+    }
+    ::close(fd);
+    return hasher.digest();
+}
+
+EventCache::EventCache(std::string dir, uint64_t size_limit, CacheKey key)
+    : dir(std::move(dir)), size_limit(size_limit), key(key) {
+    std::error_code ec;
+    fs::create_directories(this->dir, ec);
+    if (!fs::is_directory(this->dir)) throw std::runtime_error("Cannot use event cache directory: " + this->dir);
+}
+
+std::string EventCache::entry_path(const std::string& input, const std::string& config) const {
+    struct stat st;
+    if (::stat(input.c_str(), &st) != 0) throw std::runtime_error("Failed to stat file: " + input);
+
+    Hasher h;
+    h.update(uint64_t(key));
+    h.update(uint64_t(st.st_size));
+    if (key == CacheKey::STAT) {
+        h.update(uint64_t(st.st_mtim.tv_sec) * 1000000000ull + uint64_t(st.st_mtim.tv_nsec));
+        h.update(hash_file(input, CacheConfig::STAT_KEY_BYTES));
+    } else {
+        h.update(hash_file(input, ~uint64_t(0)));
+    }
+    h.update(uint64_t(CacheConfig::FORMAT_VERSION));
+    h.update(uint64_t(OCBConfig::DECODER_VERSION));
+    h.update(config);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.fcev", static_cast<unsigned long long>(h.digest()));
+    return (fs::path(dir) / name).string();
+}
+
+void EventCache::touch(const std::string& path) {
+    ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+}
+
+void EventCache::evict() const {
+    struct Entry {
+        fs::file_time_type mtime;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    const auto now = fs::file_time_type::clock::now();
+
+    for (const auto& e : fs::directory_iterator(dir, ec)) {
+        if (!e.is_regular_file(ec)) continue;
+        const fs::path& p = e.path();
+        const std::string name = p.filename().string();
+        auto mtime = e.last_write_time(ec);
+        if (ec) continue;
+
+        // Temporary files of runs that died more than a day ago
+        if (name.find(".fcev.tmp.") != std::string::npos) {
+            if (now - mtime > std::chrono::hours(24)) fs::remove(p, ec);
+            continue;
+        }
+        if (p.extension() != ".fcev") continue;
+
+        // Entries of another format or decoder version can never be hit again
+        uint8_t h[12] = {};
+        int fd = ::open(p.c_str(), O_RDONLY);
+        bool current = fd >= 0 && ::read(fd, h, sizeof(h)) == static_cast<ssize_t>(sizeof(h))
+                       && std::memcmp(h, MAGIC, 4) == 0 && get_le(h + 4, 4) == CacheConfig::FORMAT_VERSION
+                       && get_le(h + 8, 4) == OCBConfig::DECODER_VERSION;
+        if (fd >= 0) ::close(fd);
+        if (!current) {
+            fs::remove(p, ec);
+            continue;
+        }
+        uint64_t size = e.file_size(ec);
+        if (ec) continue;
+        entries.push_back({mtime, size, p});
+        total += size;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+    for (const auto& e : entries) {
+        if (total <= size_limit) break;
+        if (fs::remove(e.path, ec)) total -= e.size;
+    }
+}
@@ -0,0 +1,132 @@
+// ========================= EventCache.h =========================
+#ifndef EVENTCACHE_H
+#define EVENTCACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "OCBDecoder.h"
+#include "Pipeline.h"
+
+// On-disk cache of decoded events. The first decode of a file writes its
+// events to <cache dir>/<key>.fcev; later runs over the same file map that
+// entry and restore the events instead of decoding. Entry layout:
+//   header   "FCEV", format version u32, decoder version u32, reserved u32,
+//            input size u64, events u64, decode error packet u64 (~0: none),
+//            error message offset u64, index offset u64   (little-endian)
+//   records  one varint-coded event per decoded packet
+//   message  what() of the decoding error, if any
+//   index    offset u64 of every record
+namespace CacheConfig {
+    inline constexpr uint32_t FORMAT_VERSION = 2;
+    inline constexpr size_t HEADER_SIZE = 56;
+    inline constexpr uint64_t NO_ERROR = ~uint64_t(0);
+    inline constexpr uint64_t DEFAULT_SIZE_LIMIT = uint64_t(4) << 30;  // bytes
+    inline constexpr size_t STAT_KEY_BYTES = 1 << 20;  // hashed head of the file for CacheKey::STAT
+}
+
+enum class CacheKey {
+    CONTENT,  // hash of the whole file
+    STAT,     // size + mtime + hash of the first STAT_KEY_BYTES
+};
+
+// Compact binary form of OCBDataPacket (varints, zigzag for signed fields)
+class EventCodec {
+public:
+    static void encode(const OCBDataPacket& event, std::vector<uint8_t>& out);
+    // Decode one record; throws std::runtime_error if it is malformed
+    static OCBDataPacket decode(const uint8_t* data, size_t size);
+};
+
+// Read-only view of one committed cache entry (memory-mapped). load() may be
+// called concurrently from several decoder threads.
+class EventCacheReader {
+public:
+    // nullptr if the entry does not exist, is truncated, was written by another
+    // format or decoder version, or is for a file of a different size
+    static std::unique_ptr<EventCacheReader> open(const std::string& path, uint64_t input_size);
+    ~EventCacheReader();
+
+    EventCacheReader(const EventCacheReader&) = delete;
+    EventCacheReader& operator=(const EventCacheReader&) = delete;
+
+    // Restore the events of the batch's packets, reproducing the decoding error
+    // of the original run at the same packet
+    void load(PacketBatch& batch) const;
+
+    uint64_t get_events() const { return n_events; }
+
+private:
+    EventCacheReader() = default;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint64_t n_events = 0;
+    uint64_t error_packet = CacheConfig::NO_ERROR;
+    std::string error_message;
+    uint64_t records_end = 0;
+    const uint8_t* index = nullptr;
+};
+
+// Writes a new cache entry from the batches of a decoding run, in input order,
+// to a temporary file that commit() renames into place (an entry is visible
+// complete or not at all). Runs cut short by a read error are not committed.
+class EventCacheWriter {
+public:
+    EventCacheWriter(const std::string& path, uint64_t input_size);
+    ~EventCacheWriter();
+
+    EventCacheWriter(const EventCacheWriter&) = delete;
+    EventCacheWriter& operator=(const EventCacheWriter&) = delete;
+
+    void append(const PacketBatch& batch);
+
+    // A batch ended with a decoding error: the entry is complete up to there and
+    // will reproduce the error (runs ending with it can be committed)
+    bool has_decode_error() const { return error_packet != CacheConfig::NO_ERROR; }
+
+    // Write the index and header and move the entry into place, once all the
+    // batches of the input were appended. Returns false (and writes nothing) if
+    // a batch was cut short by a read error.
+    bool commit();
+
+private:
+    std::string path, tmp_path;
+    int fd = -1;
+    uint64_t input_size;
+    uint64_t offset = CacheConfig::HEADER_SIZE;
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> buffer;
+    uint64_t error_packet = CacheConfig::NO_ERROR;
+    std::string error_message;
+    bool incomplete = false;
+    bool committed = false;
+
+    void write_all(const void* p, size_t n);
+    void flush();
+};
+
+// One cache directory with a size limit
+class EventCache {
+public:
+    EventCache(std::string dir, uint64_t size_limit = CacheConfig::DEFAULT_SIZE_LIMIT, CacheKey key = CacheKey::CONTENT);
+
+    // Path of the entry for `input` decoded with `config` (any string that
+    // identifies the decoding options affecting the events)
+    std::string entry_path(const std::string& input, const std::string& config) const;
+
+    // Mark an entry as recently used (entries are evicted by modification time)
+    static void touch(const std::string& path);
+
+    // Remove entries of other format/decoder versions, then the least recently
+    // used ones until the directory is within the size limit
+    void evict() const;
+
+private:
+    std::string dir;
+    uint64_t size_limit;
+    CacheKey key;
+};
+
+#endif // EVENTCACHE_H
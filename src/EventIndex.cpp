@@ -0,0 +1,477 @@
+#include "EventIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char MAGIC[4] = {'F', 'C', 'I', 'X'};
+
+static void put_le(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+static uint64_t get_le(const uint8_t* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    return v;
+}
+
+// ---------------- EventBitmap ----------------
+
+uint32_t EventBitmap::Container::cardinality() const {
+    if (bits.empty()) return static_cast<uint32_t>(array.size());
+    uint32_t n = 0;
+    for (uint64_t w : bits) n += static_cast<uint32_t>(__builtin_popcountll(w));
+    return n;
+}
+
+void EventBitmap::Container::to_bitmap() {
+    if (!bits.empty()) return;
+    bits.assign(BITMAP_WORDS, 0);
+    for (uint16_t v : array) bits[v >> 6] |= uint64_t(1) << (v & 63);
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void EventBitmap::Container::normalize() {
+    if (bits.empty()) {
+        if (array.size() > ARRAY_MAX) to_bitmap();
+        return;
+    }
+    if (cardinality() > ARRAY_MAX) return;
+    array.clear();
+    for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+        for (uint64_t w = bits[i]; w; w &= w - 1) {
+            array.push_back(static_cast<uint16_t>(i * 64 + static_cast<size_t>(__builtin_ctzll(w))));
+        }
+    }
+    bits.clear();
+    bits.shrink_to_fit();
+}
+
+EventBitmap EventBitmap::range(uint32_t n) {
+    EventBitmap b;
+    for (uint64_t start = 0; start < n; start += 65536) {
+        Container c;
+        c.key = static_cast<uint16_t>(start >> 16);
+        const uint64_t count = std::min<uint64_t>(65536, n - start);
+        c.bits.assign(BITMAP_WORDS, 0);
+        for (uint64_t i = 0; i < count / 64; ++i) c.bits[i] = ~uint64_t(0);
+        if (count % 64) c.bits[count / 64] = (uint64_t(1) << (count % 64)) - 1;
+        c.normalize();
+        b.containers.push_back(std::move(c));
+    }
+    return b;
+}
+
+void EventBitmap::add(uint32_t value) {
+    const uint16_t key = static_cast<uint16_t>(value >> 16);
+    const uint16_t low = static_cast<uint16_t>(value);
+    if (containers.empty() || containers.back().key != key) {
+        if (!containers.empty() && containers.back().key > key) throw std::logic_error("EventBitmap values must increase");
+        containers.emplace_back();
+        containers.back().key = key;
+    }
+    Container& c = containers.back();
+    if (!c.bits.empty()) {
+        c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+    } else if (c.array.empty() || c.array.back() < low) {
+        c.array.push_back(low);
+        if (c.array.size() > ARRAY_MAX) c.to_bitmap();
+    }
+}
+
+uint64_t EventBitmap::cardinality() const {
+    uint64_t n = 0;
+    for (const auto& c : containers) n += c.cardinality();
+    return n;
+}
+
+std::vector<uint32_t> EventBitmap::values() const {
+    std::vector<uint32_t> out;
+    out.reserve(cardinality());
+    for (const auto& c : containers) {
+        const uint32_t high = static_cast<uint32_t>(c.key) << 16;
+        if (c.bits.empty()) {
+            for (uint16_t v : c.array) out.push_back(high | v);
+            continue;
+        }
+        for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+            for (uint64_t w = c.bits[i]; w; w &= w - 1) out.push_back(high | static_cast<uint32_t>(i * 64 + __builtin_ctzll(w)));
+        }
+    }
+    return out;
+}
+
+EventBitmap::Container EventBitmap::combine(const Container& a, const Container& b, Op op) {
+    Container r;
+    r.key = a.key;
+    if (a.bits.empty() && b.bits.empty()) {
+        // Two sorted arrays: merge
+        auto out = std::back_inserter(r.array);
+        if (op == Op::AND) std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+        else if (op == Op::OR) std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+        else std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+    } else if (op == Op::AND && (a.bits.empty() || b.bits.empty())) {
+        // Array filtered by a bitmap
+        const Container& arr = a.bits.empty() ? a : b;
+        const Container& map = a.bits.empty() ? b : a;
+        for (uint16_t v : arr.array) {
+            if (map.bits[v >> 6] >> (v & 63) & 1) r.array.push_back(v);
+        }
+    } else if (op == Op::AND_NOT && a.bits.empty()) {
+        for (uint16_t v : a.array) {
+            if (!(b.bits[v >> 6] >> (v & 63) & 1)) r.array.push_back(v);
+        }
+    } else {
+        Container x = a, y = b;
+        x.to_bitmap();
+        y.to_bitmap();
+        r.bits.resize(BITMAP_WORDS);
+        for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+            r.bits[i] = op == Op::AND ? x.bits[i] & y.bits[i] : op == Op::OR ? x.bits[i] | y.bits[i] : x.bits[i] & ~y.bits[i];
+        }
+    }
+    r.normalize();
+    return r;
+}
+
+EventBitmap EventBitmap::operator&(const EventBitmap& other) const {
+    EventBitmap r;
+    size_t i = 0, j = 0;
+    while (i < containers.size() && j < other.containers.size()) {
+        if (containers[i].key < other.containers[j].key) i++;
+        else if (containers[i].key > other.containers[j].key) j++;
+        else {
+            Container c = combine(containers[i++], other.containers[j++], Op::AND);
+            if (c.cardinality()) r.containers.push_back(std::move(c));
+        }
+    }
+    return r;
+}
+
+EventBitmap EventBitmap::operator|(const EventBitmap& other) const {
+    EventBitmap r;
+    size_t i = 0, j = 0;
+    while (i < containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size() || (i < containers.size() && containers[i].key < other.containers[j].key)) {
+            r.containers.push_back(containers[i++]);
+        } else if (i == containers.size() || containers[i].key > other.containers[j].key) {
+            r.containers.push_back(other.containers[j++]);
+        } else {
+            r.containers.push_back(combine(containers[i++], other.containers[j++], Op::OR));
+        }
+    }
+    return r;
+}
+
+EventBitmap EventBitmap::and_not(const EventBitmap& other) const {
+    EventBitmap r;
+    size_t j = 0;
+    for (const auto& c : containers) {
+        while (j < other.containers.size() && other.containers[j].key < c.key) j++;
+        if (j == other.containers.size() || other.containers[j].key != c.key) {
+            r.containers.push_back(c);
+            continue;
+        }
+        Container d = combine(c, other.containers[j], Op::AND_NOT);
+        if (d.cardinality()) r.containers.push_back(std::move(d));
+    }
+    return r;
+}
+
+// Containers: key u16, form u16 (0: array, 1: bitmap), count u32, then the
+// u16 values or the 1024 u64 words
+void EventBitmap::serialize(std::vector<uint8_t>& out) const {
+    put_le(out, containers.size(), 4);
+    for (const auto& c : containers) {
+        put_le(out, c.key, 2);
+        put_le(out, c.bits.empty() ? 0 : 1, 2);
+        put_le(out, c.cardinality(), 4);
+        if (c.bits.empty()) {
+            for (uint16_t v : c.array) put_le(out, v, 2);
+        } else {
+            for (uint64_t w : c.bits) put_le(out, w, 8);
+        }
+    }
+}
+
+EventBitmap EventBitmap::deserialize(const uint8_t* data, size_t size) {
+    auto need = [&](size_t pos, size_t n) {
+        if (pos + n > size) throw std::runtime_error("Truncated bitmap in event index");
+    };
+    EventBitmap b;
+    need(0, 4);
+    const uint64_t n = get_le(data, 4);
+    size_t pos = 4;
+    for (uint64_t k = 0; k < n; ++k) {
+        need(pos, 8);
+        Container c;
+        c.key = static_cast<uint16_t>(get_le(data + pos, 2));
+        const bool bitmap = get_le(data + pos + 2, 2) != 0;
+        const uint32_t count = static_cast<uint32_t>(get_le(data + pos + 4, 4));
+        pos += 8;
+        if (bitmap) {
+            need(pos, BITMAP_WORDS * 8);
+            c.bits.resize(BITMAP_WORDS);
+            std::memcpy(c.bits.data(), data + pos, BITMAP_WORDS * 8);  // little-endian host
+            pos += BITMAP_WORDS * 8;
+        } else {
+            if (count > ARRAY_MAX) throw std::runtime_error("Malformed bitmap in event index");
+            need(pos, 2 * size_t(count));
+            c.array.resize(count);
+            std::memcpy(c.array.data(), data + pos, 2 * size_t(count));
+            pos += 2 * size_t(count);
+        }
+        b.containers.push_back(std::move(c));
+    }
+    return b;
+}
+
+// ---------------- EventIndexBuilder ----------------
+
+void EventIndexBuilder::add(uint64_t packet, uint64_t offset, uint32_t words, const OCBDataPacket& event) {
+    if (packet != n_packets || packet > UINT32_MAX) throw std::runtime_error("Event index: packets must be added in order");
+    const uint32_t p = static_cast<uint32_t>(packet);
+    put_le(packet_table, offset, 8);
+    put_le(packet_table, words, 4);
+    put_le(packet_table, event.get_event_id(), 4);
+    n_packets++;
+
+    // Channels in increasing term order, each once
+    for (size_t board = 0; board < event.get_Nfebs_in_ocb(); ++board) {
+        if (!event.hasData(board)) continue;
+        terms[board_term(static_cast<int>(board))].add(p);
+        const FEBDataPacket& feb = event[board];
+        std::array<bool, CalibConfig::NUM_CHANNELS> fired{};
+        for (const auto& h : feb.get_hit_times()) fired[h.get_channel_id()] = true;
+        for (const auto& h : feb.get_hit_amplitudes()) fired[h.get_channel_id()] = true;
+        for (int c = 0; c < CalibConfig::NUM_CHANNELS; ++c) {
+            if (fired[c]) terms[channel_term(static_cast<int>(board), c)].add(p);
+        }
+    }
+    const auto& errors = event.get_ocb_errors();
+    for (int bit = 0; bit < 16; ++bit) {
+        if (errors[bit]) terms[error_term(bit)].add(p);
+    }
+}
+
+void EventIndexBuilder::write(const std::string& path, const std::string& input, uint64_t input_size) const {
+    std::vector<uint8_t> bitmaps, directory;
+    const uint64_t table_offset = IndexConfig::HEADER_SIZE + input.size();
+    const uint64_t bitmaps_offset = table_offset + packet_table.size();
+    uint64_t n_terms = 0;
+    for (uint32_t id = 0; id < IndexConfig::NUM_TERMS; ++id) {
+        if (terms[id].empty()) continue;
+        const size_t start = bitmaps.size();
+        terms[id].serialize(bitmaps);
+        put_le(directory, id, 4);
+        put_le(directory, 0, 4);
+        put_le(directory, bitmaps_offset + start, 8);
+        put_le(directory, bitmaps.size() - start, 8);
+        n_terms++;
+    }
+
+    std::vector<uint8_t> header(MAGIC, MAGIC + 4);
+    put_le(header, IndexConfig::VERSION, 4);
+    put_le(header, input_size, 8);
+    put_le(header, n_packets, 8);
+    put_le(header, n_terms, 8);
+    put_le(header, table_offset, 8);
+    put_le(header, bitmaps_offset + bitmaps.size(), 8);
+    put_le(header, input.size(), 4);
+
+    // Written next to the final name and renamed, so a sidecar is complete or absent
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Failed to create event index: " + tmp);
+    out.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+    out.write(input.data(), static_cast<std::streamsize>(input.size()));
+    out.write(reinterpret_cast<const char*>(packet_table.data()), static_cast<std::streamsize>(packet_table.size()));
+    out.write(reinterpret_cast<const char*>(bitmaps.data()), static_cast<std::streamsize>(bitmaps.size()));
+    out.write(reinterpret_cast<const char*>(directory.data()), static_cast<std::streamsize>(directory.size()));
+    out.close();
+    if (!out || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed to write event index: " + path);
+    }
+}
+
+// ---------------- EventIndex ----------------
+
+EventIndex::EventIndex(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Failed to open event index: " + path);
+    }
+    size = static_cast<size_t>(st.st_size);
+    void* p = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("Failed to map event index: " + path);
+    data = static_cast<const uint8_t*>(p);
+
+    try {
+        if (size < IndexConfig::HEADER_SIZE || std::memcmp(data, MAGIC, 4) != 0) {
+            throw std::runtime_error("Not an event index: " + path);
+        }
+        if (get_le(data + 4, 4) != IndexConfig::VERSION) throw std::runtime_error("Unsupported event index version: " + path);
+        input_size = get_le(data + 8, 8);
+        n_packets = get_le(data + 16, 8);
+        const uint64_t n_terms = get_le(data + 24, 8);
+        const uint64_t table_offset = get_le(data + 32, 8);
+        const uint64_t directory_offset = get_le(data + 40, 8);
+        const uint64_t path_length = get_le(data + 48, 4);
+        if (IndexConfig::HEADER_SIZE + path_length > size || table_offset + n_packets * IndexConfig::PACKET_ENTRY_SIZE > size
+            || directory_offset + n_terms * IndexConfig::DIRECTORY_ENTRY_SIZE != size) {
+            throw std::runtime_error("Truncated event index: " + path);
+        }
+        input.assign(reinterpret_cast<const char*>(data + IndexConfig::HEADER_SIZE), path_length);
+        packets = data + table_offset;
+
+        term_offset.assign(IndexConfig::NUM_TERMS, 0);
+        term_bytes.assign(IndexConfig::NUM_TERMS, 0);
+        for (uint64_t i = 0; i < n_terms; ++i) {
+            const uint8_t* e = data + directory_offset + i * IndexConfig::DIRECTORY_ENTRY_SIZE;
+            const uint64_t id = get_le(e, 4), offset = get_le(e + 8, 8), bytes = get_le(e + 16, 8);
+            if (id >= IndexConfig::NUM_TERMS || offset + bytes > size) throw std::runtime_error("Malformed event index: " + path);
+            term_offset[id] = offset;
+            term_bytes[id] = bytes;
+        }
+    } catch (...) {
+        munmap(const_cast<uint8_t*>(data), size);
+        throw;
+    }
+}
+
+EventIndex::~EventIndex() {
+    munmap(const_cast<uint8_t*>(data), size);
+}
+
+EventBitmap EventIndex::term(uint32_t id) const {
+    if (id >= IndexConfig::NUM_TERMS || term_bytes[id] == 0) return EventBitmap();
+    return EventBitmap::deserialize(data + term_offset[id], term_bytes[id]);
+}
+
+EventIndex::Packet EventIndex::packet(uint64_t index) const {
+    if (index >= n_packets) throw std::runtime_error("Packet index out of range: " + std::to_string(index));
+    const uint8_t* e = packets + index * IndexConfig::PACKET_ENTRY_SIZE;
+    return Packet{get_le(e, 8), static_cast<uint32_t>(get_le(e + 8, 4)), static_cast<uint32_t>(get_le(e + 12, 4))};
+}
+
+// ---------------- query ----------------
+
+namespace {
+
+// Recursive descent over the tokens of a query:
+//   expr := and_expr { OR and_expr }   and_expr := unary { AND unary }
+//   unary := NOT unary | ( expr ) | term
+class QueryParser {
+public:
+    QueryParser(const EventIndex& index, const std::string& text) : index(index) {
+        for (size_t i = 0; i < text.size();) {
+            const char c = text[i];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                i++;
+            } else if (c == '(' || c == ')' || c == '&' || c == '|' || c == '!') {
+                tokens.emplace_back(1, c);
+                i++;
+            } else {
+                size_t j = i;
+                while (j < text.size() && !std::isspace(static_cast<unsigned char>(text[j]))
+                       && std::strchr("()&|!", text[j]) == nullptr) {
+                    j++;
+                }
+                tokens.push_back(text.substr(i, j - i));
+                i = j;
+            }
+        }
+    }
+
+    EventBitmap parse() {
+        EventBitmap r = expr();
+        if (pos != tokens.size()) throw std::runtime_error("Unexpected '" + tokens[pos] + "' in query");
+        return r;
+    }
+
+private:
+    const EventIndex& index;
+    std::vector<std::string> tokens;
+    size_t pos = 0;
+
+    bool accept(const char* symbol, const char* word) {
+        if (pos == tokens.size()) return false;
+        std::string t = tokens[pos];
+        std::transform(t.begin(), t.end(), t.begin(), [](unsigned char c) { return std::toupper(c); });
+        if (t != symbol && t != word) return false;
+        pos++;
+        return true;
+    }
+
+    EventBitmap expr() {
+        EventBitmap r = and_expr();
+        while (accept("|", "OR")) r = r | and_expr();
+        return r;
+    }
+
+    EventBitmap and_expr() {
+        EventBitmap r = unary();
+        while (accept("&", "AND")) {
+            // a AND NOT b without building the complement of b
+            if (accept("!", "NOT")) r = r.and_not(unary());
+            else r = r & unary();
+        }
+        return r;
+    }
+
+    EventBitmap unary() {
+        if (accept("!", "NOT")) return EventBitmap::range(static_cast<uint32_t>(index.get_packets())).and_not(unary());
+        if (accept("(", "(")) {
+            EventBitmap r = expr();
+            if (!accept(")", ")")) throw std::runtime_error("Missing ')' in query");
+            return r;
+        }
+        if (pos == tokens.size()) throw std::runtime_error("Query ends where a term is expected");
+        return index.term(term_id(tokens[pos++]));
+    }
+
+    static uint32_t term_id(const std::string& t) {
+        const size_t colon = t.find(':');
+        if (colon == std::string::npos) throw std::runtime_error("Unknown query term: " + t);
+        const std::string kind = t.substr(0, colon);
+        int value;
+        try {
+            size_t used;
+            value = std::stoi(t.substr(colon + 1), &used);
+            if (used != t.size() - colon - 1) throw std::invalid_argument(t);
+            if (kind == "feb" || kind == "err") {
+                if (value < 0 || value >= (kind == "feb" ? OCBConfig::MAX_FEBS_PER_OCB : 16)) throw std::out_of_range(t);
+                return kind == "feb" ? board_term(value) : error_term(value);
+            }
+            size_t used_board;
+            const int board = std::stoi(kind, &used_board);
+            if (used_board != kind.size()) throw std::invalid_argument(t);
+            if (board < 0 || board >= OCBConfig::MAX_FEBS_PER_OCB || value < 0 || value >= CalibConfig::NUM_CHANNELS) {
+                throw std::out_of_range(t);
+            }
+            return channel_term(board, value);
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Invalid query term: " + t + " (board:channel, feb:board or err:bit)");
+        }
+    }
+};
+
+}  // namespace
+
+EventBitmap EventIndex::query(const std::string& expression) const {
+    return QueryParser(*this, expression).parse();
+}
@@ -0,0 +1,133 @@
+// ========================= EventIndex.h =========================
+#ifndef EVENTINDEX_H
+#define EVENTINDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Calibration.h"
+#include "OCBDecoder.h"
+
+// Sidecar index of a decoded run: for every (board, channel), every board and
+// every OCB trailer error bit ("terms"), the set of OCB packets in which it
+// appeared, as compressed bitmaps of packet indices. Queries combine the
+// bitmaps of a few terms and never touch the raw file. Layout (little-endian):
+//   header    "FCIX", version u32, input size u64, packets u64, terms u64,
+//             packet table offset u64, term directory offset u64, input path length u32
+//   path      input path
+//   packets   per packet: input offset u64, words u32, event number u32
+//   bitmaps   one serialized EventBitmap per term that appeared
+//   directory per term: term id u32, reserved u32, bitmap offset u64, bitmap bytes u64
+namespace IndexConfig {
+    inline constexpr uint32_t VERSION = 1;
+    inline constexpr size_t HEADER_SIZE = 52;
+    inline constexpr size_t PACKET_ENTRY_SIZE = 16;
+    inline constexpr size_t DIRECTORY_ENTRY_SIZE = 24;
+    // Term ids: channels, then boards, then error bits
+    inline constexpr uint32_t BOARD_TERMS = OCBConfig::MAX_FEBS_PER_OCB * CalibConfig::NUM_CHANNELS;
+    inline constexpr uint32_t ERROR_TERMS = BOARD_TERMS + OCBConfig::MAX_FEBS_PER_OCB;
+    inline constexpr uint32_t NUM_TERMS = ERROR_TERMS + 16;
+}
+
+inline uint32_t channel_term(int board, int channel) { return static_cast<uint32_t>(board * CalibConfig::NUM_CHANNELS + channel); }
+inline uint32_t board_term(int board) { return IndexConfig::BOARD_TERMS + board; }
+inline uint32_t error_term(int bit) { return IndexConfig::ERROR_TERMS + bit; }
+
+// Roaring-style compressed set of 32-bit integers: values are grouped by their
+// high 16 bits, and each group is stored as a sorted array of the low halves
+// (up to 4096 values) or as a 65536-bit bitmap.
+class EventBitmap {
+public:
+    // Values 0...n-1
+    static EventBitmap range(uint32_t n);
+
+    // Values must be added in increasing order
+    void add(uint32_t value);
+
+    bool empty() const { return containers.empty(); }
+    uint64_t cardinality() const;
+    std::vector<uint32_t> values() const;
+
+    EventBitmap operator&(const EventBitmap& other) const;
+    EventBitmap operator|(const EventBitmap& other) const;
+    EventBitmap and_not(const EventBitmap& other) const;
+
+    void serialize(std::vector<uint8_t>& out) const;
+    // Throws std::runtime_error if the data is malformed
+    static EventBitmap deserialize(const uint8_t* data, size_t size);
+
+private:
+    static constexpr size_t ARRAY_MAX = 4096;
+    static constexpr size_t BITMAP_WORDS = 1024;
+
+    struct Container {
+        uint16_t key = 0;
+        std::vector<uint16_t> array;  // sorted low halves, if `bits` is empty
+        std::vector<uint64_t> bits;   // BITMAP_WORDS words, for dense groups
+
+        uint32_t cardinality() const;
+        void to_bitmap();
+        void normalize();  // the smaller of the two forms
+    };
+    std::vector<Container> containers;  // by key
+
+    enum class Op { AND, OR, AND_NOT };
+    static Container combine(const Container& a, const Container& b, Op op);
+};
+
+// Collects the terms of decoded events, in packet order, and writes the sidecar
+class EventIndexBuilder {
+public:
+    // Packet `packet` (consecutive from 0) at input offset `offset`, `words` long
+    void add(uint64_t packet, uint64_t offset, uint32_t words, const OCBDataPacket& event);
+
+    void write(const std::string& path, const std::string& input, uint64_t input_size) const;
+
+    uint64_t get_packets() const { return n_packets; }
+
+private:
+    uint64_t n_packets = 0;
+    std::vector<uint8_t> packet_table;
+    std::vector<EventBitmap> terms = std::vector<EventBitmap>(IndexConfig::NUM_TERMS);
+};
+
+// Read-only view of a sidecar (memory-mapped): only the bitmaps a query uses are decoded
+class EventIndex {
+public:
+    explicit EventIndex(const std::string& path);
+    ~EventIndex();
+
+    EventIndex(const EventIndex&) = delete;
+    EventIndex& operator=(const EventIndex&) = delete;
+
+    // Packets in which the term appeared (empty if it never did)
+    EventBitmap term(uint32_t id) const;
+
+    // Evaluate a query: terms B:C (board B, channel C hit), feb:B (board B has
+    // data), err:N (OCB trailer error bit N), combined with AND, OR, NOT (or &, |, !)
+    // and parentheses. NOT is relative to all packets of the run.
+    EventBitmap query(const std::string& expression) const;
+
+    struct Packet {
+        uint64_t offset;
+        uint32_t words;
+        uint32_t event_id;
+    };
+    Packet packet(uint64_t index) const;
+
+    uint64_t get_packets() const { return n_packets; }
+    const std::string& get_input() const { return input; }
+    uint64_t get_input_size() const { return input_size; }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::string input;
+    uint64_t input_size = 0;
+    uint64_t n_packets = 0;
+    const uint8_t* packets = nullptr;
+    std::vector<uint64_t> term_offset, term_bytes;  // by term id (bytes 0: absent)
+};
+
+#endif // EVENTINDEX_H
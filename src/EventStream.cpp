@@ -0,0 +1,38 @@
+#include "EventStream.h"
+#include <stdexcept>
+
+namespace fasercal {
+
+EventRange::EventRange(ByteSource& source, OCBLayoutId layout)
+    : framer(source, EventStreamConfig::CHUNK_WORDS), layout(layout) {}
+
+EventRange::EventRange(std::unique_ptr<ByteSource> source, OCBLayoutId layout)
+    : owned(std::move(source)), framer(*owned, EventStreamConfig::CHUNK_WORDS), layout(layout) {}
+
+EventRange::iterator EventRange::begin() {
+    if (started) throw std::logic_error("fasercal::EventRange is single-pass: begin() called twice");
+    started = true;
+    advance();
+    return current ? iterator(this) : iterator();
+}
+
+void EventRange::advance() {
+    current.reset();
+    if (failed || !framer.next(words)) return;
+    try {
+        current.emplace(words, /*debug=*/false, layout);
+    } catch (...) {
+        failed = true;
+        throw;
+    }
+}
+
+EventRange events(ByteSource& source, OCBLayoutId layout) {
+    return EventRange(source, layout);
+}
+
+EventRange events(const std::string& path, OCBLayoutId layout, const ReadConfig& read) {
+    return EventRange(open_input(path, read), layout);
+}
+
+}  // namespace fasercal
@@ -0,0 +1,101 @@
+// ========================= EventStream.h =========================
+#ifndef EVENTSTREAM_H
+#define EVENTSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "InputSource.h"
+#include "OCBDecoder.h"
+#include "OCBFramer.h"
+
+namespace EventStreamConfig {
+    // Words read from the source at once: small, so that the first event is available quickly
+    inline constexpr size_t CHUNK_WORDS = 4096;
+}
+
+namespace fasercal {
+
+// Pull-style access to the decoded events of an input, for embedding the
+// decoder in other programs:
+//
+//     for (auto& ev : fasercal::events("run.raw")) {
+//         if (ev.get_event_id() > 100) break;
+//     }
+//
+// Packets are framed and decoded one at a time when the iterator advances, so
+// only the current packet is held and leaving the loop early stops reading.
+// The range is single-pass. Decoding errors propagate out of begin() or
+// operator++ (as from the OCBDataPacket constructor) and end the range.
+class EventRange {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = OCBDataPacket;
+        using difference_type = std::ptrdiff_t;
+        using pointer = OCBDataPacket*;
+        using reference = OCBDataPacket&;
+
+        iterator() = default;  // end of the range
+
+        reference operator*() const { return *range->current; }
+        pointer operator->() const { return &*range->current; }
+
+        iterator& operator++() {
+            range->advance();
+            if (!range->current) range = nullptr;
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const { return range == other.range; }
+        bool operator!=(const iterator& other) const { return range != other.range; }
+
+    private:
+        friend class EventRange;
+        explicit iterator(EventRange* range) : range(range) {}
+        EventRange* range = nullptr;
+    };
+
+    explicit EventRange(ByteSource& source, OCBLayoutId layout = OCBLayoutId::DEFAULT);
+    explicit EventRange(std::unique_ptr<ByteSource> source, OCBLayoutId layout = OCBLayoutId::DEFAULT);
+
+    // Iterators point into the range: it can be neither copied nor moved
+    EventRange(const EventRange&) = delete;
+    EventRange& operator=(const EventRange&) = delete;
+
+    // Decodes the first event; call once
+    iterator begin();
+    iterator end() { return iterator(); }
+
+    // Raw words of the current event's OCB packet
+    const std::vector<uint32_t>& get_words() const { return words; }
+    // OCB packets framed so far, including the current one
+    uint64_t get_packets_read() const { return framer.get_packets_read(); }
+
+private:
+    std::unique_ptr<ByteSource> owned;
+    OCBFramer framer;
+    OCBLayoutId layout;
+    std::vector<uint32_t> words;
+    std::optional<OCBDataPacket> current;
+    bool started = false;
+    bool failed = false;  // a packet failed to decode: the range is over
+
+    void advance();
+};
+
+// Events of an already open source
+EventRange events(ByteSource& source, OCBLayoutId layout = OCBLayoutId::DEFAULT);
+
+// Events of a raw, gzip, zstd or archive file
+EventRange events(const std::string& path, OCBLayoutId layout = OCBLayoutId::DEFAULT,
+                  const ReadConfig& read = ReadConfig());
+
+}  // namespace fasercal
+
+#endif // EVENTSTREAM_H
@@ -0,0 +1,115 @@
+#include "FollowSource.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static std::atomic<bool> stop_requested{false};
+static_assert(std::atomic<bool>::is_always_lock_free, "stop() must be async-signal-safe");
+
+void FollowSource::stop() {
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+FollowSource::FollowSource(const std::string& path, double idle_seconds) : path(path), idle_seconds(idle_seconds) {
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("Failed to open file: " + path + ": " + std::strerror(errno));
+
+    // Without inotify (e.g. unsupported file system, watch limit reached) the size is polled
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF) < 0) {
+        ::close(inotify_fd);
+        inotify_fd = -1;
+    }
+    file_size();
+}
+
+FollowSource::~FollowSource() {
+    if (inotify_fd >= 0) ::close(inotify_fd);
+    if (fd >= 0) ::close(fd);
+}
+
+uint64_t FollowSource::file_size() const {
+    struct stat st;
+    if (fstat(fd, &st) != 0) throw std::runtime_error("Failed to stat file: " + path + ": " + std::strerror(errno));
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (size < pos) {
+        throw std::runtime_error("File " + path + " shrank to " + std::to_string(size) + " bytes while being followed at byte "
+                                 + std::to_string(pos));
+    }
+    known_size = size;
+    return size;
+}
+
+bool FollowSource::ready() const {
+    return pos < known_size || file_size() > pos;
+}
+
+bool FollowSource::wait_for_data() {
+    auto last_growth = std::chrono::steady_clock::now();
+    while (true) {
+        if (file_size() > pos) return true;
+        struct stat st;
+        if (stop_requested.load(std::memory_order_relaxed) || (fstat(fd, &st) == 0 && st.st_nlink == 0)) return false;
+        if (idle_seconds > 0
+            && std::chrono::duration<double>(std::chrono::steady_clock::now() - last_growth).count() >= idle_seconds) {
+            return false;
+        }
+
+        if (inotify_fd < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(FollowConfig::POLL_MS));
+            continue;
+        }
+        pollfd p{inotify_fd, POLLIN, 0};
+        if (poll(&p, 1, FollowConfig::POLL_MS) > 0) {
+            // Drain the events: the size is checked again either way
+            alignas(inotify_event) char events[4096];
+            while (::read(inotify_fd, events, sizeof(events)) > 0) {
+            }
+        }
+    }
+}
+
+size_t FollowSource::read(void* buf, size_t n) {
+    if (n == 0) return 0;
+    while (true) {
+        const ssize_t r = ::read(fd, buf, n);
+        if (r > 0) {
+            pos += static_cast<uint64_t>(r);
+            known_size = std::max(known_size, pos);
+            return static_cast<size_t>(r);
+        }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to read file: " + path + ": " + std::strerror(errno));
+        }
+        if (!wait_for_data()) return 0;
+    }
+}
+
+uint64_t FollowSource::skip(uint64_t n) {
+    // Resuming past data that is not written yet waits for it, like a read
+    uint64_t skipped = 0;
+    while (skipped < n) {
+        const uint64_t step = std::min(n - skipped, file_size() - pos);
+        if (step == 0) {
+            if (!wait_for_data()) break;
+            continue;
+        }
+        if (lseek(fd, static_cast<off_t>(step), SEEK_CUR) < 0) {
+            throw std::runtime_error("Failed to seek in file: " + path + ": " + std::strerror(errno));
+        }
+        pos += step;
+        skipped += step;
+    }
+    return skipped;
+}
@@ -0,0 +1,57 @@
+// ========================= FollowSource.h =========================
+#ifndef FOLLOWSOURCE_H
+#define FOLLOWSOURCE_H
+
+#include <cstdint>
+#include <string>
+#include "InputSource.h"
+
+namespace FollowConfig {
+    // Longest wait between two size checks: the polling interval without
+    // inotify, and how soon a stop request or an idle timeout is noticed
+    inline constexpr int POLL_MS = 200;
+}
+
+// Raw file that is still being written (e.g. by the DAQ), read like `tail -f`:
+// at the end of the data a read waits for the file to grow, woken by inotify
+// (or by polling its size if inotify is unavailable), so only appended bytes
+// are ever read. A partial packet at the end simply waits in the framer for
+// the rest of its bytes. The input ends once the file has not grown for
+// `idle_seconds` (0: never), is deleted, or stop() is called.
+class FollowSource : public ByteSource {
+public:
+    explicit FollowSource(const std::string& path, double idle_seconds = 0);
+    ~FollowSource() override;
+
+    FollowSource(const FollowSource&) = delete;
+    FollowSource& operator=(const FollowSource&) = delete;
+
+    // Throws std::runtime_error if the file shrinks (truncated or replaced)
+    size_t read(void* buf, size_t n) override;
+    uint64_t skip(uint64_t n) override;
+
+    // False once everything written so far has been read
+    bool ready() const override;
+
+    // End every FollowSource at its next wait, after the data written so far.
+    // Async-signal-safe (e.g. from a SIGINT handler).
+    static void stop();
+
+    bool using_inotify() const { return inotify_fd >= 0; }
+    uint64_t get_position() const { return pos; }
+
+private:
+    std::string path;
+    double idle_seconds;
+    int fd = -1;
+    int inotify_fd = -1;
+    uint64_t pos = 0;
+    mutable uint64_t known_size = 0;  // file size at the last check
+
+    // Refresh known_size; throws if the file shrank below the read position
+    uint64_t file_size() const;
+    // Wait until the file grows past the read position; false if the input ended
+    bool wait_for_data();
+};
+
+#endif // FOLLOWSOURCE_H
@@ -0,0 +1,61 @@
+#include "Geometry.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// Cells of a layer are indexed with 16 bits
+static constexpr int MAX_INDEX = 1 << 15;
+
+GeometryMap GeometryMap::load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Failed to open geometry file: " + path);
+
+    struct Entry {
+        int ocb, board, channel;
+        CellIndex cell;
+    };
+    std::vector<Entry> entries;
+    GeometryMap map;
+
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); ++line_number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        int ocb, board, channel, layer, row, column;
+        if (!(fields >> ocb)) continue;  // blank or comment line
+        if (!(fields >> board >> channel >> layer >> row >> column)) {
+            throw std::runtime_error("Malformed geometry entry at " + path + ":" + std::to_string(line_number));
+        }
+        if (ocb < 0 || ocb >= MAX_INDEX || board < 0 || board >= OCBConfig::MAX_FEBS_PER_OCB || channel < 0 || channel >= NUM_CHANNELS
+            || layer < 0 || layer >= MAX_INDEX || row < 0 || row >= MAX_INDEX || column < 0 || column >= MAX_INDEX) {
+            throw std::runtime_error("Geometry entry out of range at " + path + ":" + std::to_string(line_number));
+        }
+        CellIndex cell;
+        cell.layer = static_cast<int16_t>(layer);
+        cell.row = static_cast<int16_t>(row);
+        cell.column = static_cast<int16_t>(column);
+        entries.push_back({ocb, board, channel, cell});
+
+        map.n_ocbs = std::max(map.n_ocbs, ocb + 1);
+        map.n_layers = std::max(map.n_layers, layer + 1);
+        map.n_rows = std::max(map.n_rows, row + 1);
+        map.n_columns = std::max(map.n_columns, column + 1);
+    }
+
+    map.cells.assign(static_cast<size_t>(map.n_ocbs) * OCBConfig::MAX_FEBS_PER_OCB * NUM_CHANNELS, CellIndex());
+    for (const auto& e : entries) {
+        CellIndex& c = map.cells[(static_cast<size_t>(e.ocb) * OCBConfig::MAX_FEBS_PER_OCB + e.board) * NUM_CHANNELS + e.channel];
+        if (c.valid()) {
+            throw std::runtime_error("Channel mapped twice in " + path + ": ocb " + std::to_string(e.ocb) + ", board "
+                                     + std::to_string(e.board) + ", channel " + std::to_string(e.channel));
+        }
+        c = e.cell;
+        map.n_mapped++;
+    }
+
+    static std::atomic<uint64_t> next_id{1};
+    map.id = next_id++;
+    return map;
+}
@@ -0,0 +1,51 @@
+// ========================= Geometry.h =========================
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "OCBDecoder.h"
+
+// Position of one readout channel in the calorimeter
+struct CellIndex {
+    int16_t layer = -1;  // -1: channel not mapped
+    int16_t row = -1;
+    int16_t column = -1;
+
+    bool valid() const { return layer >= 0; }
+};
+
+// (OCB, board, channel) -> (layer, row, column) map, loaded once from a text
+// file and then only read (safe to share between threads).
+class GeometryMap {
+public:
+    static constexpr int NUM_CHANNELS = 256;  // 8-bit channel_id
+
+    // One channel per line, '#' starts a comment:
+    //   ocb board channel layer row column
+    static GeometryMap load(const std::string& path);
+
+    CellIndex lookup(int ocb, int board, int channel) const {
+        if (ocb < 0 || ocb >= n_ocbs || board < 0 || board >= OCBConfig::MAX_FEBS_PER_OCB || channel < 0 || channel >= NUM_CHANNELS)
+            return CellIndex();
+        return cells[(static_cast<size_t>(ocb) * OCBConfig::MAX_FEBS_PER_OCB + board) * NUM_CHANNELS + channel];
+    }
+
+    // Grid dimensions: one past the largest mapped index
+    int get_layers() const { return n_layers; }
+    int get_rows() const { return n_rows; }
+    int get_columns() const { return n_columns; }
+    size_t get_mapped() const { return n_mapped; }
+    // Unique per loaded map, so per-thread state built for one map is never reused for another
+    uint64_t get_id() const { return id; }
+
+private:
+    std::vector<CellIndex> cells;
+    int n_ocbs = 0;
+    int n_layers = 0, n_rows = 0, n_columns = 0;
+    size_t n_mapped = 0;
+    uint64_t id = 0;
+};
+
+#endif // GEOMETRY_H
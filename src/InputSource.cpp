@@ -0,0 +1,401 @@
+#include "InputSource.h"
+#include "Archive.h"
+#include "AsyncSource.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using InputConfig::BLOCK_SIZE;
+
+// ---------------- ByteSource ----------------
+
+uint64_t ByteSource::skip(uint64_t n) {
+    std::vector<char> discard(std::min<uint64_t>(n, BLOCK_SIZE));
+    uint64_t skipped = 0;
+    while (skipped < n) {
+        size_t got = read(discard.data(), std::min<uint64_t>(n - skipped, discard.size()));
+        if (got == 0) break;
+        skipped += got;
+    }
+    return skipped;
+}
+
+// ---------------- FileSource ----------------
+
+FileSource::FileSource(const std::string& path) : in(path, std::ios::binary) {
+    if (!in) throw std::runtime_error("Failed to open file: " + path);
+}
+
+size_t FileSource::read(void* buf, size_t n) {
+    in.read(static_cast<char*>(buf), n);
+    return static_cast<size_t>(in.gcount());
+}
+
+uint64_t FileSource::skip(uint64_t n) {
+    const std::streamoff pos = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streamoff end = in.tellg();
+    const std::streamoff target = std::min<std::streamoff>(end, pos + static_cast<std::streamoff>(n));
+    in.seekg(target);
+    return static_cast<uint64_t>(target - pos);
+}
+
+// ---------------- BoundedByteBuffer ----------------
+
+bool BoundedByteBuffer::push(std::vector<char> block) {
+    std::unique_lock<std::mutex> lock(mtx);
+    not_full.wait(lock, [this] { return cancelled || blocks.size() < max_blocks; });
+    if (cancelled) return false;
+    blocks.push_back(std::move(block));
+    not_empty.notify_one();
+    return true;
+}
+
+void BoundedByteBuffer::close(std::exception_ptr err) {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    error = err;
+    not_empty.notify_all();
+}
+
+bool BoundedByteBuffer::pop(std::vector<char>& block) {
+    std::unique_lock<std::mutex> lock(mtx);
+    not_empty.wait(lock, [this] { return closed || !blocks.empty(); });
+    if (blocks.empty()) {
+        if (error) std::rethrow_exception(error);
+        return false;
+    }
+    block = std::move(blocks.front());
+    blocks.pop_front();
+    not_full.notify_one();
+    return true;
+}
+
+void BoundedByteBuffer::cancel() {
+    std::lock_guard<std::mutex> lock(mtx);
+    cancelled = true;
+    blocks.clear();
+    not_full.notify_all();
+}
+
+// ---------------- PipelinedSource ----------------
+
+PipelinedSource::PipelinedSource(Producer producer, size_t max_blocks) : buffer(max_blocks) {
+    worker = std::thread([this, producer = std::move(producer)] {
+        try {
+            producer(buffer);
+            buffer.close();
+        } catch (...) {
+            buffer.close(std::current_exception());
+        }
+    });
+}
+
+PipelinedSource::~PipelinedSource() {
+    buffer.cancel();
+    if (worker.joinable()) worker.join();
+}
+
+size_t PipelinedSource::read(void* buf, size_t n) {
+    char* dst = static_cast<char*>(buf);
+    size_t copied = 0;
+    while (copied < n && !eof) {
+        if (pos == current.size()) {
+            pos = 0;
+            current.clear();
+            if (!buffer.pop(current)) {
+                eof = true;
+                break;
+            }
+            continue;
+        }
+        size_t len = std::min(n - copied, current.size() - pos);
+        std::memcpy(dst + copied, current.data() + pos, len);
+        pos += len;
+        copied += len;
+    }
+    return copied;
+}
+
+// ---------------- Compression detection ----------------
+
+Compression detect_compression(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Failed to open file: " + path);
+
+    unsigned char magic[4] = {0, 0, 0, 0};
+    in.read(reinterpret_cast<char*>(magic), 4);
+    size_t n = static_cast<size_t>(in.gcount());
+
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return Compression::GZIP;
+    // zstd frame magic 0xFD2FB528, or a skippable frame 0x184D2A5?
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return Compression::ZSTD;
+    if (n == 4 && (magic[0] & 0xf0) == 0x50 && magic[1] == 0x2a && magic[2] == 0x4d && magic[3] == 0x18) return Compression::ZSTD;
+    if (n == 4 && magic[0] == 'F' && magic[1] == 'C' && magic[2] == 'A' && magic[3] == 'R') return Compression::ARCHIVE;
+    return Compression::NONE;
+}
+
+// ---------------- gzip ----------------
+
+#ifdef HAVE_ZLIB
+static void gunzip_file(const std::string& path, BoundedByteBuffer& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Failed to open file: " + path);
+
+    z_stream strm{};
+    // 15 + 32: maximum window size with automatic gzip/zlib header detection
+    if (inflateInit2(&strm, 15 + 32) != Z_OK) throw std::runtime_error("inflateInit2 failed");
+
+    std::vector<char> input(BLOCK_SIZE);
+    std::vector<char> block(BLOCK_SIZE);
+    strm.next_out = reinterpret_cast<Bytef*>(block.data());
+    strm.avail_out = block.size();
+    bool in_member = false;
+    bool output_full = false;  // the last inflate() stopped on a full block
+
+    try {
+        while (true) {
+            if (strm.avail_in == 0) {
+                in.read(input.data(), input.size());
+                strm.avail_in = static_cast<uInt>(in.gcount());
+                strm.next_in = reinterpret_cast<Bytef*>(input.data());
+                // At the end of the file zlib may still hold output that did not
+                // fit into the last block: inflate until it has room to spare
+                if (strm.avail_in == 0 && !output_full) break;
+            }
+            if (strm.avail_in > 0) in_member = true;
+            int ret = inflate(&strm, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // Concatenated gzip members (e.g. from pigz or appended runs)
+                in_member = false;
+                inflateReset(&strm);
+            } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                throw std::runtime_error("gzip decompression error in " + path + ": " + (strm.msg ? strm.msg : "unknown"));
+            }
+            output_full = strm.avail_out == 0;
+            if (output_full) {
+                if (!out.push(std::move(block))) break;
+                block.assign(BLOCK_SIZE, 0);
+                strm.next_out = reinterpret_cast<Bytef*>(block.data());
+                strm.avail_out = block.size();
+            }
+        }
+        if (in_member) std::cerr << "Warning: truncated gzip stream in " << path << "\n";
+        block.resize(block.size() - strm.avail_out);
+        if (!block.empty()) out.push(std::move(block));
+    } catch (...) {
+        inflateEnd(&strm);
+        throw;
+    }
+    inflateEnd(&strm);
+}
+#endif
+
+// ---------------- zstd ----------------
+
+#ifdef HAVE_ZSTD
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Failed to open file: " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat file: " + path);
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size > 0) {
+            void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Failed to mmap file: " + path);
+            }
+            madvise(p, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(p);
+        }
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), size);
+        if (fd >= 0) ::close(fd);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data = nullptr;
+    size_t size = 0;
+
+private:
+    int fd = -1;
+};
+
+static void check_zstd(size_t ret, const char* what) {
+    if (ZSTD_isError(ret)) throw std::runtime_error(std::string(what) + ": " + ZSTD_getErrorName(ret));
+}
+
+// Streaming decompression of a byte range; every full output block is passed to `sink`.
+// Returns false if the sink asked to stop.
+template <class Sink>
+static bool zstd_stream(ZSTD_DCtx* dctx, const char* src, size_t len, Sink&& sink) {
+    ZSTD_inBuffer input{src, len, 0};
+    std::vector<char> block(BLOCK_SIZE);
+    ZSTD_outBuffer output{block.data(), block.size(), 0};
+    size_t ret = 0;
+    while (input.pos < input.size) {
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        check_zstd(ret, "zstd decompression error");
+        if (output.pos == output.size) {
+            if (!sink(std::move(block))) return false;
+            block.assign(BLOCK_SIZE, 0);
+            output = ZSTD_outBuffer{block.data(), block.size(), 0};
+        }
+    }
+    // Flush whatever the decoder still holds internally
+    while (ret != 0) {
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        check_zstd(ret, "zstd decompression error");
+        if (ret != 0 && output.pos < output.size) throw std::runtime_error("truncated zstd frame");
+        if (output.pos == output.size) {
+            if (!sink(std::move(block))) return false;
+            block.assign(BLOCK_SIZE, 0);
+            output = ZSTD_outBuffer{block.data(), block.size(), 0};
+        }
+    }
+    block.resize(output.pos);
+    if (!block.empty()) return sink(std::move(block));
+    return true;
+}
+
+static void unzstd_file(const std::string& path, BoundedByteBuffer& out) {
+    MappedFile file(path);
+
+    // Locate frame boundaries; each frame can be decompressed independently
+    std::vector<std::pair<size_t, size_t>> frames;
+    for (size_t off = 0; off < file.size;) {
+        size_t len = ZSTD_findFrameCompressedSize(file.data + off, file.size - off);
+        check_zstd(len, ("corrupt zstd frame in " + path).c_str());
+        frames.emplace_back(off, len);
+        off += len;
+    }
+
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    if (frames.size() <= 1) {
+        if (!frames.empty()) {
+            zstd_stream(dctx.get(), file.data, file.size, [&](std::vector<char>&& b) { return out.push(std::move(b)); });
+        }
+        return;
+    }
+
+    // Multi-frame file: workers decompress frames in parallel into memory, this
+    // thread emits them in order. At most `window` frames are held at once.
+    size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min(nthreads, frames.size());
+    const size_t window = 2 * nthreads;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::map<size_t, std::vector<std::vector<char>>> done;
+    size_t next_frame = 0;
+    size_t next_emit = 0;
+    bool abort = false;
+    std::exception_ptr error;
+
+    auto worker = [&] {
+        std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> wctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        while (true) {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return abort || next_frame >= frames.size() || next_frame < next_emit + window; });
+                if (abort || next_frame >= frames.size()) return;
+                i = next_frame++;
+            }
+            std::vector<std::vector<char>> blocks;
+            try {
+                ZSTD_DCtx_reset(wctx.get(), ZSTD_reset_session_only);
+                zstd_stream(wctx.get(), file.data + frames[i].first, frames[i].second,
+                            [&](std::vector<char>&& b) { blocks.push_back(std::move(b)); return true; });
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!error) error = std::current_exception();
+                abort = true;
+                cv.notify_all();
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            done[i] = std::move(blocks);
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < nthreads; ++t) workers.emplace_back(worker);
+
+    for (size_t e = 0; e < frames.size(); ++e) {
+        std::vector<std::vector<char>> blocks;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&] { return abort || done.count(e); });
+            if (abort) break;
+            blocks = std::move(done[e]);
+            done.erase(e);
+        }
+        bool keep_going = true;
+        for (auto& b : blocks) {
+            if (!out.push(std::move(b))) { keep_going = false; break; }
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!keep_going) abort = true;
+        next_emit = e + 1;
+        cv.notify_all();
+        if (!keep_going) break;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        abort = true;
+        cv.notify_all();
+    }
+    for (auto& t : workers) t.join();
+    if (error) std::rethrow_exception(error);
+}
+#endif
+
+// ---------------- Factory ----------------
+
+std::unique_ptr<ByteSource> open_input(const std::string& path, const ReadConfig& read) {
+    switch (detect_compression(path)) {
+        case Compression::GZIP:
+#ifdef HAVE_ZLIB
+            return std::make_unique<PipelinedSource>([path](BoundedByteBuffer& out) { gunzip_file(path, out); });
+#else
+            throw std::runtime_error("gzip-compressed input, but built without zlib support: " + path);
+#endif
+        case Compression::ZSTD:
+#ifdef HAVE_ZSTD
+            return std::make_unique<PipelinedSource>([path](BoundedByteBuffer& out) { unzstd_file(path, out); });
+#else
+            throw std::runtime_error("zstd-compressed input, but built without zstd support: " + path);
+#endif
+        case Compression::ARCHIVE:
+            return std::make_unique<ArchiveSource>(path);
+        case Compression::NONE:
+        default:
+            if (read.async) return std::make_unique<AsyncFileSource>(path, read);
+            return std::make_unique<FileSource>(path);
+    }
+}
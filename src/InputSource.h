@@ -0,0 +1,127 @@
+// ========================= InputSource.h =========================
+#ifndef INPUTSOURCE_H
+#define INPUTSOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InputConfig {
+    // Size of the blocks handed from decompression threads to the framer,
+    // and of the compressed reads feeding them
+    inline constexpr size_t BLOCK_SIZE = 1 << 20;
+}
+
+// Sequential stream of raw bytes feeding the OCB framer.
+class ByteSource {
+public:
+    virtual ~ByteSource() = default;
+
+    // Read up to n bytes into buf. Returns the number of bytes read, 0 at end of input.
+    virtual size_t read(void* buf, size_t n) = 0;
+
+    // Discard the next n bytes. Returns the number of bytes skipped, less than
+    // n only at end of input. Reads and drops them unless the source can seek.
+    virtual uint64_t skip(uint64_t n);
+
+    // Sources backed by memory (e.g. ShmRingSource) can be framed in place:
+    // peek() returns the next readable bytes without consuming them, waiting
+    // until at least min_bytes are there (nullptr at end of input), and
+    // consume() releases them.
+    virtual bool zero_copy() const { return false; }
+    virtual const unsigned char* peek(size_t /*min_bytes*/, size_t& available) { available = 0; return nullptr; }
+    virtual void consume(size_t /*n*/) {}
+
+    // False if a read would have to wait for data (live sources)
+    virtual bool ready() const { return true; }
+
+    // Fraction (0-1) of the source's own buffer waiting to be read: how close a
+    // live producer is to being blocked. 0 for sources that cannot overflow.
+    virtual double backlog() const { return 0; }
+};
+
+// Plain (uncompressed) file read through std::ifstream.
+class FileSource : public ByteSource {
+public:
+    explicit FileSource(const std::string& path);
+
+    size_t read(void* buf, size_t n) override;
+    uint64_t skip(uint64_t n) override;
+
+private:
+    std::ifstream in;
+};
+
+// Bounded FIFO of byte blocks shared between one producer and one consumer thread.
+// The producer blocks once `max_blocks` blocks are queued (backpressure).
+class BoundedByteBuffer {
+public:
+    explicit BoundedByteBuffer(size_t max_blocks) : max_blocks(max_blocks) {}
+
+    // Producer side. push() returns false if the consumer has gone away.
+    bool push(std::vector<char> block);
+    void close(std::exception_ptr error = nullptr);
+
+    // Consumer side. Returns false once the buffer is closed and drained;
+    // rethrows the producer's exception, if any.
+    bool pop(std::vector<char>& block);
+    void cancel();
+
+private:
+    size_t max_blocks;
+    std::deque<std::vector<char>> blocks;
+    bool closed = false;
+    bool cancelled = false;
+    std::exception_ptr error;
+    std::mutex mtx;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+// Runs a producer function (e.g. a decompressor) on its own thread and exposes
+// its output as a ByteSource through a BoundedByteBuffer.
+class PipelinedSource : public ByteSource {
+public:
+    using Producer = std::function<void(BoundedByteBuffer&)>;
+
+    PipelinedSource(Producer producer, size_t max_blocks = 8);
+    ~PipelinedSource() override;
+
+    size_t read(void* buf, size_t n) override;
+
+private:
+    BoundedByteBuffer buffer;
+    std::thread worker;
+    std::vector<char> current;
+    size_t pos = 0;
+    bool eof = false;
+};
+
+// How plain (uncompressed) files are read
+struct ReadConfig {
+    bool async = false;          // io_uring read-ahead (AsyncFileSource) instead of std::ifstream
+    unsigned queue_depth = 8;    // reads kept in flight
+    size_t block_size = 1 << 20; // bytes per read, a multiple of 4096
+    bool direct = true;          // open with O_DIRECT if the filesystem supports it
+};
+
+enum class Compression { NONE, GZIP, ZSTD, ARCHIVE };
+
+// Detect the compression format of a file from its leading magic bytes.
+Compression detect_compression(const std::string& path);
+
+// Open a raw data file, transparently decompressing gzip/zstd input on a
+// separate thread. Multi-frame zstd files are decompressed in parallel;
+// archives (see Archive.h) are decoded back to the raw word stream.
+std::unique_ptr<ByteSource> open_input(const std::string& path, const ReadConfig& read = ReadConfig());
+
+#endif // INPUTSOURCE_H
@@ -0,0 +1,469 @@
+#include "Kernels.h"
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+// ---------------- scalar ----------------
+
+static inline uint32_t load_word(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t find_word_ids_scalar(const unsigned char* bytes, size_t n, uint32_t id_a, uint32_t id_b) {
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t id = load_word(bytes + 4 * i) >> 28;
+        if (id == id_a || id == id_b) return i;
+    }
+    return n;
+}
+
+static inline size_t calib_index(int32_t board, int32_t channel) {
+    return CalibrationTable::index(board, channel);
+}
+
+static inline void calibrate_one(const CalibrationTable& t, const CalibratedHits& h, size_t i, float& energy, uint8_t& gain) {
+    const size_t k = calib_index(h.board[i], h.channel[i]);
+    const float lg = static_cast<float>(h.amplitude_lg[i]);
+    const float hg = static_cast<float>(h.amplitude_hg[i]);
+    if (hg >= 0.f && hg < t.hg_saturation[k]) {
+        energy = (hg - t.ped_hg[k]) * t.gain_hg[k];
+        gain = GAIN_HG;
+    } else if (lg >= 0.f) {
+        energy = (lg - t.ped_lg[k]) * t.gain_lg[k];
+        gain = GAIN_LG;
+    } else {
+        energy = 0.f;
+        gain = GAIN_NONE;
+    }
+}
+
+static void calibrate_scalar(const CalibrationTable& table, CalibratedHits& hits) {
+    for (size_t i = 0; i < hits.size(); ++i) calibrate_one(table, hits, i, hits.energy[i], hits.gain[i]);
+}
+
+static inline uint32_t bin_one(int32_t x, int32_t lo, int32_t hi, int shift) {
+    if (x < lo) return 0;
+    if (x >= hi) return static_cast<uint32_t>((int64_t(hi) - lo) >> shift) + 1;
+    return 1 + static_cast<uint32_t>((int64_t(x) - lo) >> shift);
+}
+
+static void histogram_bins_scalar(const int32_t* x, size_t n, int32_t lo, int32_t hi, int shift, uint32_t* bins) {
+    for (size_t i = 0; i < n; ++i) bins[i] = bin_one(x[i], lo, hi, shift);
+}
+
+#ifdef KERNELS_X86
+
+// ---------------- SSE4.2 ----------------
+
+__attribute__((target("sse4.2")))
+static size_t find_word_ids_sse42(const unsigned char* bytes, size_t n, uint32_t id_a, uint32_t id_b) {
+    const __m128i a = _mm_set1_epi32(static_cast<int>(id_a));
+    const __m128i b = _mm_set1_epi32(static_cast<int>(id_b));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i id = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 4 * i)), 28);
+        int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(id, a), _mm_cmpeq_epi32(id, b))));
+        if (m) return i + __builtin_ctz(m);
+    }
+    return i + find_word_ids_scalar(bytes + 4 * i, n - i, id_a, id_b);
+}
+
+__attribute__((target("sse4.2")))
+static void calibrate_sse42(const CalibrationTable& table, CalibratedHits& hits) {
+    const size_t n = hits.size();
+    const __m128 zero = _mm_setzero_ps();
+    alignas(16) float pl[4], gl[4], ph[4], gh[4], sat[4];
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        // No gathers before AVX2: constants are looked up one hit at a time
+        for (int l = 0; l < 4; ++l) {
+            size_t k = calib_index(hits.board[i + l], hits.channel[i + l]);
+            pl[l] = table.ped_lg[k];
+            gl[l] = table.gain_lg[k];
+            ph[l] = table.ped_hg[k];
+            gh[l] = table.gain_hg[k];
+            sat[l] = table.hg_saturation[k];
+        }
+        __m128 lg = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&hits.amplitude_lg[i])));
+        __m128 hg = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&hits.amplitude_hg[i])));
+
+        __m128 use_hg = _mm_and_ps(_mm_cmpge_ps(hg, zero), _mm_cmplt_ps(hg, _mm_load_ps(sat)));
+        __m128 has_lg = _mm_cmpge_ps(lg, zero);
+        __m128 e_hg = _mm_mul_ps(_mm_sub_ps(hg, _mm_load_ps(ph)), _mm_load_ps(gh));
+        __m128 e_lg = _mm_mul_ps(_mm_sub_ps(lg, _mm_load_ps(pl)), _mm_load_ps(gl));
+        // energy = use_hg ? e_hg : (has_lg ? e_lg : 0)
+        __m128 e = _mm_blendv_ps(_mm_and_ps(has_lg, e_lg), e_hg, use_hg);
+        _mm_storeu_ps(&hits.energy[i], e);
+
+        __m128i g = _mm_blendv_epi8(_mm_and_si128(_mm_castps_si128(has_lg), _mm_set1_epi32(GAIN_LG)),
+                                    _mm_set1_epi32(GAIN_HG), _mm_castps_si128(use_hg));
+        g = _mm_packus_epi16(_mm_packs_epi32(g, g), g);
+        int packed = _mm_cvtsi128_si32(g);
+        std::memcpy(&hits.gain[i], &packed, 4);
+    }
+    for (; i < n; ++i) calibrate_one(table, hits, i, hits.energy[i], hits.gain[i]);
+}
+
+__attribute__((target("sse4.2")))
+static void histogram_bins_sse42(const int32_t* x, size_t n, int32_t lo, int32_t hi, int shift, uint32_t* bins) {
+    const __m128i vlo = _mm_set1_epi32(lo);
+    const __m128i vhi1 = _mm_set1_epi32(hi - 1);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i overflow = _mm_set1_epi32(static_cast<int>(((int64_t(hi) - lo) >> shift) + 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i b = _mm_add_epi32(_mm_srl_epi32(_mm_sub_epi32(v, vlo), count), one);
+        b = _mm_andnot_si128(_mm_cmpgt_epi32(vlo, v), b);
+        b = _mm_blendv_epi8(b, overflow, _mm_cmpgt_epi32(v, vhi1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bins + i), b);
+    }
+    for (; i < n; ++i) bins[i] = bin_one(x[i], lo, hi, shift);
+}
+
+// ---------------- AVX2 ----------------
+
+__attribute__((target("avx2")))
+static size_t find_word_ids_avx2(const unsigned char* bytes, size_t n, uint32_t id_a, uint32_t id_b) {
+    const __m256i a = _mm256_set1_epi32(static_cast<int>(id_a));
+    const __m256i b = _mm256_set1_epi32(static_cast<int>(id_b));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i id = _mm256_srli_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + 4 * i)), 28);
+        int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(id, a), _mm256_cmpeq_epi32(id, b))));
+        if (m) return i + __builtin_ctz(m);
+    }
+    return i + find_word_ids_scalar(bytes + 4 * i, n - i, id_a, id_b);
+}
+
+// Table index of 8 hits: board * 256 + channel, or the defaults entry if out of range
+__attribute__((target("avx2")))
+static inline __m256i calib_index_avx2(__m256i board, __m256i channel) {
+    const __m256i minus1 = _mm256_set1_epi32(-1);
+    __m256i valid = _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi32(board, minus1), _mm256_cmpgt_epi32(_mm256_set1_epi32(OCBConfig::MAX_FEBS_PER_OCB), board)),
+        _mm256_and_si256(_mm256_cmpgt_epi32(channel, minus1), _mm256_cmpgt_epi32(_mm256_set1_epi32(CalibConfig::NUM_CHANNELS), channel)));
+    __m256i k = _mm256_add_epi32(_mm256_slli_epi32(board, 8), channel);
+    return _mm256_blendv_epi8(_mm256_set1_epi32(CalibConfig::NUM_ENTRIES), k, valid);
+}
+
+__attribute__((target("avx2")))
+static void calibrate_avx2(const CalibrationTable& table, CalibratedHits& hits) {
+    const size_t n = hits.size();
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i k = calib_index_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&hits.board[i])),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&hits.channel[i])));
+        __m256 lg = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&hits.amplitude_lg[i])));
+        __m256 hg = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&hits.amplitude_hg[i])));
+
+        __m256 use_hg = _mm256_and_ps(_mm256_cmp_ps(hg, zero, _CMP_GE_OQ),
+                                      _mm256_cmp_ps(hg, _mm256_i32gather_ps(table.hg_saturation.data(), k, 4), _CMP_LT_OQ));
+        __m256 has_lg = _mm256_cmp_ps(lg, zero, _CMP_GE_OQ);
+        __m256 e_hg = _mm256_mul_ps(_mm256_sub_ps(hg, _mm256_i32gather_ps(table.ped_hg.data(), k, 4)),
+                                    _mm256_i32gather_ps(table.gain_hg.data(), k, 4));
+        __m256 e_lg = _mm256_mul_ps(_mm256_sub_ps(lg, _mm256_i32gather_ps(table.ped_lg.data(), k, 4)),
+                                    _mm256_i32gather_ps(table.gain_lg.data(), k, 4));
+        _mm256_storeu_ps(&hits.energy[i], _mm256_blendv_ps(_mm256_and_ps(has_lg, e_lg), e_hg, use_hg));
+
+        __m256i g = _mm256_blendv_epi8(_mm256_and_si256(_mm256_castps_si256(has_lg), _mm256_set1_epi32(GAIN_LG)),
+                                       _mm256_set1_epi32(GAIN_HG), _mm256_castps_si256(use_hg));
+        __m128i g16 = _mm_packs_epi32(_mm256_castsi256_si128(g), _mm256_extracti128_si256(g, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&hits.gain[i]), _mm_packus_epi16(g16, g16));
+    }
+    for (; i < n; ++i) calibrate_one(table, hits, i, hits.energy[i], hits.gain[i]);
+}
+
+__attribute__((target("avx2")))
+static void histogram_bins_avx2(const int32_t* x, size_t n, int32_t lo, int32_t hi, int shift, uint32_t* bins) {
+    const __m256i vlo = _mm256_set1_epi32(lo);
+    const __m256i vhi1 = _mm256_set1_epi32(hi - 1);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i overflow = _mm256_set1_epi32(static_cast<int>(((int64_t(hi) - lo) >> shift) + 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+        __m256i b = _mm256_add_epi32(_mm256_srl_epi32(_mm256_sub_epi32(v, vlo), count), one);
+        b = _mm256_andnot_si256(_mm256_cmpgt_epi32(vlo, v), b);
+        b = _mm256_blendv_epi8(b, overflow, _mm256_cmpgt_epi32(v, vhi1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bins + i), b);
+    }
+    for (; i < n; ++i) bins[i] = bin_one(x[i], lo, hi, shift);
+}
+
+// ---------------- AVX-512 ----------------
+
+// GCC 12 warns about the _mm512_undefined_*() pass-through operands of the intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+static size_t find_word_ids_avx512(const unsigned char* bytes, size_t n, uint32_t id_a, uint32_t id_b) {
+    const __m512i a = _mm512_set1_epi32(static_cast<int>(id_a));
+    const __m512i b = _mm512_set1_epi32(static_cast<int>(id_b));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i id = _mm512_srli_epi32(_mm512_loadu_si512(bytes + 4 * i), 28);
+        __mmask16 m = _mm512_cmpeq_epi32_mask(id, a) | _mm512_cmpeq_epi32_mask(id, b);
+        if (m) return i + __builtin_ctz(m);
+    }
+    return i + find_word_ids_scalar(bytes + 4 * i, n - i, id_a, id_b);
+}
+
+__attribute__((target("avx512f")))
+static void calibrate_avx512(const CalibrationTable& table, CalibratedHits& hits) {
+    const size_t n = hits.size();
+    const __m512 zero = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i board = _mm512_loadu_si512(&hits.board[i]);
+        __m512i channel = _mm512_loadu_si512(&hits.channel[i]);
+        __mmask16 valid = _mm512_cmplt_epu32_mask(board, _mm512_set1_epi32(OCBConfig::MAX_FEBS_PER_OCB))
+                        & _mm512_cmplt_epu32_mask(channel, _mm512_set1_epi32(CalibConfig::NUM_CHANNELS));
+        __m512i k = _mm512_mask_blend_epi32(valid, _mm512_set1_epi32(CalibConfig::NUM_ENTRIES),
+                                            _mm512_add_epi32(_mm512_slli_epi32(board, 8), channel));
+        __m512 lg = _mm512_cvtepi32_ps(_mm512_loadu_si512(&hits.amplitude_lg[i]));
+        __m512 hg = _mm512_cvtepi32_ps(_mm512_loadu_si512(&hits.amplitude_hg[i]));
+
+        __mmask16 use_hg = _mm512_cmp_ps_mask(hg, zero, _CMP_GE_OQ)
+                         & _mm512_cmp_ps_mask(hg, _mm512_i32gather_ps(k, table.hg_saturation.data(), 4), _CMP_LT_OQ);
+        __mmask16 has_lg = _mm512_cmp_ps_mask(lg, zero, _CMP_GE_OQ);
+        __m512 e_hg = _mm512_mul_ps(_mm512_sub_ps(hg, _mm512_i32gather_ps(k, table.ped_hg.data(), 4)),
+                                    _mm512_i32gather_ps(k, table.gain_hg.data(), 4));
+        __m512 e_lg = _mm512_mul_ps(_mm512_sub_ps(lg, _mm512_i32gather_ps(k, table.ped_lg.data(), 4)),
+                                    _mm512_i32gather_ps(k, table.gain_lg.data(), 4));
+        __m512 e = _mm512_mask_blend_ps(use_hg, _mm512_maskz_mov_ps(has_lg, e_lg), e_hg);
+        _mm512_storeu_ps(&hits.energy[i], e);
+
+        __m512i g = _mm512_mask_blend_epi32(use_hg, _mm512_maskz_mov_epi32(has_lg, _mm512_set1_epi32(GAIN_LG)),
+                                            _mm512_set1_epi32(GAIN_HG));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&hits.gain[i]), _mm512_cvtepi32_epi8(g));
+    }
+    for (; i < n; ++i) calibrate_one(table, hits, i, hits.energy[i], hits.gain[i]);
+}
+
+__attribute__((target("avx512f")))
+static void histogram_bins_avx512(const int32_t* x, size_t n, int32_t lo, int32_t hi, int shift, uint32_t* bins) {
+    const __m512i vlo = _mm512_set1_epi32(lo);
+    const __m512i vhi = _mm512_set1_epi32(hi);
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i overflow = _mm512_set1_epi32(static_cast<int>(((int64_t(hi) - lo) >> shift) + 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i v = _mm512_loadu_si512(x + i);
+        __m512i b = _mm512_add_epi32(_mm512_srl_epi32(_mm512_sub_epi32(v, vlo), count), one);
+        b = _mm512_maskz_mov_epi32(_mm512_cmpge_epi32_mask(v, vlo), b);
+        b = _mm512_mask_mov_epi32(b, _mm512_cmpge_epi32_mask(v, vhi), overflow);
+        _mm512_storeu_si512(bins + i, b);
+    }
+    for (; i < n; ++i) bins[i] = bin_one(x[i], lo, hi, shift);
+}
+
+#pragma GCC diagnostic pop
+
+#endif // KERNELS_X86
+
+// ---------------- dispatch ----------------
+
+static const Kernels VARIANTS[] = {
+    {KernelIsa::SCALAR, "scalar", find_word_ids_scalar, calibrate_scalar, histogram_bins_scalar},
+#ifdef KERNELS_X86
+    {KernelIsa::SSE42, "sse4.2", find_word_ids_sse42, calibrate_sse42, histogram_bins_sse42},
+    {KernelIsa::AVX2, "avx2", find_word_ids_avx2, calibrate_avx2, histogram_bins_avx2},
+    {KernelIsa::AVX512, "avx512", find_word_ids_avx512, calibrate_avx512, histogram_bins_avx512},
+#else
+    {KernelIsa::SSE42, "sse4.2", find_word_ids_scalar, calibrate_scalar, histogram_bins_scalar},
+    {KernelIsa::AVX2, "avx2", find_word_ids_scalar, calibrate_scalar, histogram_bins_scalar},
+    {KernelIsa::AVX512, "avx512", find_word_ids_scalar, calibrate_scalar, histogram_bins_scalar},
+#endif
+};
+
+bool kernels_supported(KernelIsa isa) {
+#ifdef KERNELS_X86
+    switch (isa) {
+        case KernelIsa::SCALAR: return true;
+        case KernelIsa::SSE42: return __builtin_cpu_supports("sse4.2");
+        case KernelIsa::AVX2: return __builtin_cpu_supports("avx2");
+        case KernelIsa::AVX512: return __builtin_cpu_supports("avx512f");
+    }
+    return false;
+#else
+    return isa == KernelIsa::SCALAR;
+#endif
+}
+
+const Kernels& kernel_variant(KernelIsa isa) {
+    return VARIANTS[static_cast<int>(isa)];
+}
+
+static const Kernels* best_kernels() {
+    for (KernelIsa isa : {KernelIsa::AVX512, KernelIsa::AVX2, KernelIsa::SSE42}) {
+        if (kernels_supported(isa)) return &kernel_variant(isa);
+    }
+    return &kernel_variant(KernelIsa::SCALAR);
+}
+
+static std::atomic<const Kernels*> selected{nullptr};
+
+const Kernels& kernels() {
+    const Kernels* k = selected.load(std::memory_order_acquire);
+    if (!k) {
+        k = best_kernels();
+        selected.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+void select_kernels(KernelIsa isa) {
+    if (!kernels_supported(isa)) {
+        throw std::runtime_error(std::string("Kernel variant not supported by this CPU: ") + kernel_variant(isa).name);
+    }
+    selected.store(&kernel_variant(isa), std::memory_order_release);
+}
+
+KernelIsa find_kernel_isa(const std::string& name) {
+    for (const auto& k : VARIANTS) {
+        if (name == k.name) return k.isa;
+    }
+    throw std::runtime_error("Unknown kernel variant: " + name + " (known: " + kernel_isa_names() + ")");
+}
+
+std::string kernel_isa_names() {
+    std::string names;
+    for (const auto& k : VARIANTS) names += (names.empty() ? "" : ", ") + std::string(k.name);
+    return names;
+}
+
+// ---------------- compare_kernels ----------------
+
+// Deterministic test data (xorshift)
+struct TestRandom {
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<uint32_t>(state >> 16);
+    }
+    int32_t range(int32_t lo, int32_t hi) { return lo + static_cast<int32_t>(next() % static_cast<uint32_t>(hi - lo)); }
+};
+
+static std::string compare_find(const Kernels& v, const Kernels& ref, const std::vector<uint32_t>& words, const char* what) {
+    // Byte copies at every misalignment, scanned as the framer does
+    static const uint32_t PAIRS[][2] = {{WordID::OCB_PACKET_HEADER, WordID::OCB_PACKET_TRAILER}, {0, 15}, {3, 3}};
+    for (size_t misalign = 0; misalign < 4; ++misalign) {
+        std::vector<unsigned char> bytes(words.size() * 4 + misalign);
+        for (size_t i = 0; i < words.size(); ++i) {
+            for (int b = 0; b < 4; ++b) bytes[misalign + 4 * i + b] = static_cast<unsigned char>(words[i] >> (8 * b));
+        }
+        const unsigned char* p = bytes.data() + misalign;
+        for (const auto& pair : PAIRS) {
+            for (size_t pos = 0; pos <= words.size();) {
+                size_t a = v.find_word_ids(p + 4 * pos, words.size() - pos, pair[0], pair[1]);
+                size_t b = ref.find_word_ids(p + 4 * pos, words.size() - pos, pair[0], pair[1]);
+                if (a != b) {
+                    std::ostringstream s;
+                    s << "find_word_ids differs on " << what << " at word " << pos << " (" << a << " vs " << b << ")";
+                    return s.str();
+                }
+                pos += a + 1;
+            }
+        }
+    }
+    return "";
+}
+
+static std::string compare_calibrate(const Kernels& v, const Kernels& ref, CalibratedHits hits,
+                                     const CalibrationTable& table, const char* what) {
+    CalibratedHits expected = hits;
+    hits.energy.assign(hits.size(), -1.f);
+    hits.gain.assign(hits.size(), 0xFF);
+    expected.energy.assign(hits.size(), -1.f);
+    expected.gain.assign(hits.size(), 0xFF);
+    v.calibrate(table, hits);
+    ref.calibrate(table, expected);
+    for (size_t i = 0; i < hits.size(); ++i) {
+        if (std::memcmp(&hits.energy[i], &expected.energy[i], sizeof(float)) != 0 || hits.gain[i] != expected.gain[i]) {
+            std::ostringstream s;
+            s << "calibrate differs on " << what << " at hit " << i << " (" << hits.energy[i] << "/" << int(hits.gain[i])
+              << " vs " << expected.energy[i] << "/" << int(expected.gain[i]) << ")";
+            return s.str();
+        }
+    }
+    return "";
+}
+
+static std::string compare_bins(const Kernels& v, const Kernels& ref, const std::vector<int32_t>& x, const char* what) {
+    static const int32_t RANGES[][3] = {{0, 4096, 0}, {0, 4096, 4}, {-64, 4032, 6}, {1000, 1001, 0}};
+    std::vector<uint32_t> a(x.size()), b(x.size());
+    for (const auto& r : RANGES) {
+        v.histogram_bins(x.data(), x.size(), r[0], r[1], r[2], a.data());
+        ref.histogram_bins(x.data(), x.size(), r[0], r[1], r[2], b.data());
+        for (size_t i = 0; i < x.size(); ++i) {
+            if (a[i] != b[i]) {
+                std::ostringstream s;
+                s << "histogram_bins differs on " << what << " at value " << x[i] << " (" << a[i] << " vs " << b[i] << ")";
+                return s.str();
+            }
+        }
+    }
+    return "";
+}
+
+std::string compare_kernels(const Kernels& variant, const std::vector<uint32_t>& words,
+                            const CalibratedHits& hits, const CalibrationTable& table) {
+    const Kernels& ref = kernel_variant(KernelIsa::SCALAR);
+    TestRandom rnd;
+
+    // Generated edge cases: every word ID, sparse and dense matches
+    std::vector<uint32_t> gen_words(4099);
+    for (size_t i = 0; i < gen_words.size(); ++i) {
+        uint32_t id = (i % 97 == 0) ? uint32_t(WordID::OCB_PACKET_TRAILER) : rnd.next() % 16;
+        if (i > 2000 && i < 3000) id = WordID::HIT_TIME;
+        gen_words[i] = id << 28 | (rnd.next() & 0x0FFFFFFF);
+    }
+
+    CalibratedHits gen_hits;
+    for (int i = 0; i < 1027; ++i) {
+        gen_hits.board.push_back(rnd.range(-2, OCBConfig::MAX_FEBS_PER_OCB + 2));
+        gen_hits.channel.push_back(rnd.range(-3, CalibConfig::NUM_CHANNELS + 3));
+        gen_hits.amplitude_lg.push_back(rnd.next() % 5 == 0 ? -1 : rnd.range(0, 4096));
+        gen_hits.amplitude_hg.push_back(rnd.next() % 5 == 0 ? -1 : rnd.range(0, 4096));
+    }
+    CalibrationTable gen_table;
+    for (size_t k = 0; k < gen_table.ped_lg.size(); ++k) {
+        gen_table.ped_lg[k] = static_cast<float>(rnd.range(0, 400)) * 0.37f;
+        gen_table.gain_lg[k] = static_cast<float>(rnd.range(1, 1000)) * 0.013f;
+        gen_table.ped_hg[k] = static_cast<float>(rnd.range(0, 400)) * 0.41f;
+        gen_table.gain_hg[k] = static_cast<float>(rnd.range(1, 1000)) * 0.0017f;
+        gen_table.hg_saturation[k] = static_cast<float>(rnd.range(3000, 4096));
+    }
+
+    std::vector<int32_t> gen_values(1031);
+    for (auto& x : gen_values) x = rnd.range(-5000, 9000);
+    gen_values[0] = INT32_MIN;
+    gen_values[1] = INT32_MAX;
+    std::vector<int32_t> amplitudes = hits.amplitude_lg;
+    amplitudes.insert(amplitudes.end(), hits.amplitude_hg.begin(), hits.amplitude_hg.end());
+
+    for (const std::string& diff : {
+             compare_find(variant, ref, words, "input words"),
+             compare_find(variant, ref, gen_words, "generated words"),
+             compare_calibrate(variant, ref, hits, table, "input hits"),
+             compare_calibrate(variant, ref, gen_hits, gen_table, "generated hits"),
+             compare_bins(variant, ref, amplitudes, "input amplitudes"),
+             compare_bins(variant, ref, gen_values, "generated values")}) {
+        if (!diff.empty()) return diff;
+    }
+    return "";
+}
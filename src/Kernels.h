@@ -0,0 +1,54 @@
+// ========================= Kernels.h =========================
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Calibration.h"
+
+// Instruction set variants of the hot loops. The build targets baseline x86-64
+// (SSE2), so the wider variants are compiled with per-function target
+// attributes and picked at startup from what the CPU supports (cpuid).
+enum class KernelIsa { SCALAR, SSE42, AVX2, AVX512 };
+
+// Dispatch table: one implementation of every kernel, all giving identical results
+struct Kernels {
+    KernelIsa isa;
+    const char* name;
+
+    // Index of the first of the `n` little-endian words at `bytes` whose word ID
+    // (4 MSBs) is `id_a` or `id_b`; `n` if there is none (framing)
+    size_t (*find_word_ids)(const unsigned char* bytes, size_t n, uint32_t id_a, uint32_t id_b);
+
+    // Look up the constants of every hit and fill `energy` and `gain`
+    // (sized by the caller), see calibrate()
+    void (*calibrate)(const CalibrationTable& table, CalibratedHits& hits);
+
+    // Bin of each of the `n` values for a histogram over [lo, hi) with bins of
+    // 2^shift: 0 below lo, 1 + ((x - lo) >> shift) inside, nbins + 1 from hi on
+    void (*histogram_bins)(const int32_t* x, size_t n, int32_t lo, int32_t hi, int shift, uint32_t* bins);
+};
+
+// The variant in use: the best the CPU supports, unless select_kernels() forced one
+const Kernels& kernels();
+
+// Force a variant (before starting any decoding threads). Throws std::runtime_error
+// if the CPU does not support it.
+void select_kernels(KernelIsa isa);
+
+bool kernels_supported(KernelIsa isa);
+const Kernels& kernel_variant(KernelIsa isa);
+// Variant by name (scalar, sse4.2, avx2, avx512); throws std::runtime_error if unknown
+KernelIsa find_kernel_isa(const std::string& name);
+std::string kernel_isa_names();  // "scalar, sse4.2, avx2, avx512"
+
+// Run every kernel of `variant` and of the scalar variant on the same inputs:
+// the given raw words and amplitude hits, plus generated edge cases (all word
+// IDs, every alignment, out-of-range channels, saturated amplitudes). Returns an
+// empty string if all results are identical, otherwise the first difference.
+std::string compare_kernels(const Kernels& variant, const std::vector<uint32_t>& words,
+                            const CalibratedHits& hits, const CalibrationTable& table);
+
+#endif // KERNELS_H
@@ -0,0 +1,94 @@
+#include "LoadShedder.h"
+#include <algorithm>
+
+const char* shed_level_name(ShedLevel level) {
+    switch (level) {
+        case ShedLevel::FULL: return "full";
+        case ShedLevel::NO_OPTIONAL: return "no-optional";
+        case ShedLevel::HEADER_ONLY: return "header-only";
+        case ShedLevel::PRESCALE: return "prescale";
+    }
+    return "unknown";
+}
+
+LoadShedder::LoadShedder(const ShedPolicy& policy)
+    : policy(policy), start(std::chrono::steady_clock::now()), since(start) {
+    if (this->policy.prescale < 1) this->policy.prescale = 1;
+}
+
+ShedLevel LoadShedder::update(double pressure, uint64_t first_packet, size_t n) {
+    const auto now = std::chrono::steady_clock::now();
+    const double lat = latency.load(std::memory_order_relaxed);
+    if (pressure > max_pressure.load(std::memory_order_relaxed)) max_pressure.store(pressure, std::memory_order_relaxed);
+
+    // Tier k (1-3) reached at `factor` times its thresholds
+    auto reached = [&](int k, double factor) {
+        const double max_latency = policy.latency[k - 1];
+        return pressure >= factor * policy.pressure[k - 1] || (max_latency > 0 && lat >= factor * max_latency);
+    };
+    const int current = static_cast<int>(level.load(std::memory_order_relaxed));
+    int target = current;
+    for (int k = ShedConfig::NUM_LEVELS - 1; k > current; --k) {
+        if (reached(k, 1.0)) {
+            target = k;
+            break;
+        }
+    }
+    if (target == current && current > 0 && !reached(current, policy.release)
+        && std::chrono::duration<double>(now - since).count() >= policy.hold_seconds) {
+        target = current - 1;
+    }
+
+    const ShedLevel next = static_cast<ShedLevel>(target);
+    if (target != current) {
+        {
+            std::lock_guard<std::mutex> lock(transitions_mtx);
+            transitions.push_back({std::chrono::duration<double>(now - start).count(),
+                                   static_cast<ShedLevel>(current), next, pressure, lat});
+        }
+        level.store(next, std::memory_order_relaxed);
+        since = now;
+    }
+
+    packets[target].fetch_add(n, std::memory_order_relaxed);
+    batches[target].fetch_add(1, std::memory_order_relaxed);
+    if (next == ShedLevel::PRESCALE) {
+        // Packets of [first_packet, first_packet + n) that are not a multiple of the prescale
+        const uint64_t p = policy.prescale;
+        const uint64_t kept = (first_packet + n + p - 1) / p - (first_packet + p - 1) / p;
+        prescaled.fetch_add(n - kept, std::memory_order_relaxed);
+    }
+    return next;
+}
+
+void LoadShedder::observe_latency(double seconds) {
+    const double old = latency.load(std::memory_order_relaxed);
+    latency.store(old + ShedConfig::LATENCY_SMOOTHING * (seconds - old), std::memory_order_relaxed);
+}
+
+std::vector<ShedTransition> LoadShedder::get_transitions() const {
+    std::lock_guard<std::mutex> lock(transitions_mtx);
+    return transitions;
+}
+
+void LoadShedder::report(std::ostream& out) const {
+    out << "shed_level " << shed_level_name(get_level()) << "\n"
+        << "shed_latency_s " << latency.load(std::memory_order_relaxed) << "\n"
+        << "shed_max_pressure " << max_pressure.load(std::memory_order_relaxed) << "\n";
+    out << "shed_packets";
+    for (int k = 0; k < ShedConfig::NUM_LEVELS; ++k) {
+        out << " " << shed_level_name(static_cast<ShedLevel>(k)) << " " << packets[k].load(std::memory_order_relaxed);
+    }
+    out << "\nshed_batches";
+    for (int k = 0; k < ShedConfig::NUM_LEVELS; ++k) {
+        out << " " << shed_level_name(static_cast<ShedLevel>(k)) << " " << batches[k].load(std::memory_order_relaxed);
+    }
+    out << "\nshed_prescaled " << get_prescaled() << " prescale " << policy.prescale << "\n";
+
+    const std::vector<ShedTransition> all = get_transitions();
+    out << "shed_transitions " << all.size() << "\n";
+    for (const auto& t : all) {
+        out << "shed_transition " << t.time << " " << shed_level_name(t.from) << " " << shed_level_name(t.to)
+            << " pressure " << t.pressure << " latency_s " << t.latency << "\n";
+    }
+}
@@ -0,0 +1,91 @@
+// ========================= LoadShedder.h =========================
+#ifndef LOADSHEDDER_H
+#define LOADSHEDDER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Degradation tiers of a live decoding run under overload, cheapest last.
+// Raw packets are never dropped at any tier: only the work done on them is.
+enum class ShedLevel : uint8_t {
+    FULL,         // everything configured
+    NO_OPTIONAL,  // no monitoring, calibration or clustering; no raw-word dump in the output
+    HEADER_ONLY,  // event number, OCB error bits and FEB presence only
+    PRESCALE      // header-only for 1 in `prescale` OCB packets, the others only counted
+};
+
+namespace ShedConfig {
+    inline constexpr int NUM_LEVELS = 4;
+    inline constexpr uint32_t DEFAULT_PRESCALE = 10;
+    inline constexpr double LATENCY_SMOOTHING = 0.25;  // weight of a new latency sample
+}
+
+const char* shed_level_name(ShedLevel level);
+
+// When to move between tiers. Tier k (1-3) is entered when the pressure or
+// the smoothed output latency reaches its threshold; a threshold above 1
+// (pressure) or of 0 (latency) never triggers. A tier is left one step at a
+// time, once both have dropped below `release` times its thresholds and it
+// has been held for `hold_seconds`.
+struct ShedPolicy {
+    std::array<double, 3> pressure = {0.5, 0.75, 0.9};  // fraction of the buffering in use
+    std::array<double, 3> latency = {0, 0, 0};          // seconds from framing to output
+    double release = 0.5;
+    double hold_seconds = 1.0;
+    uint32_t prescale = ShedConfig::DEFAULT_PRESCALE;
+};
+
+struct ShedTransition {
+    double time;  // seconds since the start of the run
+    ShedLevel from, to;
+    double pressure;
+    double latency;
+};
+
+// Picks the tier of every batch from the load of the pipeline and records
+// each decision: per-tier packet and batch counts, prescaled packets and every
+// transition. update() is called by the reader only, observe_latency() by the
+// writer only; the counters can be reported from any thread.
+class LoadShedder {
+public:
+    explicit LoadShedder(const ShedPolicy& policy);
+
+    // Tier for the batch of `packets` OCB packets starting at input packet
+    // `first_packet`, given the current pressure (0-1)
+    ShedLevel update(double pressure, uint64_t first_packet, size_t packets);
+
+    // Output latency of a batch, in seconds
+    void observe_latency(double seconds);
+
+    // Whether input packet `packet` is decoded at the PRESCALE tier
+    bool keep(uint64_t packet) const { return packet % policy.prescale == 0; }
+
+    const ShedPolicy& get_policy() const { return policy; }
+    ShedLevel get_level() const { return level.load(std::memory_order_relaxed); }
+    uint64_t get_prescaled() const { return prescaled.load(std::memory_order_relaxed); }
+    std::vector<ShedTransition> get_transitions() const;
+
+    // Metric lines: current tier, counts per tier, prescaled packets, transitions
+    void report(std::ostream& out) const;
+
+private:
+    ShedPolicy policy;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point since;  // of the current tier (reader only)
+    std::atomic<ShedLevel> level{ShedLevel::FULL};
+    std::atomic<double> latency{0};
+    std::array<std::atomic<uint64_t>, ShedConfig::NUM_LEVELS> packets{};
+    std::array<std::atomic<uint64_t>, ShedConfig::NUM_LEVELS> batches{};
+    std::atomic<uint64_t> prescaled{0};
+    std::atomic<double> max_pressure{0};
+
+    mutable std::mutex transitions_mtx;
+    std::vector<ShedTransition> transitions;
+};
+
+#endif // LOADSHEDDER_H
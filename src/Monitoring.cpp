@@ -0,0 +1,236 @@
+#include "Monitoring.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include "Kernels.h"
+#include "TimeOrdering.h"
+
+// ---------------- Histogram ----------------
+
+Histogram::Histogram(std::string name, int nbins, int64_t lo, int64_t hi)
+    : name(std::move(name)), nbins(nbins), lo(lo), hi(hi), counts(nbins + 2) {
+    for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+    if ((hi - lo) % nbins == 0) {
+        int64_t width = (hi - lo) / nbins;
+        if ((width & (width - 1)) == 0) {
+            width_shift = 0;
+            while ((int64_t(1) << width_shift) < width) ++width_shift;
+        }
+    }
+}
+
+void Histogram::fill_n(const int32_t* x, size_t n) {
+    if (width_shift < 0 || lo < std::numeric_limits<int32_t>::min() || hi > std::numeric_limits<int32_t>::max()) {
+        for (size_t i = 0; i < n; ++i) fill(x[i]);
+        return;
+    }
+    thread_local std::vector<uint32_t> bins;
+    bins.resize(n);
+    kernels().histogram_bins(x, n, static_cast<int32_t>(lo), static_cast<int32_t>(hi), width_shift, bins.data());
+    for (size_t i = 0; i < n; ++i) bump(counts[bins[i]]);
+}
+
+std::vector<uint64_t> Histogram::read() const {
+    std::vector<uint64_t> out(counts.size());
+    for (size_t i = 0; i < counts.size(); ++i) out[i] = counts[i].load(std::memory_order_relaxed);
+    return out;
+}
+
+// ---------------- MonitorHistograms ----------------
+
+MonitorHistograms::MonitorHistograms(OCBLayoutId layout)
+    : occupancy("occupancy", get_layout_info(layout).num_febs * 256, 0, get_layout_info(layout).num_febs * 256),
+      amplitude_lg("amplitude_lg", 4096, 0, 4096),
+      amplitude_hg("amplitude_hg", 4096, 0, 4096),
+      time_over_threshold("time_over_threshold", 512, 0, 2 * static_cast<int64_t>(TimeConfig::TICKS_PER_GTS)),
+      gts_per_feb("gts_per_feb", 64, 0, 64),
+      error_bits("error_bits", NUM_ERROR_BITS, 0, NUM_ERROR_BITS),
+      layout(layout) {}
+
+void MonitorHistograms::fill_ocb_errors(const std::array<bool, 16>& errors) {
+    for (int i = 0; i < NUM_OCB_ERROR_BITS; ++i) {
+        if (errors[i]) error_bits.fill(i);
+    }
+}
+
+void MonitorHistograms::fill_feb(const FEBInfo& feb, size_t n_gts) {
+    gts_per_feb.fill(static_cast<int64_t>(n_gts));
+
+    int flag = NUM_OCB_ERROR_BITS;
+    for (bool set : {feb.artificial_trl2, feb.event_done_timeout, feb.d1_fifo_full,
+                     feb.d0_fifo_full, feb.rb_cnt_error, feb.nb_decoder_errors > 0}) {
+        if (set) error_bits.fill(flag);
+        ++flag;
+    }
+}
+
+void MonitorHistograms::fill_hit_time(int board, const HitTimeData& hit) {
+    occupancy.fill(static_cast<int64_t>(board) * 256 + hit.get_channel_id());
+    if (hit.get_hit_time_rise() >= 0 && hit.get_hit_time_fall() >= 0) {
+        time_over_threshold.fill(::time_over_threshold(hit));
+    }
+}
+
+void MonitorHistograms::fill_hit_amplitude(const HitAmplitudeData& hit) {
+    if (hit.get_amplitude_lg() >= 0) amplitude_lg.fill(hit.get_amplitude_lg());
+    if (hit.get_amplitude_hg() >= 0) amplitude_hg.fill(hit.get_amplitude_hg());
+}
+
+void MonitorHistograms::fill(const OCBDataPacket& event) {
+    Histogram::bump(events);
+    fill_ocb_errors(event.get_ocb_errors());
+
+    lg_scratch.clear();
+    hg_scratch.clear();
+    for (size_t board = 0; board < event.get_Nfebs_in_ocb(); ++board) {
+        if (!event.hasData(board)) continue;
+        const FEBDataPacket& feb = event[board];
+
+        FEBInfo info;
+        info.artificial_trl2 = feb.get_artificial_trl2();
+        info.event_done_timeout = feb.get_event_done_timeout();
+        info.d1_fifo_full = feb.get_d1_fifo_full();
+        info.d0_fifo_full = feb.get_d0_fifo_full();
+        info.rb_cnt_error = feb.get_rb_cnt_error();
+        info.nb_decoder_errors = feb.get_nb_decoder_errors();
+        fill_feb(info, feb.get_gts_times().size());
+
+        for (const auto& hit : feb.get_hit_times()) fill_hit_time(static_cast<int>(board), hit);
+        for (const auto& hit : feb.get_hit_amplitudes()) {
+            if (hit.get_amplitude_lg() >= 0) lg_scratch.push_back(hit.get_amplitude_lg());
+            if (hit.get_amplitude_hg() >= 0) hg_scratch.push_back(hit.get_amplitude_hg());
+        }
+    }
+    amplitude_lg.fill_n(lg_scratch.data(), lg_scratch.size());
+    amplitude_hg.fill_n(hg_scratch.data(), hg_scratch.size());
+}
+
+// Streaming fill: histograms are updated directly from the decoder callbacks.
+// A packet that fails to decode contributes what was decoded before the error.
+class MonitorVisitor : public DecodeVisitor {
+public:
+    explicit MonitorVisitor(MonitorHistograms& h) : h(h) {}
+
+    void on_event_begin(uint32_t, const std::array<bool, 16>& errors) {
+        Histogram::bump(h.events);
+        h.fill_ocb_errors(errors);
+    }
+    void on_feb_begin(const FEBInfo& feb) {
+        board = feb.board_id;
+        h.gts_scratch.clear();
+    }
+    void on_gts(uint32_t gts_tag, uint32_t) { h.gts_scratch.push_back(gts_tag); }
+    void on_hit_time(const HitTimeData& hit) { h.fill_hit_time(board, hit); }
+    void on_hit_amplitude(const HitAmplitudeData& hit) { h.fill_hit_amplitude(hit); }
+    void on_feb_end(const FEBInfo& feb) {
+        // Distinct GTS windows, as in FEBDataPacket::get_gts_times()
+        auto& tags = h.gts_scratch;
+        std::sort(tags.begin(), tags.end());
+        h.fill_feb(feb, std::unique(tags.begin(), tags.end()) - tags.begin());
+    }
+
+private:
+    MonitorHistograms& h;
+    int board = -1;
+};
+
+void MonitorHistograms::fill(const std::vector<uint32_t>& packet) {
+    MonitorVisitor visitor(*this);
+    with_layout(layout, [&](auto l) { decode_ocb_packet<decltype(l)>(packet, visitor); });
+}
+
+std::vector<const Histogram*> MonitorHistograms::all() const {
+    return {&occupancy, &amplitude_lg, &amplitude_hg, &time_over_threshold, &gts_per_feb, &error_bits};
+}
+
+// ---------------- Monitor ----------------
+
+static std::atomic<uint64_t> next_monitor_id{1};
+
+Monitor::Monitor(std::string snapshot_path, double interval_seconds, OCBLayoutId layout)
+    : snapshot_path(std::move(snapshot_path)), interval(interval_seconds), layout(layout),
+      start(std::chrono::steady_clock::now()), id(next_monitor_id++) {
+    snapshot_thread = std::thread([this] {
+        std::unique_lock<std::mutex> lock(stop_mtx);
+        while (!stop_cv.wait_for(lock, interval, [this] { return stop; })) {
+            lock.unlock();
+            write_snapshot();
+            lock.lock();
+        }
+    });
+}
+
+Monitor::~Monitor() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mtx);
+        stop = true;
+    }
+    stop_cv.notify_all();
+    snapshot_thread.join();
+    // Final snapshot with everything accumulated
+    write_snapshot();
+}
+
+MonitorHistograms& Monitor::local() {
+    // Per-thread cache of (monitor id, histograms); ids are never reused
+    thread_local std::vector<std::pair<uint64_t, MonitorHistograms*>> cache;
+    for (const auto& [mid, hist] : cache) {
+        if (mid == id) return *hist;
+    }
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    registry.push_back(std::make_unique<MonitorHistograms>(layout));
+    cache.emplace_back(id, registry.back().get());
+    return *registry.back();
+}
+
+void Monitor::write_merged(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t events = 0;
+    for (const auto& h : registry) events += h->events.load(std::memory_order_relaxed);
+
+    out << "# FASERCal DAQ monitoring snapshot\n"
+        << "elapsed_s " << elapsed << "\n"
+        << "threads " << registry.size() << "\n"
+        << "events " << events << "\n";
+
+    MonitorHistograms reference(layout);
+    auto histograms = reference.all();
+    for (size_t k = 0; k < histograms.size(); ++k) {
+        std::vector<uint64_t> sum(histograms[k]->get_nbins() + 2, 0);
+        for (const auto& h : registry) {
+            std::vector<uint64_t> counts = h->all()[k]->read();
+            for (size_t i = 0; i < sum.size(); ++i) sum[i] += counts[i];
+        }
+        out << "histogram " << histograms[k]->get_name() << " " << histograms[k]->get_nbins()
+            << " " << histograms[k]->get_lo() << " " << histograms[k]->get_hi() << "\n"
+            << "underflow " << sum.front() << " overflow " << sum.back() << "\n";
+        for (size_t i = 1; i + 1 < sum.size(); ++i) {
+            out << sum[i] << (i + 2 < sum.size() ? ' ' : '\n');
+        }
+    }
+    if (metrics) metrics(out);
+}
+
+void Monitor::set_metrics(std::function<void(std::ostream&)> writer) {
+    std::lock_guard<std::mutex> lock(registry_mtx);
+    metrics = std::move(writer);
+}
+
+void Monitor::write_snapshot() {
+    std::string tmp = snapshot_path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        if (!out) {
+            std::cerr << "Warning: failed to write monitoring snapshot " << tmp << "\n";
+            return;
+        }
+        write_merged(out);
+    }
+    if (std::rename(tmp.c_str(), snapshot_path.c_str()) != 0) {
+        std::cerr << "Warning: failed to replace monitoring snapshot " << snapshot_path << "\n";
+    }
+}
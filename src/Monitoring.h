@@ -0,0 +1,138 @@
+// ========================= Monitoring.h =========================
+#ifndef MONITORING_H
+#define MONITORING_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "OCBDecoder.h"
+#include "OCBStreamDecoder.h"
+
+// Fixed-binning histogram over the integer range [lo, hi). Every bin is a
+// relaxed atomic written by one owning thread only (plain load + store, no
+// locked instruction), so other threads can read consistent counts at any time.
+class Histogram {
+public:
+    Histogram(std::string name, int nbins, int64_t lo, int64_t hi);
+
+    void fill(int64_t x) {
+        size_t bin;
+        if (x < lo) bin = 0;
+        else if (x >= hi) bin = counts.size() - 1;
+        else if (width_shift >= 0) bin = 1 + static_cast<size_t>((x - lo) >> width_shift);
+        else bin = 1 + static_cast<size_t>((x - lo) * nbins / (hi - lo));
+        bump(counts[bin]);
+    }
+
+    // Fill n values at once (bins computed with the vector kernels)
+    void fill_n(const int32_t* x, size_t n);
+
+    const std::string& get_name() const { return name; }
+    int get_nbins() const { return nbins; }
+    int64_t get_lo() const { return lo; }
+    int64_t get_hi() const { return hi; }
+
+    // Snapshot of the counts: [underflow, bin 0 ... bin nbins-1, overflow]
+    std::vector<uint64_t> read() const;
+
+    static void bump(std::atomic<uint64_t>& c) {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    std::string name;
+    int nbins;
+    int64_t lo, hi;
+    int width_shift = -1;  // log2 of the bin width if it is a power of two
+    std::vector<std::atomic<uint64_t>> counts;
+};
+
+// The set of shift-monitoring histograms kept by one decoding thread
+class MonitorHistograms {
+public:
+    // 16 OCB trailer error bits followed by the FEB data packet trailer flags
+    static constexpr int NUM_OCB_ERROR_BITS = 16;
+    static constexpr int NUM_FEB_ERROR_FLAGS = 6;
+    static constexpr int NUM_ERROR_BITS = NUM_OCB_ERROR_BITS + NUM_FEB_ERROR_FLAGS;
+
+    explicit MonitorHistograms(OCBLayoutId layout = OCBLayoutId::DEFAULT);
+
+    // Accumulate one decoded event
+    void fill(const OCBDataPacket& event);
+    // Accumulate the raw words of one OCB packet, decoded in a single streaming
+    // pass without building the event. Throws like OCBDataPacket on decoding errors.
+    void fill(const std::vector<uint32_t>& packet);
+
+    std::atomic<uint64_t> events{0};
+    Histogram occupancy;      // board_id * 256 + channel_id
+    Histogram amplitude_lg;   // raw 12-bit ADC
+    Histogram amplitude_hg;
+    Histogram time_over_threshold;  // fall - rise, in hit-time ticks across GTS windows
+    Histogram gts_per_feb;    // GTS windows per FEB data packet
+    Histogram error_bits;     // see NUM_ERROR_BITS
+
+    std::vector<const Histogram*> all() const;
+
+private:
+    friend class MonitorVisitor;
+    void fill_ocb_errors(const std::array<bool, 16>& errors);
+    void fill_feb(const FEBInfo& feb, size_t n_gts);
+    void fill_hit_time(int board, const HitTimeData& hit);
+    void fill_hit_amplitude(const HitAmplitudeData& hit);
+    std::vector<uint32_t> gts_scratch;  // GTS tags of the FEB packet being filled
+    std::vector<int32_t> lg_scratch, hg_scratch;  // amplitudes of the event being filled
+    OCBLayoutId layout;                 // how fill(packet) decodes
+};
+
+// Online monitoring: every thread that calls fill() gets its own
+// MonitorHistograms, so filling never synchronizes. A background thread
+// periodically merges all of them (relaxed reads, no locks on the fill path)
+// and atomically replaces the snapshot file (write to a temporary, rename).
+class Monitor {
+public:
+    Monitor(std::string snapshot_path, double interval_seconds, OCBLayoutId layout = OCBLayoutId::DEFAULT);
+    ~Monitor();
+
+    Monitor(const Monitor&) = delete;
+    Monitor& operator=(const Monitor&) = delete;
+
+    void fill(const OCBDataPacket& event) { local().fill(event); }
+    void fill(const std::vector<uint32_t>& packet) { local().fill(packet); }
+
+    // The calling thread's histograms (registered on first use)
+    MonitorHistograms& local();
+
+    // Merge all threads' histograms and write the snapshot file now
+    void write_snapshot();
+
+    // Extra metric lines appended to every snapshot (e.g. load-shedding decisions)
+    void set_metrics(std::function<void(std::ostream&)> writer);
+
+private:
+    std::string snapshot_path;
+    std::chrono::duration<double> interval;
+    OCBLayoutId layout;
+    std::chrono::steady_clock::time_point start;
+
+    std::mutex registry_mtx;  // taken on registration and while merging only
+    std::vector<std::unique_ptr<MonitorHistograms>> registry;
+    std::function<void(std::ostream&)> metrics;  // under registry_mtx
+    const uint64_t id;
+
+    std::mutex stop_mtx;
+    std::condition_variable stop_cv;
+    bool stop = false;
+    std::thread snapshot_thread;
+
+    void write_merged(std::ostream& out);
+};
+
+#endif // MONITORING_H
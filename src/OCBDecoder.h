@@ -10,11 +10,14 @@
 #include <cstdint>
 #include <iostream>
 #include "Word.h"
+#include "OCBLayout.h"
 #include <iomanip>
 
+class ChannelMask;
+
 namespace OCBConfig {
-    inline constexpr int NUM_GTS_BEFORE_EVENT = 2;
-    inline constexpr int NUM_FEBS_PER_OCB = 9;
+    // Bump whenever the decoded content of a packet changes: invalidates cached events
+    inline constexpr uint32_t DECODER_VERSION = 1;
 }
 
 // Hit key used to uniquely identify words belonging to the same HitTimeData (within same FEB and GTS)
@@ -174,26 +177,46 @@ private:
     bool d0_fifo_full = false;
     bool rb_cnt_error = false;
     int nb_decoder_errors = 0;
+    int masked_words = 0;
 
 public:
     int board_id = -1;
     int hold_time = -1;
+    int gate_time = -1;  // from the GATE_TIME word, if present
 
+    // Decode the words of one FEB data packet (GATE_HEADER ... FEB_DATA_PACKET_TRAILER)
     FEBDataPacket(const std::vector<uint32_t>& words);
 
     // const std::vector<HitData>& get_hits() const { return _hits; }
     const std::vector<HitTimeData>& get_hit_times() const { return _hit_times; }
     const std::vector<HitAmplitudeData>& get_hit_amplitudes() const { return _hit_amplitudes; }
+    // GTS tag -> GTS time of every GTS window in the packet
+    const std::map<uint32_t, uint32_t>& get_gts_times() const { return _gts_tag_map; }
+
+    // FEB data packet trailer flags
+    bool get_artificial_trl2() const { return artificial_trl2; }
+    bool get_event_done_timeout() const { return event_done_timeout; }
+    bool get_d1_fifo_full() const { return d1_fifo_full; }
+    bool get_d0_fifo_full() const { return d0_fifo_full; }
+    bool get_rb_cnt_error() const { return rb_cnt_error; }
+    int get_nb_decoder_errors() const { return nb_decoder_errors; }
+    // Hit words of masked (noisy) channels dropped by the decoder
+    int get_masked_words() const { return masked_words; }
 
 private:
-    void decodeFEBdata(const std::vector<uint32_t>& words);
+    // Filled by EventBuilder, the visitor of the streaming decoder (OCBStreamDecoder.h),
+    // or restored from the event cache by EventCodec (EventCache.h)
+    friend class EventBuilder;
+    friend class EventCodec;
+    FEBDataPacket() = default;
     // void extract_hits_from_gts(int gts_tag, const std::vector<uint32_t>& block);
 };
 
 struct OCBevent {
     uint32_t event_id;
-    // FEBs' indices assumed 0...NUM_FEB_PER_OCB; nullptr for missing FEBs.
-    std::array<std::shared_ptr<FEBDataPacket>, OCBConfig::NUM_FEBS_PER_OCB> febs;
+    // FEBs' indices assumed 0...n_febs-1 (the decoding layout); nullptr for missing FEBs.
+    std::array<std::shared_ptr<FEBDataPacket>, OCBConfig::MAX_FEBS_PER_OCB> febs;
+    size_t n_febs = OCBConfig::NUM_FEBS_PER_OCB;
 
     OCBevent();
 };
@@ -201,7 +224,9 @@ struct OCBevent {
 class OCBDataPacket {
 
 public:
-    OCBDataPacket(const std::vector<uint32_t>& words, bool debug = false);
+    // Hit words of the channels in `mask` (if any) are dropped and only counted
+    OCBDataPacket(const std::vector<uint32_t>& words, bool debug = false, OCBLayoutId layout = OCBLayoutId::DEFAULT,
+                  const ChannelMask* mask = nullptr);
 
     uint32_t get_event_id() const { return event.event_id; }
 
@@ -216,7 +241,7 @@ public:
     const FEBDataPacket& operator[](size_t board_id) const { return *(event.febs[board_id]); }
     bool hasData(size_t board_id) const { return (event.febs[board_id] != nullptr); }
 
-    size_t get_Nfebs_in_ocb() const { return event.febs.size(); }
+    size_t get_Nfebs_in_ocb() const { return event.n_febs; }
     uint32_t get_Nfebs_fired() const {
         size_t count = 0;
         for (const auto& feb : event.febs) {
@@ -225,11 +250,22 @@ public:
         return count;
     }
 
+    // Hit words dropped by the channel mask, summed over the FEBs
+    uint64_t get_masked_words() const {
+        uint64_t n = 0;
+        for (const auto& feb : event.febs) {
+            if (feb != nullptr) n += feb->get_masked_words();
+        }
+        return n;
+    }
+
     friend std::ostream &operator<<(std::ostream &out, const OCBDataPacket &event);
 
 private:
+    friend class EventBuilder;
+    friend class EventCodec;
+    OCBDataPacket() = default;
     OCBevent event;
-    void decodeOCBdata(const std::vector<uint32_t>& words, bool debug);
     // Error bits extracted from the OCB packet trailer (16 bits)
     std::array<bool,16> ocb_errors{};
 };
@@ -0,0 +1,126 @@
+#include "OCBFramer.h"
+#include <cstring>
+#include <stdexcept>
+#include "Kernels.h"
+#include "Word.h"
+
+static uint32_t bytes_to_uint32(const unsigned char buf[4]) {
+    return (uint32_t)buf[0]
+        | ((uint32_t)buf[1] << 8)
+        | ((uint32_t)buf[2] << 16)
+        | ((uint32_t)buf[3] << 24);
+}
+
+// Append n words (little-endian bytes) to the packet
+static void append_words(std::vector<uint32_t>& packet, const unsigned char* p, size_t n) {
+    const size_t old = packet.size();
+    packet.resize(old + n);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    std::memcpy(packet.data() + old, p, 4 * n);
+#else
+    for (size_t i = 0; i < n; ++i) packet[old + i] = bytes_to_uint32(p + 4 * i);
+#endif
+}
+
+OCBFramer::OCBFramer(ByteSource& source, size_t chunk_words)
+    : source(source), zero_copy(source.zero_copy()), chunk(zero_copy ? 0 : chunk_words * 4) {}
+
+// Read the next chunk of bytes from the source, keeping any partial word.
+bool OCBFramer::refill() {
+    if (eof) return false;
+    size_t carry = chunk_len - chunk_pos;
+    if (carry > 0) std::memmove(chunk.data(), chunk.data() + chunk_pos, carry);
+    chunk_pos = 0;
+    chunk_len = carry;
+
+    while (chunk_len < 4) {
+        size_t n = source.read(chunk.data() + chunk_len, chunk.size() - chunk_len);
+        if (n == 0) {
+            eof = true;
+            return false;
+        }
+        chunk_len += n;
+    }
+    return true;
+}
+
+// Readable whole words: in place for zero-copy sources, from the chunk otherwise
+bool OCBFramer::window(const unsigned char*& p, size_t& words) {
+    if (zero_copy) {
+        size_t available;
+        p = source.peek(4, available);
+        words = available / 4;
+        return p != nullptr;
+    }
+    if (chunk_len - chunk_pos < 4 && !refill()) return false;
+    p = chunk.data() + chunk_pos;
+    words = (chunk_len - chunk_pos) / 4;
+    return true;
+}
+
+void OCBFramer::advance(size_t words) {
+    if (zero_copy) source.consume(4 * words);
+    else chunk_pos += 4 * words;
+    words_read += words;
+}
+
+bool OCBFramer::would_block() const {
+    return (zero_copy || chunk_len - chunk_pos < 4) && !source.ready();
+}
+
+bool OCBFramer::next(std::vector<uint32_t>& packet) {
+    packet.clear();
+    return frame(&packet, nullptr);
+}
+
+bool OCBFramer::next_bounds(PacketBounds& bounds) {
+    return frame(nullptr, &bounds);
+}
+
+// Frame the next packet, copying its words and/or recording where it is
+bool OCBFramer::frame(std::vector<uint32_t>* packet, PacketBounds* bounds) {
+    bool in_packet = false;
+    const Kernels& k = kernels();
+
+    while (true) {
+        const unsigned char* p;
+        size_t avail;
+        if (!window(p, avail)) return false;
+
+        // Only headers and trailers change the state: find the next one, taking
+        // (inside a packet) or skipping the words before it in one go
+        const size_t run = k.find_word_ids(p, avail, WordID::OCB_PACKET_HEADER, WordID::OCB_PACKET_TRAILER);
+        if (in_packet && packet) append_words(*packet, p, run);
+        if (run == avail) {
+            advance(run);
+            continue;
+        }
+
+        uint32_t w = bytes_to_uint32(p + 4 * run);
+        advance(run + 1);
+
+        if (get_wordID(w) == WordID::OCB_PACKET_HEADER) {
+            // A new header restarts the packet
+            in_packet = true;
+            if (packet) {
+                packet->clear();
+                packet->push_back(w);
+            }
+            if (bounds) {
+                bounds->begin = (words_read - 1) * 4;
+                bounds->header = w;
+            }
+            continue;
+        }
+        if (!in_packet) {
+            throw std::runtime_error("OCB Packet Trailer received without corresponding Header");
+        }
+        if (packet) packet->push_back(w);
+        if (bounds) {
+            bounds->end = words_read * 4;
+            bounds->trailer = w;
+        }
+        ++packets_read;
+        return true;
+    }
+}
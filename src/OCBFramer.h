@@ -0,0 +1,55 @@
+// ========================= OCBFramer.h =========================
+#ifndef OCBFRAMER_H
+#define OCBFRAMER_H
+
+#include <cstdint>
+#include <vector>
+#include "InputSource.h"
+
+// Where a framed packet is in the input: byte offsets from the start of the
+// source ([begin, end)) and its header and trailer words
+struct PacketBounds {
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    uint32_t header = 0;
+    uint32_t trailer = 0;
+};
+
+// Splits the little-endian 32-bit word stream of a ByteSource into OCB packets,
+// i.e. runs of words from OCB_PACKET_HEADER to OCB_PACKET_TRAILER (inclusive).
+// Words outside of a header/trailer pair are skipped. Zero-copy sources (see
+// ByteSource::peek) are framed in place, others through an internal chunk.
+class OCBFramer {
+public:
+    explicit OCBFramer(ByteSource& source, size_t chunk_words = 1 << 16);
+
+    // Fill `packet` with the words of the next complete OCB packet.
+    // Returns false at end of input (a trailing incomplete packet is dropped).
+    bool next(std::vector<uint32_t>& packet);
+    // Same framing, recording only where the packet is (no copy of its words)
+    bool next_bounds(PacketBounds& bounds);
+
+    // True if next() would have to wait for the source (live sources only):
+    // a reader can hand on what it has framed so far
+    bool would_block() const;
+
+    uint64_t get_words_read() const { return words_read; }
+    uint64_t get_packets_read() const { return packets_read; }
+
+private:
+    ByteSource& source;
+    bool zero_copy;
+    std::vector<unsigned char> chunk;
+    size_t chunk_pos = 0;
+    size_t chunk_len = 0;
+    bool eof = false;
+    uint64_t words_read = 0;
+    uint64_t packets_read = 0;
+
+    bool refill();
+    bool window(const unsigned char*& p, size_t& words);
+    void advance(size_t words);
+    bool frame(std::vector<uint32_t>* packet, PacketBounds* bounds);
+};
+
+#endif // OCBFRAMER_H
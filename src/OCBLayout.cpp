@@ -0,0 +1,30 @@
+#include "OCBLayout.h"
+#include <stdexcept>
+
+static const OCBLayoutInfo LAYOUTS[] = {
+    {OCBLayoutId::DEFAULT, "default", DefaultLayout::NUM_FEBS_PER_OCB, DefaultLayout::NUM_GTS_BEFORE_EVENT},
+    {OCBLayoutId::FULL, "full", FullOCBLayout::NUM_FEBS_PER_OCB, FullOCBLayout::NUM_GTS_BEFORE_EVENT},
+};
+
+const OCBLayoutInfo& get_layout_info(OCBLayoutId id) {
+    for (const auto& l : LAYOUTS) {
+        if (l.id == id) return l;
+    }
+    return LAYOUTS[0];
+}
+
+OCBLayoutId find_layout(const std::string& name) {
+    for (const auto& l : LAYOUTS) {
+        if (name == l.name) return l.id;
+    }
+    throw std::runtime_error("Unknown OCB layout: " + name + " (known: " + layout_names() + ")");
+}
+
+std::string layout_names() {
+    std::string names;
+    for (const auto& l : LAYOUTS) {
+        if (!names.empty()) names += ", ";
+        names += l.name;
+    }
+    return names;
+}
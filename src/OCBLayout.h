@@ -0,0 +1,59 @@
+// ========================= OCBLayout.h =========================
+#ifndef OCBLAYOUT_H
+#define OCBLAYOUT_H
+
+#include <string>
+
+namespace OCBConfig {
+    // Standard setup
+    inline constexpr int NUM_GTS_BEFORE_EVENT = 2;
+    inline constexpr int NUM_FEBS_PER_OCB = 9;
+    // FEB slots of an OCB (one error bit each in the trailer): capacity of the event model
+    inline constexpr int MAX_FEBS_PER_OCB = 14;
+}
+
+// Readout configuration of one OCB as a traits type. The streaming decoder is a
+// template on it, so its per-board arrays and word-count checks use
+// compile-time constants.
+template <int NumFebs, int NumGtsBeforeEvent>
+struct OCBLayout {
+    static_assert(NumFebs > 0 && NumFebs <= OCBConfig::MAX_FEBS_PER_OCB, "FEB count exceeds the OCB slots");
+    static_assert(NumGtsBeforeEvent >= 0, "negative GTS count");
+
+    static constexpr int NUM_FEBS_PER_OCB = NumFebs;
+    static constexpr int NUM_GTS_BEFORE_EVENT = NumGtsBeforeEvent;
+};
+
+// Pre-instantiated layouts, selected at run time through OCBLayoutId
+using DefaultLayout = OCBLayout<OCBConfig::NUM_FEBS_PER_OCB, OCBConfig::NUM_GTS_BEFORE_EVENT>;
+using FullOCBLayout = OCBLayout<OCBConfig::MAX_FEBS_PER_OCB, OCBConfig::NUM_GTS_BEFORE_EVENT>;
+
+enum class OCBLayoutId { DEFAULT, FULL };
+
+struct OCBLayoutInfo {
+    OCBLayoutId id;
+    const char* name;
+    int num_febs;
+    int num_gts_before_event;
+};
+
+const OCBLayoutInfo& get_layout_info(OCBLayoutId id);
+
+// Look up a layout by name; throws std::runtime_error listing the known names
+OCBLayoutId find_layout(const std::string& name);
+
+// Comma-separated names of the known layouts
+std::string layout_names();
+
+// Call f(Layout{}) with the traits type of `id`. Adding a layout means adding
+// its alias above, its enum value, its OCBLayoutInfo entry and a case here.
+template <class F>
+decltype(auto) with_layout(OCBLayoutId id, F&& f) {
+    switch (id) {
+        case OCBLayoutId::FULL: return f(FullOCBLayout{});
+        case OCBLayoutId::DEFAULT:
+        default: return f(DefaultLayout{});
+    }
+}
+
+#endif // OCBLAYOUT_H
@@ -0,0 +1,383 @@
+// ========================= OCBStreamDecoder.h =========================
+#ifndef OCBSTREAMDECODER_H
+#define OCBSTREAMDECODER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ChannelMask.h"
+#include "OCBDecoder.h"
+
+// Push-style decoding of OCB packets: the decoder walks the raw words once and
+// calls the hooks of a visitor, without building OCBDataPacket/FEBDataPacket
+// objects. The object model (OCBDataPacket) is itself built by one such visitor,
+// so both paths share the checks, warnings and exceptions of this core.
+//
+// Visitors derive from DecodeVisitor and hide the hooks they need; calls are
+// resolved at compile time (the decoder is templated on the visitor type).
+// For every FEB data packet that is decoded, the hooks are called as
+//   on_feb_begin, { on_gate_time | on_gts | on_hit_time }*, on_hit_time* (hits
+//   without falling edge, by channel/hit id), on_hit_amplitude* (by channel), on_feb_end
+// between on_event_begin and on_event_end. If a packet fails to decode, the
+// exception propagates out of decode_ocb_packet() and on_event_end is not called.
+// With a ChannelMask, hit words of masked channels are skipped after a bit test
+// on the raw word and only counted (FEBInfo::masked_words, final in on_feb_end).
+
+// Header and trailer content of one FEB data packet
+struct FEBInfo {
+    int board_id = -1;
+    int hold_time = -1;  // from the optional HOLD_TIME word following the gate header
+    bool artificial_trl2 = false;
+    bool event_done_timeout = false;
+    bool d1_fifo_full = false;
+    bool d0_fifo_full = false;
+    bool rb_cnt_error = false;
+    int nb_decoder_errors = 0;
+    int masked_words = 0;  // hit words of masked channels, dropped undecoded
+};
+
+struct DecodeVisitor {
+    void on_event_begin(uint32_t /*event_id*/, const std::array<bool, 16>& /*ocb_errors*/) {}
+    void on_feb_begin(const FEBInfo& /*feb*/) {}
+    void on_gate_time(int /*gate_time*/) {}
+    void on_gts(uint32_t /*gts_tag*/, uint32_t /*gts_time*/) {}
+    // Called when the falling edge completes a hit, or at the end of the FEB packet
+    void on_hit_time(const HitTimeData& /*hit*/) {}
+    // Called at the end of the FEB packet, once LG and HG of a channel are collected
+    void on_hit_amplitude(const HitAmplitudeData& /*hit*/) {}
+    void on_feb_end(const FEBInfo& /*feb*/) {}
+    void on_event_end() {}
+};
+
+// Print one line per set OCB trailer error bit to std::cerr
+void report_ocb_errors(const std::array<bool, 16>& errors);
+
+namespace ocb_stream_detail {
+
+inline uint32_t bits(uint32_t word, int start, int length) {
+    return (word >> start) & ((uint32_t(1) << length) - 1);
+}
+
+// Word ID of a raw word; throws for IDs without a word class (as parse_word does)
+inline WordID checked_word_id(uint32_t word) {
+    uint32_t id = word >> 28;
+    if (id == 0xA || id == HOUSEKEEPING || id == SPECIAL_WORD) {
+        throw std::runtime_error("Unknown WordID: " + std::to_string(id));
+    }
+    return WordID(id);
+}
+
+inline void expect_word(uint32_t word, WordID expected) {
+    WordID id = checked_word_id(word);
+    if (id != expected) {
+        throw std::runtime_error("Wrong word type received: wordID = " + std::to_string(id) + ", expected = " + std::to_string(expected));
+    }
+}
+
+// Per-thread state pairing rising/falling edges and LG/HG amplitudes within one
+// FEB packet, reused across packets so that decoding does not allocate.
+struct FEBScratch {
+    static constexpr size_t NUM_CHANNELS = 256;  // 8-bit channel_id
+    static constexpr size_t NUM_HIT_IDS = 8;     // 3-bit hit_id
+
+    struct PendingTime {
+        bool active = false;
+        int gts_tag_rise, tag_id_rise, hit_time_rise;
+    };
+    struct PendingAmplitude {
+        bool active = false;
+        int hit_id;
+        int gts_tag_lg, tag_id_lg, amplitude_lg;
+        int gts_tag_hg, tag_id_hg, amplitude_hg;
+    };
+
+    std::array<PendingTime, NUM_CHANNELS * NUM_HIT_IDS> times;
+    std::array<PendingAmplitude, NUM_CHANNELS> amplitudes;
+    std::vector<uint16_t> time_keys;     // keys (channel * 8 + hit_id) that were activated
+    std::vector<uint16_t> amplitude_channels;
+
+    void reset() {
+        for (uint16_t k : time_keys) times[k].active = false;
+        for (uint16_t c : amplitude_channels) amplitudes[c].active = false;
+        time_keys.clear();
+        amplitude_channels.clear();
+    }
+};
+
+FEBScratch& feb_scratch();
+
+} // namespace ocb_stream_detail
+
+// Decode the words of one FEB data packet (GATE_HEADER ... FEB_DATA_PACKET_TRAILER)
+template <class Visitor>
+void decode_feb_packet(const uint32_t* words, size_t n, Visitor& visitor, const ChannelMask* mask = nullptr) {
+    using namespace ocb_stream_detail;
+    if (n == 0) throw std::runtime_error("Empty FEBDataPacket words");
+
+    expect_word(words[0], WordID::GATE_HEADER);
+    expect_word(words[n - 1], WordID::FEB_DATA_PACKET_TRAILER);
+
+    FEBInfo info;
+    info.board_id = static_cast<int>(bits(words[0], 20, 8));
+    const uint32_t trailer = words[n - 1];
+    info.artificial_trl2 = bits(trailer, 19, 1);
+    info.event_done_timeout = bits(trailer, 18, 1);
+    info.d1_fifo_full = bits(trailer, 17, 1);
+    info.d0_fifo_full = bits(trailer, 16, 1);
+    info.rb_cnt_error = bits(trailer, 15, 1);
+    info.nb_decoder_errors = static_cast<int>(bits(trailer, 0, 15));
+    if (n > 1 && checked_word_id(words[1]) == WordID::HOLD_TIME) {
+        info.hold_time = static_cast<int>(bits(words[1], 0, 11));
+    }
+    visitor.on_feb_begin(info);
+
+    FEBScratch& s = feb_scratch();
+    s.reset();
+    bool has_gts = false;
+    int gts_tag = -1;  // tag of the current GTS window
+
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t w = words[i];
+        switch (checked_word_id(w)) {
+            case WordID::GATE_TIME:
+                visitor.on_gate_time(static_cast<int>(bits(w, 0, 28)));
+                break;
+
+            case WordID::GTS_HEADER:
+                has_gts = true;
+                gts_tag = static_cast<int>(bits(w, 0, 28));
+                break;
+
+            case WordID::HIT_TIME: {
+                if (mask && mask->masks(info.board_id, w)) {
+                    info.masked_words++;
+                    break;
+                }
+                const int channel_id = static_cast<int>(bits(w, 20, 8));
+                const int hit_id = static_cast<int>(bits(w, 17, 3));
+                const int tag_id = static_cast<int>(bits(w, 15, 2));
+                const int hit_time = static_cast<int>(bits(w, 0, 13));
+                const uint16_t key = static_cast<uint16_t>(channel_id * FEBScratch::NUM_HIT_IDS + hit_id);
+                auto& p = s.times[key];
+                if (bits(w, 14, 1) == 0) {
+                    // Rising edge: a second one before the falling edge is an error
+                    if (p.active) {
+                        throw std::runtime_error("Rising edge received twice for same hit (channel_id=" + std::to_string(channel_id) +
+                                                 ", hit_id=" + std::to_string(hit_id) + ")");
+                    }
+                    p.active = true;
+                    p.gts_tag_rise = gts_tag;
+                    p.tag_id_rise = tag_id;
+                    p.hit_time_rise = hit_time;
+                    s.time_keys.push_back(key);
+                } else {
+                    // Falling edge completes the hit
+                    if (!p.active) {
+                        throw std::runtime_error("Falling edge received before rising edge for hit (channel_id=" + std::to_string(channel_id) +
+                                                 ", hit_id=" + std::to_string(hit_id) + ")");
+                    }
+                    HitTimeData h(info.board_id, channel_id, hit_id);
+                    h.set_hit_time_rise(p.hit_time_rise);
+                    h.set_tag_id_rise(p.tag_id_rise);
+                    h.set_gts_tag_rise(p.gts_tag_rise);
+                    h.set_hit_time_fall(hit_time);
+                    h.set_tag_id_fall(tag_id);
+                    h.set_gts_tag_fall(gts_tag);
+                    p.active = false;
+                    visitor.on_hit_time(h);
+                }
+                break;
+            }
+
+            case WordID::HIT_AMPLITUDE: {
+                if (mask && mask->masks(info.board_id, w)) {
+                    info.masked_words++;
+                    break;
+                }
+                const int channel_id = static_cast<int>(bits(w, 20, 8));
+                auto& a = s.amplitudes[channel_id];
+                if (!a.active) {
+                    a.active = true;
+                    a.hit_id = static_cast<int>(bits(w, 17, 3));
+                    a.gts_tag_lg = a.tag_id_lg = a.amplitude_lg = -1;
+                    a.gts_tag_hg = a.tag_id_hg = a.amplitude_hg = -1;
+                    s.amplitude_channels.push_back(static_cast<uint16_t>(channel_id));
+                }
+                const int tag_id = static_cast<int>(bits(w, 15, 2));
+                const int value = static_cast<int>(bits(w, 0, 12));
+                if (bits(w, 12, 3) == 2) {
+                    if (a.amplitude_hg != -1) {
+                        throw std::runtime_error("High Gain Amplitude received twice for same channel (channel_id=" + std::to_string(channel_id) + ")");
+                    }
+                    a.amplitude_hg = value;
+                    a.tag_id_hg = tag_id;
+                    a.gts_tag_hg = gts_tag;
+                } else {
+                    if (a.amplitude_lg != -1) {
+                        throw std::runtime_error("Low Gain Amplitude received twice for same channel (channel_id=" + std::to_string(channel_id) + ")");
+                    }
+                    a.amplitude_lg = value;
+                    a.tag_id_lg = tag_id;
+                    a.gts_tag_lg = gts_tag;
+                }
+                break;
+            }
+
+            case WordID::GTS_TRAILER1:
+                if (!has_gts) throw std::runtime_error("GTS Trailer1 received without corresponding GTS Header!");
+                // GTS tag in the trailer must match the current GTS header
+                if (static_cast<int>(bits(w, 0, 28)) != gts_tag) {
+                    throw std::runtime_error("GTS tag in Trailer1 different from current GTS Header!");
+                }
+                break;
+
+            case WordID::GTS_TRAILER2:
+                if (!has_gts) throw std::runtime_error("GTS Trailer2 received without corresponding GTS Header!");
+                visitor.on_gts(static_cast<uint32_t>(gts_tag), bits(w, 0, 20));
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // Hits still waiting for their falling edge, ordered by (channel, hit id)
+    std::sort(s.time_keys.begin(), s.time_keys.end());
+    s.time_keys.erase(std::unique(s.time_keys.begin(), s.time_keys.end()), s.time_keys.end());
+    for (uint16_t key : s.time_keys) {
+        auto& p = s.times[key];
+        if (!p.active) continue;
+        HitTimeData h(info.board_id, key / FEBScratch::NUM_HIT_IDS, key % FEBScratch::NUM_HIT_IDS);
+        h.set_hit_time_rise(p.hit_time_rise);
+        h.set_tag_id_rise(p.tag_id_rise);
+        h.set_gts_tag_rise(p.gts_tag_rise);
+        visitor.on_hit_time(h);
+    }
+
+    // Amplitudes, ordered by channel
+    std::sort(s.amplitude_channels.begin(), s.amplitude_channels.end());
+    for (uint16_t channel : s.amplitude_channels) {
+        const auto& a = s.amplitudes[channel];
+        HitAmplitudeData h(info.board_id, channel, a.hit_id);
+        h.set_amplitude_lg(a.amplitude_lg);
+        h.set_tag_id_lg(a.tag_id_lg);
+        h.set_gts_tag_lg(a.gts_tag_lg);
+        h.set_amplitude_hg(a.amplitude_hg);
+        h.set_tag_id_hg(a.tag_id_hg);
+        h.set_gts_tag_hg(a.gts_tag_hg);
+        visitor.on_hit_amplitude(h);
+    }
+
+    visitor.on_feb_end(info);
+}
+
+// Decode the words of one OCB packet (OCB_PACKET_HEADER ... OCB_PACKET_TRAILER)
+// read out with the OCBLayout `Layout` (see with_layout() for run-time selection)
+template <class Layout = DefaultLayout, class Visitor>
+void decode_ocb_packet(const uint32_t* words, size_t n, Visitor& visitor, const ChannelMask* mask = nullptr) {
+    using namespace ocb_stream_detail;
+    if (n < 2) throw std::runtime_error("OCB packet too small");
+
+    expect_word(words[0], WordID::OCB_PACKET_HEADER);
+    expect_word(words[n - 1], WordID::OCB_PACKET_TRAILER);
+
+    const uint32_t header = words[0];
+    const uint32_t trailer = words[n - 1];
+    if (bits(header, 25, 3) != bits(trailer, 25, 3)) {
+        throw std::runtime_error("Different gate type in OCB packet header and trailer!");
+    }
+    if (bits(header, 23, 2) != bits(trailer, 23, 2)) {
+        throw std::runtime_error("Different gate tag in OCB packet header and trailer!");
+    }
+
+    std::array<bool, 16> ocb_errors;
+    for (int i = 0; i < 16; ++i) ocb_errors[i] = bits(trailer, i, 1);
+    report_ocb_errors(ocb_errors);
+    visitor.on_event_begin(bits(header, 0, 23), ocb_errors);
+
+    // Check word count and decode FEB data packets
+    std::array<bool, Layout::NUM_FEBS_PER_OCB> decoded{};
+    int gate_header_index = -1;
+    int feb_id = -1;
+    int nbr_feb_words = 0;
+    int nbr_gts = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t w = words[i];
+        const WordID id = checked_word_id(w);
+
+        switch (id) {
+            case WordID::GATE_HEADER: {
+                if (bits(w, 19, 1) != 0) nbr_feb_words++;
+                else {
+                    // reset FEB word counter
+                    nbr_feb_words = 0;
+                    nbr_gts = 0;
+                    gate_header_index = static_cast<int>(i);
+                    feb_id = static_cast<int>(bits(w, 20, 8));
+                    // word count should be increased only if header 0 is followed by header 1, otherwise it means header 0 is artificially added by the OCB
+                    if (i + 1 < n && checked_word_id(words[i + 1]) == WordID::GATE_HEADER) nbr_feb_words++;
+                }
+                break;
+            }
+
+            case WordID::GATE_TIME:
+            case WordID::HOLD_TIME:
+                nbr_feb_words++;
+                break;
+
+            case WordID::GTS_HEADER:
+                nbr_gts++;
+                if (nbr_gts > Layout::NUM_GTS_BEFORE_EVENT) nbr_feb_words++;
+                break;
+
+            // increment FEB word count only if number of GTS headers received is above GTS_BEFORE_EVENT
+            case WordID::GTS_TRAILER1:
+            case WordID::GTS_TRAILER2:
+            case WordID::HIT_TIME:
+            case WordID::HIT_AMPLITUDE:
+                if (nbr_gts > Layout::NUM_GTS_BEFORE_EVENT) nbr_feb_words++;
+                break;
+
+            case WordID::EVENT_DONE: {
+                const int word_count = static_cast<int>(bits(w, 0, 16));
+                if (word_count != nbr_feb_words) {
+                    std::cerr << "Word count in EventDone ( " + std::to_string(word_count)
+                              << " ) does not match # words in FEB packet ( " << std::to_string(nbr_feb_words) << " )\n";
+                }
+                break;
+            }
+
+            case WordID::FEB_DATA_PACKET_TRAILER: {
+                nbr_feb_words++;
+                if (gate_header_index < 0) {
+                    throw std::runtime_error("FEB Data Packet Trailer received without corresponding Gate Header");
+                }
+                if (feb_id < 0 || feb_id >= Layout::NUM_FEBS_PER_OCB) {
+                    std::cerr << "Warning: encountered FEB with invalid board id " << feb_id << ", skipping\n";
+                } else if (decoded[feb_id]) {
+                    std::cerr << "Warning: FEB data packet for board " << feb_id << " already received\n";
+                } else {
+                    decode_feb_packet(words + gate_header_index, i + 1 - static_cast<size_t>(gate_header_index), visitor, mask);
+                    decoded[feb_id] = true;
+                }
+                gate_header_index = -1;
+                break;
+            }
+
+            default:
+                std::cerr << "Warning: encountered word id not belonging to FEB data packet: " << id << "\n";
+        }
+    }
+
+    visitor.on_event_end();
+}
+
+template <class Layout = DefaultLayout, class Visitor>
+void decode_ocb_packet(const std::vector<uint32_t>& words, Visitor& visitor, const ChannelMask* mask = nullptr) {
+    decode_ocb_packet<Layout>(words.data(), words.size(), visitor, mask);
+}
+
+#endif // OCBSTREAMDECODER_H
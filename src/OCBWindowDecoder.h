@@ -0,0 +1,440 @@
+// ========================= OCBWindowDecoder.h =========================
+#ifndef OCBWINDOWDECODER_H
+#define OCBWINDOWDECODER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ChannelMask.h"
+#include "InputSource.h"
+#include "OCBStreamDecoder.h"
+
+// Incremental decoding of the raw word stream, for live inputs: words are pushed
+// as they arrive and hits are delivered as soon as they are complete, instead of
+// after the OCB packet trailer (which follows all FEBs and all their GTS windows).
+// A time hit is delivered at its falling edge and an amplitude hit once both of
+// its gains are in; a GTS window is closed at its GTS_TRAILER2, when
+// on_window_end is called. Rising edges and single gains still waiting for their
+// partner carry over to the following windows of the FEB packet; the ones left at
+// the FEB trailer are delivered there, in the order of decode_feb_packet().
+//
+// For a well-formed packet the visitor receives the same hits, checks and warnings
+// as with decode_ocb_packet() (OCBStreamDecoder.h), in this order:
+//   on_event_begin (error bits not known yet: all false)
+//   per FEB: on_feb_begin (board and hold time only), { on_gate_time | on_hit_time |
+//            on_hit_amplitude | on_gts + on_window_end }*, remaining hits, on_feb_end
+//   on_event_trailer (OCB error bits), on_event_end
+// Hits are delivered before the checks of the OCB trailer: a packet that turns out
+// to be bad raises its exception after its early hits were seen, and a FEB
+// packet cut short by a new gate header is closed with what it had. After an
+// exception the event is abandoned (no on_event_end) and push() resumes at the
+// next OCB packet header.
+struct WindowVisitor : DecodeVisitor {
+    // GTS window `gts_tag` of the FEB packet closed: all its hits were delivered
+    void on_window_end(const FEBInfo& /*feb*/, uint32_t /*gts_tag*/) {}
+    void on_event_trailer(const std::array<bool, 16>& /*ocb_errors*/) {}
+};
+
+template <class Visitor, class Layout = DefaultLayout>
+class OCBWindowDecoder {
+public:
+    explicit OCBWindowDecoder(Visitor& visitor, const ChannelMask* mask = nullptr) : visitor(visitor), mask(mask) {}
+
+    // Decode the next word of the stream
+    void push(uint32_t word) {
+        ++words_read;
+        try {
+            decode(word);
+        } catch (...) {
+            in_packet = false;
+            feb_open = false;
+            throw;
+        }
+    }
+
+    void push(const uint32_t* words, size_t n) {
+        for (size_t i = 0; i < n; ++i) push(words[i]);
+    }
+
+    // Push everything `source` delivers until its end (zero-copy sources are
+    // decoded in place), stopping at the first exception. Returns the number of
+    // OCB packets completed.
+    uint64_t run(ByteSource& source);
+
+    uint64_t get_words_read() const { return words_read; }
+    uint64_t get_packets_read() const { return packets_read; }
+
+private:
+    using FEBScratch = ocb_stream_detail::FEBScratch;
+
+    Visitor& visitor;
+    const ChannelMask* mask;
+    uint64_t words_read = 0;
+    uint64_t packets_read = 0;
+
+    // OCB packet state (as in decode_ocb_packet)
+    bool in_packet = false;
+    uint32_t header = 0;
+    std::array<bool, Layout::NUM_FEBS_PER_OCB> decoded{};
+    bool gate_header_seen = false;
+    bool after_gate_header0 = false;  // previous word was a header 0 (word count look-ahead)
+    int feb_id = -1;
+    int nbr_feb_words = 0;
+    int nbr_gts = 0;
+
+    // FEB packet state (as in decode_feb_packet)
+    bool feb_open = false;     // decoding the words of a FEB packet
+    bool feb_started = false;  // on_feb_begin called (after the word following the gate header)
+    FEBInfo info;
+    bool has_gts = false;
+    int gts_tag = -1;
+    FEBScratch scratch;
+    std::array<bool, FEBScratch::NUM_CHANNELS> amplitude_done{};
+
+    void decode(uint32_t w);
+    void begin_event(uint32_t w);
+    void begin_feb(uint32_t w);
+    void feb_word(uint32_t w, WordID id);
+    void end_feb(uint32_t trailer);
+    void end_event(uint32_t trailer);
+    void emit_amplitude(uint16_t channel);
+};
+
+// ---------------- implementation ----------------
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::decode(uint32_t w) {
+    using namespace ocb_stream_detail;
+    const uint32_t raw_id = w >> 28;
+    if (raw_id == OCB_PACKET_HEADER) {
+        // A new header restarts the packet (as in OCBFramer)
+        begin_event(w);
+        return;
+    }
+    if (!in_packet) {
+        if (raw_id == OCB_PACKET_TRAILER) throw std::runtime_error("OCB Packet Trailer received without corresponding Header");
+        return;
+    }
+    if (raw_id == OCB_PACKET_TRAILER) {
+        end_event(w);
+        return;
+    }
+
+    const WordID id = checked_word_id(w);
+    if (after_gate_header0 && id == WordID::GATE_HEADER) nbr_feb_words++;
+    after_gate_header0 = false;
+    if (feb_open && !feb_started) {
+        // The FEB info is complete with the word after the gate header
+        if (id == WordID::HOLD_TIME) info.hold_time = static_cast<int>(bits(w, 0, 11));
+        visitor.on_feb_begin(info);
+        feb_started = true;
+    }
+
+    switch (id) {
+        case WordID::GATE_HEADER:
+            if (bits(w, 19, 1) != 0) nbr_feb_words++;
+            else {
+                nbr_feb_words = 0;
+                nbr_gts = 0;
+                after_gate_header0 = true;
+                begin_feb(w);
+            }
+            break;
+
+        case WordID::GATE_TIME:
+        case WordID::HOLD_TIME:
+            nbr_feb_words++;
+            break;
+
+        case WordID::GTS_HEADER:
+            nbr_gts++;
+            if (nbr_gts > Layout::NUM_GTS_BEFORE_EVENT) nbr_feb_words++;
+            break;
+
+        case WordID::GTS_TRAILER1:
+        case WordID::GTS_TRAILER2:
+        case WordID::HIT_TIME:
+        case WordID::HIT_AMPLITUDE:
+            if (nbr_gts > Layout::NUM_GTS_BEFORE_EVENT) nbr_feb_words++;
+            break;
+
+        case WordID::EVENT_DONE: {
+            const int word_count = static_cast<int>(bits(w, 0, 16));
+            if (word_count != nbr_feb_words) {
+                std::cerr << "Word count in EventDone ( " + std::to_string(word_count)
+                          << " ) does not match # words in FEB packet ( " << std::to_string(nbr_feb_words) << " )\n";
+            }
+            break;
+        }
+
+        case WordID::FEB_DATA_PACKET_TRAILER:
+            nbr_feb_words++;
+            if (!gate_header_seen) {
+                throw std::runtime_error("FEB Data Packet Trailer received without corresponding Gate Header");
+            }
+            if (feb_id < 0 || feb_id >= Layout::NUM_FEBS_PER_OCB) {
+                std::cerr << "Warning: encountered FEB with invalid board id " << feb_id << ", skipping\n";
+            } else if (decoded[feb_id]) {
+                std::cerr << "Warning: FEB data packet for board " << feb_id << " already received\n";
+            } else {
+                end_feb(w);
+                decoded[feb_id] = true;
+            }
+            gate_header_seen = false;
+            feb_open = false;
+            return;
+
+        default:
+            std::cerr << "Warning: encountered word id not belonging to FEB data packet: " << id << "\n";
+    }
+    if (feb_open) feb_word(w, id);
+}
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::begin_event(uint32_t w) {
+    in_packet = true;
+    header = w;
+    decoded.fill(false);
+    gate_header_seen = false;
+    after_gate_header0 = false;
+    feb_id = -1;
+    nbr_feb_words = 0;
+    nbr_gts = 0;
+    feb_open = false;
+    std::array<bool, 16> unknown{};
+    visitor.on_event_begin(ocb_stream_detail::bits(w, 0, 23), unknown);
+    // decode_ocb_packet() walks the header and trailer words too
+    std::cerr << "Warning: encountered word id not belonging to FEB data packet: " << WordID::OCB_PACKET_HEADER << "\n";
+}
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::begin_feb(uint32_t w) {
+    // A gate header 0 before the trailer restarts the FEB packet: the one in
+    // progress is closed with what it had
+    if (feb_open && feb_started) visitor.on_feb_end(info);
+    gate_header_seen = true;
+    feb_id = static_cast<int>(ocb_stream_detail::bits(w, 20, 8));
+    // Boards the packet decoder would skip are not decoded
+    feb_open = feb_id >= 0 && feb_id < Layout::NUM_FEBS_PER_OCB && !decoded[feb_id];
+    feb_started = false;
+    if (!feb_open) return;
+
+    info = FEBInfo();
+    info.board_id = feb_id;
+    has_gts = false;
+    gts_tag = -1;
+    for (uint16_t c : scratch.amplitude_channels) amplitude_done[c] = false;
+    scratch.reset();
+}
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::feb_word(uint32_t w, WordID id) {
+    using namespace ocb_stream_detail;
+    FEBScratch& s = scratch;
+    switch (id) {
+        case WordID::GATE_TIME:
+            visitor.on_gate_time(static_cast<int>(bits(w, 0, 28)));
+            break;
+
+        case WordID::GTS_HEADER:
+            has_gts = true;
+            gts_tag = static_cast<int>(bits(w, 0, 28));
+            break;
+
+        case WordID::HIT_TIME: {
+            if (mask && mask->masks(info.board_id, w)) {
+                info.masked_words++;
+                break;
+            }
+            const int channel_id = static_cast<int>(bits(w, 20, 8));
+            const int hit_id = static_cast<int>(bits(w, 17, 3));
+            const int tag_id = static_cast<int>(bits(w, 15, 2));
+            const int hit_time = static_cast<int>(bits(w, 0, 13));
+            const uint16_t key = static_cast<uint16_t>(channel_id * FEBScratch::NUM_HIT_IDS + hit_id);
+            auto& p = s.times[key];
+            if (bits(w, 14, 1) == 0) {
+                if (p.active) {
+                    throw std::runtime_error("Rising edge received twice for same hit (channel_id=" + std::to_string(channel_id) +
+                                             ", hit_id=" + std::to_string(hit_id) + ")");
+                }
+                p.active = true;
+                p.gts_tag_rise = gts_tag;
+                p.tag_id_rise = tag_id;
+                p.hit_time_rise = hit_time;
+                s.time_keys.push_back(key);
+            } else {
+                if (!p.active) {
+                    throw std::runtime_error("Falling edge received before rising edge for hit (channel_id=" + std::to_string(channel_id) +
+                                             ", hit_id=" + std::to_string(hit_id) + ")");
+                }
+                HitTimeData h(info.board_id, channel_id, hit_id);
+                h.set_hit_time_rise(p.hit_time_rise);
+                h.set_tag_id_rise(p.tag_id_rise);
+                h.set_gts_tag_rise(p.gts_tag_rise);
+                h.set_hit_time_fall(hit_time);
+                h.set_tag_id_fall(tag_id);
+                h.set_gts_tag_fall(gts_tag);
+                p.active = false;
+                visitor.on_hit_time(h);
+            }
+            break;
+        }
+
+        case WordID::HIT_AMPLITUDE: {
+            if (mask && mask->masks(info.board_id, w)) {
+                info.masked_words++;
+                break;
+            }
+            const int channel_id = static_cast<int>(bits(w, 20, 8));
+            auto& a = s.amplitudes[channel_id];
+            if (!a.active) {
+                a.active = true;
+                a.hit_id = static_cast<int>(bits(w, 17, 3));
+                a.gts_tag_lg = a.tag_id_lg = a.amplitude_lg = -1;
+                a.gts_tag_hg = a.tag_id_hg = a.amplitude_hg = -1;
+                s.amplitude_channels.push_back(static_cast<uint16_t>(channel_id));
+            }
+            const int tag_id = static_cast<int>(bits(w, 15, 2));
+            const int value = static_cast<int>(bits(w, 0, 12));
+            if (bits(w, 12, 3) == 2) {
+                if (a.amplitude_hg != -1) {
+                    throw std::runtime_error("High Gain Amplitude received twice for same channel (channel_id=" + std::to_string(channel_id) + ")");
+                }
+                a.amplitude_hg = value;
+                a.tag_id_hg = tag_id;
+                a.gts_tag_hg = gts_tag;
+            } else {
+                if (a.amplitude_lg != -1) {
+                    throw std::runtime_error("Low Gain Amplitude received twice for same channel (channel_id=" + std::to_string(channel_id) + ")");
+                }
+                a.amplitude_lg = value;
+                a.tag_id_lg = tag_id;
+                a.gts_tag_lg = gts_tag;
+            }
+            if (a.amplitude_lg != -1 && a.amplitude_hg != -1) emit_amplitude(static_cast<uint16_t>(channel_id));
+            break;
+        }
+
+        case WordID::GTS_TRAILER1:
+            if (!has_gts) throw std::runtime_error("GTS Trailer1 received without corresponding GTS Header!");
+            if (static_cast<int>(bits(w, 0, 28)) != gts_tag) {
+                throw std::runtime_error("GTS tag in Trailer1 different from current GTS Header!");
+            }
+            break;
+
+        case WordID::GTS_TRAILER2:
+            if (!has_gts) throw std::runtime_error("GTS Trailer2 received without corresponding GTS Header!");
+            visitor.on_gts(static_cast<uint32_t>(gts_tag), bits(w, 0, 20));
+            visitor.on_window_end(info, static_cast<uint32_t>(gts_tag));
+            break;
+
+        default:
+            break;
+    }
+}
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::emit_amplitude(uint16_t channel) {
+    const auto& a = scratch.amplitudes[channel];
+    HitAmplitudeData h(info.board_id, channel, a.hit_id);
+    h.set_amplitude_lg(a.amplitude_lg);
+    h.set_tag_id_lg(a.tag_id_lg);
+    h.set_gts_tag_lg(a.gts_tag_lg);
+    h.set_amplitude_hg(a.amplitude_hg);
+    h.set_tag_id_hg(a.tag_id_hg);
+    h.set_gts_tag_hg(a.gts_tag_hg);
+    amplitude_done[channel] = true;
+    visitor.on_hit_amplitude(h);
+}
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::end_feb(uint32_t trailer) {
+    using namespace ocb_stream_detail;
+    if (!feb_started) {
+        visitor.on_feb_begin(info);
+        feb_started = true;
+    }
+    info.artificial_trl2 = bits(trailer, 19, 1);
+    info.event_done_timeout = bits(trailer, 18, 1);
+    info.d1_fifo_full = bits(trailer, 17, 1);
+    info.d0_fifo_full = bits(trailer, 16, 1);
+    info.rb_cnt_error = bits(trailer, 15, 1);
+    info.nb_decoder_errors = static_cast<int>(bits(trailer, 0, 15));
+
+    // Hits still waiting for their falling edge or second gain
+    FEBScratch& s = scratch;
+    std::sort(s.time_keys.begin(), s.time_keys.end());
+    s.time_keys.erase(std::unique(s.time_keys.begin(), s.time_keys.end()), s.time_keys.end());
+    for (uint16_t key : s.time_keys) {
+        auto& p = s.times[key];
+        if (!p.active) continue;
+        HitTimeData h(info.board_id, key / FEBScratch::NUM_HIT_IDS, key % FEBScratch::NUM_HIT_IDS);
+        h.set_hit_time_rise(p.hit_time_rise);
+        h.set_tag_id_rise(p.tag_id_rise);
+        h.set_gts_tag_rise(p.gts_tag_rise);
+        visitor.on_hit_time(h);
+    }
+    std::sort(s.amplitude_channels.begin(), s.amplitude_channels.end());
+    for (uint16_t channel : s.amplitude_channels) {
+        if (!amplitude_done[channel]) emit_amplitude(channel);
+    }
+    visitor.on_feb_end(info);
+}
+
+template <class Visitor, class Layout>
+void OCBWindowDecoder<Visitor, Layout>::end_event(uint32_t trailer) {
+    using namespace ocb_stream_detail;
+    in_packet = false;
+    if (feb_open && feb_started) visitor.on_feb_end(info);
+    feb_open = false;
+    if (bits(header, 25, 3) != bits(trailer, 25, 3)) {
+        throw std::runtime_error("Different gate type in OCB packet header and trailer!");
+    }
+    if (bits(header, 23, 2) != bits(trailer, 23, 2)) {
+        throw std::runtime_error("Different gate tag in OCB packet header and trailer!");
+    }
+    std::array<bool, 16> ocb_errors;
+    for (int i = 0; i < 16; ++i) ocb_errors[i] = bits(trailer, i, 1);
+    report_ocb_errors(ocb_errors);
+    std::cerr << "Warning: encountered word id not belonging to FEB data packet: " << WordID::OCB_PACKET_TRAILER << "\n";
+    ++packets_read;
+    visitor.on_event_trailer(ocb_errors);
+    visitor.on_event_end();
+}
+
+template <class Visitor, class Layout>
+uint64_t OCBWindowDecoder<Visitor, Layout>::run(ByteSource& source) {
+    const uint64_t first = packets_read;
+    auto push_bytes = [this](const unsigned char* p, size_t n_words) {
+        for (size_t i = 0; i < n_words; ++i) {
+            uint32_t w;
+            std::memcpy(&w, p + 4 * i, 4);  // little-endian host
+            push(w);
+        }
+    };
+    if (source.zero_copy()) {
+        size_t available;
+        while (const unsigned char* p = source.peek(4, available)) {
+            const size_t n_words = available / 4;
+            push_bytes(p, n_words);
+            source.consume(4 * n_words);
+        }
+        return packets_read - first;
+    }
+    std::vector<unsigned char> buf(1 << 16);
+    size_t have = 0;
+    while (size_t n = source.read(buf.data() + have, buf.size() - have)) {
+        have += n;
+        const size_t n_words = have / 4;
+        push_bytes(buf.data(), n_words);
+        std::memmove(buf.data(), buf.data() + 4 * n_words, have - 4 * n_words);
+        have -= 4 * n_words;
+    }
+    return packets_read - first;
+}
+
+#endif // OCBWINDOWDECODER_H
@@ -0,0 +1,264 @@
+#include "Pipeline.h"
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "CpuAffinity.h"
+#include "OCBFramer.h"
+#include "OCBStreamDecoder.h"
+#include "SPSCQueue.h"
+
+void decode_batch(PacketBatch& batch, OCBLayoutId layout, const ChannelMask* mask) {
+    size_t n = batch.error ? batch.error_index : batch.packets.size();
+    batch.events.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        try {
+            batch.events.emplace_back(batch.packets[i], /*debug=*/false, layout, mask);
+        } catch (...) {
+            batch.error = std::current_exception();
+            batch.error_index = i;
+            break;
+        }
+    }
+}
+
+void summarize_batch(PacketBatch& batch, OCBLayoutId layout, uint32_t prescale) {
+    using namespace ocb_stream_detail;
+    const uint32_t num_febs = static_cast<uint32_t>(get_layout_info(layout).num_febs);
+    const size_t n = batch.error ? batch.error_index : batch.packets.size();
+    batch.summaries.reserve(n / prescale + 1);
+    for (size_t i = 0; i < n; ++i) {
+        if ((batch.first_packet + i) % prescale != 0) continue;
+        const std::vector<uint32_t>& words = batch.packets[i];
+        try {
+            if (words.size() < 2) throw std::runtime_error("OCB packet too small");
+            expect_word(words.front(), WordID::OCB_PACKET_HEADER);
+            expect_word(words.back(), WordID::OCB_PACKET_TRAILER);
+        } catch (...) {
+            batch.error = std::current_exception();
+            batch.error_index = i;
+            break;
+        }
+        PacketSummary s{static_cast<uint32_t>(i), bits(words.front(), 0, 23),
+                        static_cast<uint16_t>(bits(words.back(), 0, 16)), 0};
+        for (uint32_t w : words) {
+            // A GATE_HEADER of type 0 opens the data of one FEB; boards outside
+            // the layout are left to the full decoder to reject
+            if (get_wordID(w) != WordID::GATE_HEADER || bits(w, 19, 1) != 0) continue;
+            const uint32_t board = bits(w, 20, 8);
+            if (board < num_febs) s.febs |= 1u << board;
+        }
+        batch.summaries.push_back(s);
+    }
+}
+
+void calibrate_batch(PacketBatch& batch, const CalibrationTable& table) {
+    batch.calibrated.clear();
+    batch.calibrated_offsets.assign(1, 0);
+    for (const auto& ev : batch.events) {
+        batch.calibrated.append(ev);
+        batch.calibrated_offsets.push_back(batch.calibrated.size());
+    }
+    calibrate(table, batch.calibrated);
+}
+
+void cluster_batch(PacketBatch& batch, const GeometryMap& geometry, const ClusterConfig& config) {
+    // One finder per decoder thread, rebuilt only if the geometry or configuration changes
+    thread_local std::unique_ptr<ClusterFinder> finder;
+    thread_local uint64_t finder_geometry = 0;
+    thread_local ClusterConfig finder_config;
+    if (!finder || finder_geometry != geometry.get_id() || finder_config.ocb_id != config.ocb_id
+        || finder_config.time_window != config.time_window || finder_config.connect_layers != config.connect_layers) {
+        finder = std::make_unique<ClusterFinder>(geometry, config);
+        finder_geometry = geometry.get_id();
+        finder_config = config;
+    }
+
+    const bool calibrated = batch.calibrated_offsets.size() == batch.events.size() + 1;
+    batch.clusters.clear();
+    batch.cluster_offsets.assign(1, 0);
+    for (size_t i = 0; i < batch.events.size(); ++i) {
+        const float* energies = calibrated ? batch.calibrated.energy.data() + batch.calibrated_offsets[i] : nullptr;
+        finder->find(batch.events[i], batch.clusters, energies);
+        batch.cluster_offsets.push_back(batch.clusters.size());
+    }
+}
+
+static const char* gain_name(uint8_t gain) {
+    switch (gain) {
+        case GAIN_HG: return "HG";
+        case GAIN_LG: return "LG";
+        default: return "none";
+    }
+}
+
+void print_batch(std::ostream& out, const PacketBatch& batch, bool raw_words) {
+    for (size_t i = 0; i < batch.packets.size(); ++i) {
+        if (raw_words) {
+            for (uint32_t w : batch.packets[i]) {
+                out << *parse_word(w);
+            }
+        }
+        // Stop at a packet that failed to decode
+        if (i >= batch.events.size()) break;
+        out << batch.events[i];
+
+        if (i + 1 < batch.calibrated_offsets.size()) {
+            const CalibratedHits& c = batch.calibrated;
+            out << "Calibrated hits: " << batch.calibrated_offsets[i + 1] - batch.calibrated_offsets[i] << '\n';
+            for (size_t k = batch.calibrated_offsets[i]; k < batch.calibrated_offsets[i + 1]; ++k) {
+                out << "  Board " << c.board[k] << ", Channel " << c.channel[k]
+                    << ": energy " << c.energy[k] << " (" << gain_name(c.gain[k]) << ")\n";
+            }
+        }
+        if (i + 1 < batch.cluster_offsets.size()) {
+            out << "Clusters: " << batch.cluster_offsets[i + 1] - batch.cluster_offsets[i] << '\n';
+            for (size_t k = batch.cluster_offsets[i]; k < batch.cluster_offsets[i + 1]; ++k) {
+                out << "  Cluster " << k - batch.cluster_offsets[i] << ": " << batch.clusters[k];
+            }
+        }
+    }
+}
+
+void print_shed_batch(std::ostream& out, const PacketBatch& batch) {
+    if (batch.packets.empty()) return;
+    out << "Load shedding (" << shed_level_name(batch.shed_level) << "): OCB packets " << batch.first_packet << "-"
+        << batch.first_packet + batch.packets.size() - 1;
+    if (batch.shed_level == ShedLevel::PRESCALE) out << ", " << batch.summaries.size() << " summarized";
+    out << '\n';
+    if (batch.shed_level == ShedLevel::NO_OPTIONAL) {
+        print_batch(out, batch, /*raw_words=*/false);
+        return;
+    }
+    for (const auto& s : batch.summaries) {
+        out << "OCB Packet Summary - Event number: " << s.event_id << ", OCB error bits: " << s.errors << ", FEBs:";
+        for (int b = 0; b < OCBConfig::MAX_FEBS_PER_OCB; ++b) {
+            if (s.febs >> b & 1) out << ' ' << b;
+        }
+        out << '\n';
+    }
+}
+
+using BatchQueue = SPSCQueue<std::unique_ptr<PacketBatch>>;
+
+uint64_t Pipeline::run(ByteSource& source, const Sink& sink) {
+    return run_shared(source, [&sink](const std::shared_ptr<const PacketBatch>& batch) { sink(*batch); });
+}
+
+uint64_t Pipeline::run_shared(ByteSource& source, const SharedSink& sink) {
+    if (config.start_offset != 0 && source.skip(config.start_offset) != config.start_offset) {
+        throw std::runtime_error("Input ends before the resume offset " + std::to_string(config.start_offset));
+    }
+
+    const size_t ndec = std::max(1, config.decoder_threads);
+    std::vector<std::unique_ptr<BatchQueue>> to_decoder, to_writer;
+    for (size_t i = 0; i < ndec; ++i) {
+        to_decoder.push_back(std::make_unique<BatchQueue>(config.queue_depth));
+        to_writer.push_back(std::make_unique<BatchQueue>(config.queue_depth));
+    }
+
+    auto abort_all = [&] {
+        for (auto& q : to_decoder) q->abort();
+        for (auto& q : to_writer) q->abort();
+    };
+
+    // ---- reader: frame packets and deal batches round-robin ----
+    std::thread reader([&] {
+        if (config.pin_threads) pin_current_thread(0);
+        OCBFramer framer(source);
+        uint64_t seq = 0;
+        uint64_t first_packet = config.start_packet;
+        bool more = true;
+        while (more) {
+            auto batch = std::make_unique<PacketBatch>();
+            batch->seq = seq;
+            batch->first_packet = first_packet;
+            batch->packets.reserve(config.batch_packets);
+            try {
+                std::vector<uint32_t> words;
+                // A live source that has nothing more for now flushes a partial batch
+                while (batch->packets.size() < config.batch_packets
+                       && (batch->packets.empty() || !framer.would_block()) && (more = framer.next(words))) {
+                    if (config.record_offsets) {
+                        batch->offsets.push_back(config.start_offset + (framer.get_words_read() - words.size()) * 4);
+                    }
+                    batch->packets.push_back(std::move(words));
+                }
+            } catch (...) {
+                batch->error = std::current_exception();
+                batch->error_index = batch->packets.size();
+                more = false;
+            }
+            if (batch->packets.empty() && !batch->error) break;
+            batch->input_end = config.start_offset + framer.get_words_read() * 4;
+            if (config.shedder) {
+                // Pressure: the fuller of the pipeline queues and the source's own buffer
+                size_t queued = 0, capacity = 0;
+                for (size_t d = 0; d < ndec; ++d) {
+                    queued += to_decoder[d]->size() + to_writer[d]->size();
+                    capacity += to_decoder[d]->capacity() + to_writer[d]->capacity();
+                }
+                const double pressure = std::max(static_cast<double>(queued) / capacity, source.backlog());
+                batch->shed_level = config.shedder->update(pressure, batch->first_packet, batch->packets.size());
+            }
+            if (config.calibration) batch->calibration = config.calibration->run_table();
+            batch->framed = std::chrono::steady_clock::now();
+            first_packet += batch->packets.size();
+            if (!to_decoder[seq % ndec]->push(std::move(batch))) return;
+            ++seq;
+        }
+        for (auto& q : to_decoder) q->close();
+    });
+
+    // ---- decoders ----
+    std::vector<std::thread> decoders;
+    for (size_t d = 0; d < ndec; ++d) {
+        decoders.emplace_back([&, d] {
+            if (config.pin_threads) pin_current_thread(1 + d);
+            std::unique_ptr<PacketBatch> batch;
+            while (to_decoder[d]->pop(batch)) {
+                const ShedLevel level = batch->shed_level;
+                if (level >= ShedLevel::HEADER_ONLY) {
+                    const uint32_t prescale = level == ShedLevel::PRESCALE ? config.shedder->get_policy().prescale : 1;
+                    summarize_batch(*batch, config.layout, prescale);
+                } else if (config.build_events) {
+                    decode_batch(*batch, config.layout, config.mask);
+                }
+                if (decode_hook && level == ShedLevel::FULL) decode_hook(*batch);
+                if (!to_writer[d]->push(std::move(batch))) return;
+            }
+            to_writer[d]->close();
+        });
+    }
+
+    // ---- writer: collect batches in input order ----
+    uint64_t n_packets = 0;
+    std::exception_ptr error;
+    std::thread writer([&] {
+        if (config.pin_threads) pin_current_thread(1 + ndec);
+        std::unique_ptr<PacketBatch> next;
+        try {
+            for (uint64_t seq = 0; to_writer[seq % ndec]->pop(next); ++seq) {
+                std::shared_ptr<const PacketBatch> batch(std::move(next));
+                sink(batch);
+                if (config.shedder) {
+                    config.shedder->observe_latency(
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - batch->framed).count());
+                }
+                n_packets += batch->error ? batch->error_index : batch->packets.size();
+                if (batch->error) std::rethrow_exception(batch->error);
+            }
+        } catch (...) {
+            error = std::current_exception();
+            abort_all();
+        }
+    });
+
+    reader.join();
+    for (auto& t : decoders) t.join();
+    writer.join();
+
+    if (error) std::rethrow_exception(error);
+    return n_packets;
+}
@@ -0,0 +1,132 @@
+// ========================= Pipeline.h =========================
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Calibration.h"
+#include "ChannelMask.h"
+#include "ClusterFinder.h"
+#include "InputSource.h"
+#include "LoadShedder.h"
+#include "OCBDecoder.h"
+
+struct PipelineConfig {
+    int decoder_threads = 1;      // number of parallel decoder stages
+    size_t batch_packets = 64;    // OCB packets handed between stages at once
+    size_t queue_depth = 16;      // batches buffered between two stages
+    bool pin_threads = false;     // pin reader/decoder/writer threads to separate CPUs
+    bool build_events = true;     // false: no OCBDataPacket objects, decoders only run the decode hook
+    OCBLayoutId layout = OCBLayoutId::DEFAULT;  // FEB count / GTS windows of the OCB packets
+    const ChannelMask* mask = nullptr;          // noisy channels whose hit words are dropped undecoded
+    // Resuming: input bytes skipped before framing (a packet boundary) and the
+    // index of the first packet after them
+    uint64_t start_offset = 0;
+    uint64_t start_packet = 0;
+    bool record_offsets = false;  // fill PacketBatch::offsets
+    // Overload: the reader picks the tier of every batch from the fill of the
+    // pipeline queues and of the source, the writer feeds back the output latency
+    LoadShedder* shedder = nullptr;
+    // Calibration stage: the reader gives every batch the table of the current run
+    CalibrationManager* calibration = nullptr;
+};
+
+// Header-only decoding (load shedding): what the OCB header, trailer and gate
+// headers of a packet tell without decoding its hits
+struct PacketSummary {
+    uint32_t packet;    // index in the batch
+    uint32_t event_id;
+    uint16_t errors;    // OCB trailer error bits
+    uint16_t febs;      // bit b: board b sent data
+};
+
+// Unit of work flowing through the pipeline: a run of consecutive OCB packets
+// and, after the decoder stage, the corresponding decoded events.
+struct PacketBatch {
+    uint64_t seq = 0;
+    uint64_t first_packet = 0;  // index of packets[0] in the input
+    uint64_t input_end = 0;     // input bytes framed up to the end of the last packet
+    std::vector<std::vector<uint32_t>> packets;
+    std::vector<uint64_t> offsets;  // input offset of every packet (PipelineConfig::record_offsets)
+    std::vector<OCBDataPacket> events;
+    // Optional calibration stage: amplitude hits of all events as columns,
+    // hits of event i in [calibrated_offsets[i], calibrated_offsets[i+1]),
+    // calibrated with the table of the file or run the batch belongs to
+    std::shared_ptr<const CalibrationTable> calibration;
+    CalibratedHits calibrated;
+    std::vector<size_t> calibrated_offsets;
+    // Optional clustering stage: clusters of event i in [cluster_offsets[i], cluster_offsets[i+1])
+    std::vector<Cluster> clusters;
+    std::vector<size_t> cluster_offsets;
+    // Load shedding: tier chosen by the reader, and the summaries of the
+    // packets decoded header-only (HEADER_ONLY, PRESCALE) instead of `events`
+    ShedLevel shed_level = ShedLevel::FULL;
+    std::vector<PacketSummary> summaries;
+    std::chrono::steady_clock::time_point framed;  // when the reader passed the batch on
+    // Set if reading or decoding failed at packet `error_index`; packets before
+    // it are valid, the ones after it were not decoded.
+    std::exception_ptr error;
+    size_t error_index = 0;
+};
+
+// Staged reader -> decoder(s) -> writer pipeline. Stages run on their own
+// threads and are connected by bounded SPSC queues: the reader deals batches
+// round-robin to the decoders, and the writer collects them in the same order,
+// so the sink sees batches in input order.
+class Pipeline {
+public:
+    // Called on the writer thread for each batch, in input order
+    using Sink = std::function<void(const PacketBatch&)>;
+    // Same, handing over the (from then on immutable) batch, e.g. to an EventBus
+    using SharedSink = std::function<void(const std::shared_ptr<const PacketBatch>&)>;
+
+    // Called on a decoder thread for each decoded batch, before it is passed on
+    // (skipped for batches shed by the LoadShedder)
+    using DecodeHook = std::function<void(PacketBatch&)>;
+
+    explicit Pipeline(const PipelineConfig& config) : config(config) {}
+
+    // Optional extra work done by the decoder threads (e.g. monitoring)
+    void set_decode_hook(DecodeHook hook) { decode_hook = std::move(hook); }
+
+    // Process the whole source. Rethrows the first read/decode error (after
+    // the sink has seen every batch before it) or any exception of the sink.
+    // Returns the number of decoded OCB packets.
+    uint64_t run(ByteSource& source, const Sink& sink);
+    uint64_t run_shared(ByteSource& source, const SharedSink& sink);
+
+private:
+    PipelineConfig config;
+    DecodeHook decode_hook;
+};
+
+// Decoder stage: decode every packet of the batch into `events`, stopping at
+// the first packet that fails (recorded in `error`/`error_index`).
+void decode_batch(PacketBatch& batch, OCBLayoutId layout = OCBLayoutId::DEFAULT, const ChannelMask* mask = nullptr);
+
+// Header-only decoder stage: fill `summaries` for the packets whose input index
+// is a multiple of `prescale`, stopping at the first malformed one. FEBs
+// outside `layout` are not reported.
+void summarize_batch(PacketBatch& batch, OCBLayoutId layout = OCBLayoutId::DEFAULT, uint32_t prescale = 1);
+
+// Calibration stage: fill `calibrated` from the decoded events and apply `table`
+void calibrate_batch(PacketBatch& batch, const CalibrationTable& table);
+
+// Clustering stage: fill `clusters` from the decoded events, with calibrated
+// energies if the batch went through calibrate_batch() first
+void cluster_batch(PacketBatch& batch, const GeometryMap& geometry, const ClusterConfig& config);
+
+// Writer stage: dump the raw words and the decoded content of every packet
+// (and its calibrated hits and clusters, if any), up to and including the raw words of a
+// packet that failed to decode. Without `raw_words`, only the decoded content.
+void print_batch(std::ostream& out, const PacketBatch& batch, bool raw_words = true);
+
+// Writer stage of a shed batch: a line naming the tier and the packets it
+// covers, then the decoded events (NO_OPTIONAL) or the packet summaries
+void print_shed_batch(std::ostream& out, const PacketBatch& batch);
+
+#endif // PIPELINE_H
@@ -0,0 +1,180 @@
+#include "RawExtract.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "InputSource.h"
+#include "Kernels.h"
+#include "Word.h"
+
+bool PacketSelection::matches(uint64_t index, const PacketBounds& packet) const {
+    if (index < first_packet || index - first_packet >= packet_count) return false;
+    const uint32_t event = packet.header & 0x7FFFFF;  // bits 0-22 of the OCB header
+    if (event < first_event || event > last_event) return false;
+    return !errors_only || (packet.trailer & 0xFFFF) != 0;
+}
+
+// ---------------- file helpers ----------------
+
+namespace {
+
+// Owned file descriptor
+struct Fd {
+    int fd = -1;
+    ~Fd() {
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+void open_raw_input(const std::string& path, Fd& in, uint64_t& size) {
+    if (detect_compression(path) != Compression::NONE) {
+        throw std::runtime_error("Extraction requires an uncompressed raw file: " + path);
+    }
+    in.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (in.fd < 0 || fstat(in.fd, &st) != 0) {
+        throw std::runtime_error("Failed to open file: " + path + ": " + std::strerror(errno));
+    }
+    size = static_cast<uint64_t>(st.st_size);
+}
+
+void open_output(const std::string& path, Fd& out) {
+    out.fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out.fd < 0) throw std::runtime_error("Failed to create output file: " + path + ": " + std::strerror(errno));
+}
+
+}  // namespace
+
+void copy_range(int in_fd, int out_fd, uint64_t offset, uint64_t length) {
+    // copy_file_range can fail up front across filesystems or on old kernels, and
+    // sendfile on some file types: fall through to the next method with what is left
+    off_t off = static_cast<off_t>(offset);
+    uint64_t left = length;
+    while (left > 0) {
+        ssize_t n = copy_file_range(in_fd, &off, out_fd, nullptr, left, 0);
+        if (n > 0) {
+            left -= static_cast<uint64_t>(n);
+            continue;
+        }
+        if (n == 0) throw std::runtime_error("Unexpected end of input file while copying");
+        if (errno == EINTR) continue;
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+            throw std::runtime_error(std::string("copy_file_range failed: ") + std::strerror(errno));
+        }
+        break;
+    }
+    while (left > 0) {
+        ssize_t n = sendfile(out_fd, in_fd, &off, left);
+        if (n > 0) {
+            left -= static_cast<uint64_t>(n);
+            continue;
+        }
+        if (n == 0) throw std::runtime_error("Unexpected end of input file while copying");
+        if (errno == EINTR) continue;
+        if (errno != EINVAL && errno != ENOSYS) throw std::runtime_error(std::string("sendfile failed: ") + std::strerror(errno));
+        break;
+    }
+    std::vector<char> buf(left > 0 ? ExtractConfig::SCAN_BYTES : 0);
+    while (left > 0) {
+        ssize_t n = pread(in_fd, buf.data(), std::min<uint64_t>(left, buf.size()), off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) throw std::runtime_error("Failed to read input file while copying");
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = ::write(out_fd, buf.data() + done, static_cast<size_t>(n - done));
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) throw std::runtime_error(std::string("Failed to write output file: ") + std::strerror(errno));
+            done += w;
+        }
+        off += n;
+        left -= static_cast<uint64_t>(n);
+    }
+}
+
+// ---------------- extract ----------------
+
+ExtractStats extract_packets(const std::string& input, const std::string& output, const PacketSelection& selection) {
+    Fd in, out;
+    uint64_t size;
+    open_raw_input(input, in, size);
+    open_output(output, out);
+
+    // Framing reads the file through a buffered source, the copies go through the fd
+    FileSource source(input);
+    OCBFramer framer(source);
+    ExtractStats stats;
+    PacketBounds packet;
+    uint64_t range_begin = 0, range_end = 0;
+    auto flush = [&] {
+        if (range_end == range_begin) return;
+        copy_range(in.fd, out.fd, range_begin, range_end - range_begin);
+        stats.ranges++;
+        stats.bytes += range_end - range_begin;
+        range_begin = range_end = 0;
+    };
+
+    const uint64_t last_index = selection.packet_count == ExtractConfig::ALL ? ExtractConfig::ALL
+                                                                             : selection.first_packet + selection.packet_count;
+    while (stats.packets_scanned < last_index && framer.next_bounds(packet)) {
+        if (selection.matches(stats.packets_scanned++, packet)) {
+            if (packet.begin != range_end) {
+                flush();
+                range_begin = packet.begin;
+            }
+            range_end = packet.end;
+            stats.packets++;
+        }
+    }
+    flush();
+    return stats;
+}
+
+// ---------------- split ----------------
+
+// Offset of the first OCB packet header at or after `from` (a multiple of 4), or `size`
+static uint64_t next_header(int fd, uint64_t from, uint64_t size) {
+    std::vector<unsigned char> buf(ExtractConfig::SCAN_BYTES);
+    const Kernels& k = kernels();
+    for (uint64_t pos = from; pos + 4 <= size;) {
+        ssize_t n = pread(fd, buf.data(), static_cast<size_t>(std::min<uint64_t>(buf.size(), size - pos)), static_cast<off_t>(pos));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 4) throw std::runtime_error("Failed to read input file while looking for a split point");
+        const size_t words = static_cast<size_t>(n) / 4;
+        const size_t i = k.find_word_ids(buf.data(), words, WordID::OCB_PACKET_HEADER, WordID::OCB_PACKET_HEADER);
+        if (i < words) return pos + 4 * i;
+        pos += 4 * words;
+    }
+    return size;
+}
+
+std::vector<std::string> split_raw(const std::string& input, const std::string& prefix, unsigned n) {
+    if (n < 1) throw std::runtime_error("The number of parts must be at least 1");
+    Fd in;
+    uint64_t size;
+    open_raw_input(input, in, size);
+
+    // Cut points: the first header after every n-th of the file (word-aligned)
+    std::vector<uint64_t> cuts{0};
+    for (unsigned k = 1; k < n; ++k) {
+        uint64_t target = (size * k / n) & ~uint64_t(3);
+        cuts.push_back(std::max(cuts.back(), next_header(in.fd, std::max(target, cuts.back()), size)));
+    }
+    cuts.push_back(size);
+
+    const size_t digits = std::to_string(n - 1).size();
+    std::vector<std::string> parts;
+    for (unsigned k = 0; k < n; ++k) {
+        std::string index = std::to_string(k);
+        std::string path = prefix + "_" + std::string(digits - index.size(), '0') + index + ".raw";
+        Fd out;
+        open_output(path, out);
+        copy_range(in.fd, out.fd, cuts[k], cuts[k + 1] - cuts[k]);
+        parts.push_back(path);
+    }
+    return parts;
+}
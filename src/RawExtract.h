@@ -0,0 +1,50 @@
+// ========================= RawExtract.h =========================
+#ifndef RAWEXTRACT_H
+#define RAWEXTRACT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "OCBFramer.h"
+
+// Cutting raw files without decoding them: packets are framed from their
+// header and trailer words only, and the selected byte ranges are copied
+// file to file by the kernel (copy_file_range, sendfile), merged into one copy
+// per run of adjacent packets. Inputs must be uncompressed raw files.
+namespace ExtractConfig {
+    inline constexpr uint64_t ALL = ~uint64_t(0);
+    inline constexpr size_t SCAN_BYTES = 1 << 20;  // read size when looking for split points
+}
+
+// OCB packets to extract; a packet is taken if it passes every criterion
+struct PacketSelection {
+    uint64_t first_packet = 0;                    // packet index range
+    uint64_t packet_count = ExtractConfig::ALL;
+    uint32_t first_event = 0;                     // event number range (OCB header), inclusive
+    uint32_t last_event = UINT32_MAX;
+    bool errors_only = false;                     // only packets with OCB trailer error bits set
+
+    bool matches(uint64_t index, const PacketBounds& packet) const;
+};
+
+struct ExtractStats {
+    uint64_t packets_scanned = 0;
+    uint64_t packets = 0;   // packets written
+    uint64_t ranges = 0;    // copies of contiguous runs of packets
+    uint64_t bytes = 0;
+};
+
+// Write the selected packets of `input` to `output`, in input order.
+ExtractStats extract_packets(const std::string& input, const std::string& output, const PacketSelection& selection);
+
+// Cut `input` into n files of about equal size, <prefix>_<k>.raw, each starting
+// at an OCB packet header (the first at the start of the file). Concatenated,
+// they are the input. Only the bytes around the n-1 cut points are read.
+// Returns the paths of the parts.
+std::vector<std::string> split_raw(const std::string& input, const std::string& prefix, unsigned n);
+
+// Append `length` bytes at `offset` of in_fd to out_fd, inside the kernel if it can
+// (copy_file_range, then sendfile; read/write otherwise).
+void copy_range(int in_fd, int out_fd, uint64_t offset, uint64_t length);
+
+#endif // RAWEXTRACT_H
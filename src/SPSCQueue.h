@@ -0,0 +1,103 @@
+// ========================= SPSCQueue.h =========================
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free single-producer/single-consumer ring queue.
+// Exactly one thread may push and exactly one (other) thread may pop.
+// The blocking push()/pop() spin briefly, then yield, then sleep, so a full
+// queue throttles the producer (backpressure) without burning a core.
+template <class T>
+class SPSCQueue {
+public:
+    explicit SPSCQueue(size_t capacity) {
+        size_t cap = 2;
+        while (cap < capacity) cap <<= 1;
+        slots.resize(cap);
+        mask = cap - 1;
+    }
+
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    bool try_push(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == slots.size()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == slots.size()) return false;
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) return false;
+        }
+        item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocks while the queue is full. Returns false if the queue was aborted.
+    bool push(T item) {
+        for (unsigned spins = 0; !try_push(item); ++spins) {
+            if (aborted.load(std::memory_order_relaxed)) return false;
+            backoff(spins);
+        }
+        return true;
+    }
+
+    // Blocks while the queue is empty. Returns false once the queue is closed
+    // and drained, or aborted.
+    bool pop(T& item) {
+        for (unsigned spins = 0; !try_pop(item); ++spins) {
+            if (aborted.load(std::memory_order_relaxed)) return false;
+            if (closed.load(std::memory_order_acquire)) return try_pop(item);
+            backoff(spins);
+        }
+        return true;
+    }
+
+    // Producer: no more items will be pushed.
+    void close() { closed.store(true, std::memory_order_release); }
+    // Either side: wake up and fail all blocking calls.
+    void abort() { aborted.store(true, std::memory_order_relaxed); }
+
+    // Approximate number of queued items (exact when called by either endpoint)
+    size_t size() const {
+        // head first: the tail read after it is never behind it
+        const size_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+    size_t capacity() const { return slots.size(); }
+
+private:
+    static void backoff(unsigned spins) {
+        if (spins < 64) return;
+        if (spins < 256) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    std::vector<T> slots;
+    size_t mask = 0;
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cached_tail = 0;  // consumer's view of tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cached_head = 0;  // producer's view of head
+    alignas(64) std::atomic<bool> closed{false};
+    std::atomic<bool> aborted{false};
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,322 @@
+#include "ShmRing.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static_assert(offsetof(ShmRingHeader, capacity) == 8, "ring header layout");
+static_assert(offsetof(ShmRingHeader, producer_pid) == 16, "ring header layout");
+static_assert(offsetof(ShmRingHeader, consumer_pid) == 24, "ring header layout");
+static_assert(offsetof(ShmRingHeader, write_pos) == 64, "ring header layout");
+static_assert(offsetof(ShmRingHeader, n_publish) == 80, "ring header layout");
+static_assert(offsetof(ShmRingHeader, read_pos) == 128, "ring header layout");
+static_assert(offsetof(ShmRingHeader, producer_waiting) == 140, "ring header layout");
+static_assert(offsetof(ShmRingHeader, stamps) == 192, "ring header layout");
+static_assert(sizeof(ShmRingHeader) <= ShmConfig::HEADER_SIZE, "ring header layout");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring indices must be lock-free to be shared between processes");
+
+uint64_t monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// ---------------- futex ----------------
+
+// Shared (not FUTEX_PRIVATE) futexes: the words are in a segment mapped by two processes.
+// Returns false if the wait timed out.
+static bool futex_wait(std::atomic<uint32_t>& word, uint32_t expected, int timeout_ms) {
+    timespec ts{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0) == 0
+        || errno != ETIMEDOUT;
+}
+
+static void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+static bool process_alive(uint32_t pid) {
+    return pid != 0 && (kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM);
+}
+
+static std::string shm_path(const std::string& name) {
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+// ---------------- ShmRingMapping ----------------
+
+ShmRingMapping::ShmRingMapping(int fd, uint64_t capacity) : capacity(capacity) {
+    void* h = mmap(nullptr, ShmConfig::HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (h == MAP_FAILED) throw std::runtime_error(std::string("Failed to map ring header: ") + std::strerror(errno));
+    header = static_cast<ShmRingHeader*>(h);
+
+    // Reserve twice the data size, then map the data area into both halves
+    void* area = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED) {
+        munmap(header, ShmConfig::HEADER_SIZE);
+        throw std::runtime_error(std::string("Failed to reserve ring mapping: ") + std::strerror(errno));
+    }
+    data = static_cast<unsigned char*>(area);
+    for (int half = 0; half < 2; ++half) {
+        void* p = mmap(data + half * capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd,
+                       static_cast<off_t>(ShmConfig::HEADER_SIZE));
+        if (p == MAP_FAILED) {
+            int err = errno;
+            munmap(data, 2 * capacity);
+            munmap(header, ShmConfig::HEADER_SIZE);
+            throw std::runtime_error(std::string("Failed to map ring data: ") + std::strerror(err));
+        }
+    }
+}
+
+ShmRingMapping::~ShmRingMapping() {
+    munmap(data, 2 * capacity);
+    munmap(header, ShmConfig::HEADER_SIZE);
+}
+
+// ---------------- ShmRingProducer ----------------
+
+ShmRingProducer::ShmRingProducer(const std::string& segment, uint64_t capacity) : name(shm_path(segment)) {
+    const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    if (capacity < page || (capacity & (capacity - 1)) != 0) {
+        throw std::runtime_error("Ring capacity must be a power of two of at least one page");
+    }
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) throw std::runtime_error("Failed to create shared memory " + name + ": " + std::strerror(errno));
+    if (ftruncate(fd, static_cast<off_t>(ShmConfig::HEADER_SIZE + capacity)) != 0) {
+        int err = errno;
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("Failed to size shared memory " + name + ": " + std::strerror(err));
+    }
+    try {
+        map = new ShmRingMapping(fd, capacity);
+    } catch (...) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw;
+    }
+
+    // The segment is zero-filled: set the constants, then the magic last
+    ShmRingHeader* h = map->header;
+    h->capacity = capacity;
+    h->producer_pid = static_cast<uint32_t>(getpid());
+    h->version = ShmConfig::VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = ShmConfig::MAGIC;
+}
+
+ShmRingProducer::~ShmRingProducer() {
+    close();
+    delete map;
+    ::close(fd);
+    shm_unlink(name.c_str());
+}
+
+void ShmRingProducer::write(const void* src, size_t n) {
+    ShmRingHeader* h = map->header;
+    const unsigned char* p = static_cast<const unsigned char*>(src);
+    while (n > 0) {
+        uint64_t used = pending - h->read_pos.load(std::memory_order_acquire);
+        uint64_t space = map->capacity - used;
+        if (space == 0) {
+            // Publish what we have, so the consumer can make room, and sleep until it does
+            publish();
+            h->producer_waiting.store(1);
+            uint32_t seq = h->space_seq.load();
+            if (pending - h->read_pos.load() == map->capacity) {
+                uint32_t consumer = h->consumer_pid.load();
+                if (!futex_wait(h->space_seq, seq, ShmConfig::WAIT_TIMEOUT_MS) && consumer != 0 && !process_alive(consumer)) {
+                    h->producer_waiting.store(0);
+                    throw std::runtime_error("Ring consumer process is gone");
+                }
+            }
+            h->producer_waiting.store(0);
+            continue;
+        }
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(n, space));
+        std::memcpy(map->data + (pending & (map->capacity - 1)), p, chunk);  // mirrored: no wrap split
+        pending += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+}
+
+void ShmRingProducer::publish() {
+    ShmRingHeader* h = map->header;
+    if (pending == h->write_pos.load(std::memory_order_relaxed)) return;
+    uint64_t n = h->n_publish.load(std::memory_order_relaxed);
+    ShmRingHeader::Stamp& stamp = h->stamps[n % ShmConfig::NUM_STAMPS];
+    stamp.end_pos.store(pending, std::memory_order_relaxed);
+    stamp.time_ns.store(monotonic_ns(), std::memory_order_relaxed);
+    h->n_publish.store(n + 1, std::memory_order_release);
+
+    h->write_pos.store(pending);  // seq_cst: ordered before reading consumer_waiting
+    h->data_seq.fetch_add(1);
+    if (h->consumer_waiting.load()) futex_wake(h->data_seq);
+}
+
+void ShmRingProducer::close() {
+    ShmRingHeader* h = map->header;
+    if (h->producer_closed.load()) return;
+    publish();
+    h->producer_closed.store(1);
+    h->data_seq.fetch_add(1);
+    futex_wake(h->data_seq);
+}
+
+bool ShmRingProducer::consumer_attached() const {
+    return map->header->consumer_pid.load() != 0;
+}
+
+bool ShmRingProducer::drained() const {
+    return map->header->read_pos.load() == map->header->write_pos.load();
+}
+
+// ---------------- ShmRingSource ----------------
+
+ShmRingSource::ShmRingSource(const std::string& segment) {
+    const std::string name = shm_path(segment);
+    fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("Failed to open shared memory " + name + ": " + std::strerror(errno));
+
+    struct stat st;
+    ShmRingHeader probe;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < ShmConfig::HEADER_SIZE
+        || pread(fd, &probe, offsetof(ShmRingHeader, producer_closed), 0) != static_cast<ssize_t>(offsetof(ShmRingHeader, producer_closed))
+        || probe.magic != ShmConfig::MAGIC || probe.version != ShmConfig::VERSION
+        || static_cast<uint64_t>(st.st_size) != ShmConfig::HEADER_SIZE + probe.capacity) {
+        ::close(fd);
+        throw std::runtime_error("Not a FASERCal ring buffer (or another version): " + name);
+    }
+    try {
+        map = new ShmRingMapping(fd, probe.capacity);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+
+    uint32_t none = 0;
+    if (!map->header->consumer_pid.compare_exchange_strong(none, static_cast<uint32_t>(getpid()))
+        && process_alive(none)) {
+        delete map;
+        ::close(fd);
+        throw std::runtime_error("Ring buffer " + name + " already has a consumer (pid " + std::to_string(none) + ")");
+    }
+    map->header->consumer_pid.store(static_cast<uint32_t>(getpid()));
+    start_pos = map->header->read_pos.load(std::memory_order_acquire);
+}
+
+ShmRingSource::~ShmRingSource() {
+    map->header->consumer_pid.store(0);
+    delete map;
+    ::close(fd);
+}
+
+bool ShmRingSource::wait_for(size_t min_bytes) {
+    ShmRingHeader* h = map->header;
+    const uint64_t read_pos = h->read_pos.load(std::memory_order_relaxed);
+    while (true) {
+        if (h->write_pos.load(std::memory_order_acquire) - read_pos >= min_bytes) return true;
+        if (h->producer_closed.load(std::memory_order_acquire)) {
+            return h->write_pos.load(std::memory_order_acquire) - read_pos >= min_bytes;
+        }
+        h->consumer_waiting.store(1);
+        uint32_t seq = h->data_seq.load();
+        if (h->write_pos.load() - read_pos < min_bytes && !h->producer_closed.load()) {
+            if (!futex_wait(h->data_seq, seq, ShmConfig::WAIT_TIMEOUT_MS) && !process_alive(h->producer_pid)
+                && h->write_pos.load() - read_pos < min_bytes && !h->producer_closed.load()) {
+                h->consumer_waiting.store(0);
+                std::cerr << "Warning: ring producer (pid " << h->producer_pid << ") is gone without closing the ring\n";
+                return false;
+            }
+        }
+        h->consumer_waiting.store(0);
+    }
+}
+
+const unsigned char* ShmRingSource::peek(size_t min_bytes, size_t& available) {
+    available = 0;
+    if (!wait_for(std::max<size_t>(min_bytes, 1))) return nullptr;
+    ShmRingHeader* h = map->header;
+    const uint64_t read_pos = h->read_pos.load(std::memory_order_relaxed);
+    available = static_cast<size_t>(h->write_pos.load(std::memory_order_acquire) - read_pos);
+    return map->data + (read_pos & (map->capacity - 1));
+}
+
+void ShmRingSource::consume(size_t n) {
+    if (n == 0) return;
+    ShmRingHeader* h = map->header;
+    h->read_pos.store(h->read_pos.load(std::memory_order_relaxed) + n);  // seq_cst: before producer_waiting
+    h->space_seq.fetch_add(1);
+    if (h->producer_waiting.load()) futex_wake(h->space_seq);
+}
+
+bool ShmRingSource::ready() const {
+    const ShmRingHeader* h = map->header;
+    return h->write_pos.load(std::memory_order_acquire) != h->read_pos.load(std::memory_order_relaxed)
+        || h->producer_closed.load(std::memory_order_acquire);
+}
+
+double ShmRingSource::backlog() const {
+    const ShmRingHeader* h = map->header;
+    const uint64_t queued = h->write_pos.load(std::memory_order_acquire) - h->read_pos.load(std::memory_order_relaxed);
+    return static_cast<double>(queued) / map->capacity;
+}
+
+size_t ShmRingSource::read(void* buf, size_t n) {
+    size_t available;
+    const unsigned char* p = peek(1, available);
+    if (!p) return 0;
+    n = std::min(n, available);
+    std::memcpy(buf, p, n);
+    consume(n);
+    return n;
+}
+
+uint64_t ShmRingSource::skip(uint64_t n) {
+    uint64_t skipped = 0;
+    while (skipped < n) {
+        size_t available;
+        if (!peek(1, available)) break;
+        size_t k = static_cast<size_t>(std::min<uint64_t>(n - skipped, available));
+        consume(k);
+        skipped += k;
+    }
+    return skipped;
+}
+
+uint64_t ShmRingSource::publish_time(uint64_t offset) const {
+    // The first recorded publish that made the byte visible
+    const uint64_t pos = start_pos + offset;
+    const ShmRingHeader* h = map->header;
+    uint64_t best_end = UINT64_MAX, best_time = 0;
+    for (const auto& stamp : h->stamps) {
+        uint64_t end = stamp.end_pos.load(std::memory_order_relaxed);
+        uint64_t time = stamp.time_ns.load(std::memory_order_relaxed);
+        if (end >= pos && end < best_end && stamp.end_pos.load(std::memory_order_relaxed) == end) {
+            best_end = end;
+            best_time = time;
+        }
+    }
+    // Older stamps may have been overwritten: only trust a publish that is still the
+    // first one covering the byte, i.e. no older stamp has been lost since
+    const uint64_t n = h->n_publish.load(std::memory_order_acquire);
+    if (n > ShmConfig::NUM_STAMPS) {
+        uint64_t oldest = UINT64_MAX;
+        for (const auto& stamp : h->stamps) oldest = std::min(oldest, stamp.end_pos.load(std::memory_order_relaxed));
+        if (oldest >= pos) return 0;
+    }
+    return best_time;
+}
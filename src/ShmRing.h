@@ -0,0 +1,140 @@
+// ========================= ShmRing.h =========================
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "InputSource.h"
+
+namespace ShmConfig {
+    inline constexpr uint32_t MAGIC = 0x52534346;  // "FCSR"
+    inline constexpr uint32_t VERSION = 1;
+    inline constexpr size_t HEADER_SIZE = 4096;    // data starts one page into the segment
+    inline constexpr size_t NUM_STAMPS = 64;
+    inline constexpr uint64_t DEFAULT_CAPACITY = uint64_t(64) << 20;
+    inline constexpr int WAIT_TIMEOUT_MS = 100;    // futex waits re-check that the peer is alive
+}
+
+// Header of the shared-memory ring buffer (/dev/shm/<name>), little-endian.
+// Producer and consumer fields are on separate cache lines.
+//   0    u32 magic "FCSR", u32 version
+//   8    u64 capacity        bytes of the data area, a power of two and multiple of the page size
+//   16   u32 producer_pid    u32 producer_closed (no more data after write_pos)
+//   24   u32 consumer_pid    (0: no consumer attached)
+//   64   u64 write_pos       bytes ever written (producer)
+//   72   u32 data_seq        futex, bumped after write_pos moves or the producer closes
+//   76   u32 consumer_waiting
+//   80   u64 n_publish       number of publish() calls
+//   128  u64 read_pos        bytes ever consumed (consumer)
+//   136  u32 space_seq       futex, bumped after read_pos moves
+//   140  u32 producer_waiting
+//   192  stamps[64]          {u64 end_pos, u64 monotonic ns} of the last publish() calls
+//   4096 data                byte i of the stream at data[i % capacity]
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint32_t producer_pid;
+    std::atomic<uint32_t> producer_closed;
+    std::atomic<uint32_t> consumer_pid;
+
+    alignas(64) std::atomic<uint64_t> write_pos;
+    std::atomic<uint32_t> data_seq;
+    std::atomic<uint32_t> consumer_waiting;
+    std::atomic<uint64_t> n_publish;
+
+    alignas(64) std::atomic<uint64_t> read_pos;
+    std::atomic<uint32_t> space_seq;
+    std::atomic<uint32_t> producer_waiting;
+
+    struct Stamp {
+        std::atomic<uint64_t> end_pos;
+        std::atomic<uint64_t> time_ns;
+    };
+    alignas(64) Stamp stamps[ShmConfig::NUM_STAMPS];
+};
+
+// Mapping of a ring segment. The data area is mapped twice back to back, so
+// any run of up to `capacity` bytes is contiguous in memory, across the wrap.
+class ShmRingMapping {
+public:
+    ShmRingMapping(int fd, uint64_t capacity);
+    ~ShmRingMapping();
+
+    ShmRingMapping(const ShmRingMapping&) = delete;
+    ShmRingMapping& operator=(const ShmRingMapping&) = delete;
+
+    ShmRingHeader* header = nullptr;
+    unsigned char* data = nullptr;
+    uint64_t capacity = 0;
+};
+
+// Writer side, run by the acquisition process (see tools/shm_producer.cpp).
+// Creates the segment; blocks while the ring is full.
+class ShmRingProducer {
+public:
+    ShmRingProducer(const std::string& name, uint64_t capacity = ShmConfig::DEFAULT_CAPACITY);
+    // Closes the stream (if not done) and removes the segment name; an attached
+    // consumer keeps its mapping and drains the ring
+    ~ShmRingProducer();
+
+    // Copy bytes into the ring, waiting for space. They are visible to the
+    // consumer only after publish().
+    void write(const void* data, size_t n);
+    // Make everything written so far visible and wake the consumer
+    void publish();
+    // End of stream
+    void close();
+
+    bool consumer_attached() const;
+    // Everything published was consumed
+    bool drained() const;
+
+private:
+    std::string name;
+    int fd = -1;
+    ShmRingMapping* map = nullptr;
+    uint64_t pending = 0;  // write position including unpublished bytes
+};
+
+// Reader side: a ByteSource on an existing ring. The framer scans and copies
+// OCB packets straight out of the mapping (peek/consume), and the source sleeps
+// on a futex while the ring is empty. Ends when the producer has closed the
+// ring and it is drained, or the producer process is gone.
+class ShmRingSource : public ByteSource {
+public:
+    explicit ShmRingSource(const std::string& name);
+    ~ShmRingSource() override;
+
+    ShmRingSource(const ShmRingSource&) = delete;
+    ShmRingSource& operator=(const ShmRingSource&) = delete;
+
+    size_t read(void* buf, size_t n) override;
+    uint64_t skip(uint64_t n) override;
+
+    bool zero_copy() const override { return true; }
+    const unsigned char* peek(size_t min_bytes, size_t& available) override;
+    void consume(size_t n) override;
+    bool ready() const override;
+    double backlog() const override;
+
+    // Monotonic time (ns) at which the producer published the byte at stream
+    // offset `offset` (counted from where this source attached), or 0 if it is
+    // no longer recorded
+    uint64_t publish_time(uint64_t offset) const;
+
+private:
+    int fd = -1;
+    ShmRingMapping* map = nullptr;
+    uint64_t start_pos = 0;
+
+    // Wait until at least min_bytes are readable; false at end of stream
+    bool wait_for(size_t min_bytes);
+};
+
+// CLOCK_MONOTONIC in nanoseconds (the clock of the publish stamps)
+uint64_t monotonic_ns();
+
+#endif // SHMRING_H
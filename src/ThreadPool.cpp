@@ -0,0 +1,103 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include "CpuAffinity.h"
+
+// Worker index of the current thread within `current_pool`
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+ThreadPool::ThreadPool(size_t nthreads, bool pin_threads) {
+    nthreads = std::max<size_t>(1, nthreads);
+    for (size_t i = 0; i < nthreads; ++i) workers.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < nthreads; ++i) {
+        threads.emplace_back([this, i, pin_threads] {
+            if (pin_threads) pin_current_thread(i);
+            current_pool = this;
+            current_worker = i;
+            worker_loop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mtx);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void ThreadPool::submit(Task task) {
+    size_t target = (current_pool == this) ? current_worker
+                                           : next_queue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mtx);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    queued.fetch_add(1, std::memory_order_release);
+    // Taking the lock orders this notification after a sleeper's predicate check
+    { std::lock_guard<std::mutex> lock(sleep_mtx); }
+    wake.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    if (current_pool == this) throw std::logic_error("ThreadPool::wait_idle() called from a worker");
+    std::unique_lock<std::mutex> lock(sleep_mtx);
+    idle.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+}
+
+bool ThreadPool::try_get(size_t self, Task& task) {
+    if (queued.load(std::memory_order_acquire) == 0) return false;
+    {
+        // Own tasks: newest first
+        Worker& w = *workers[self];
+        std::lock_guard<std::mutex> lock(w.mtx);
+        if (!w.tasks.empty()) {
+            task = std::move(w.tasks.back());
+            w.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    // Steal: oldest task of the next non-empty victim
+    for (size_t k = 1; k < workers.size(); ++k) {
+        Worker& victim = *workers[(self + k) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t self) {
+    while (true) {
+        Task task;
+        if (!try_get(self, task)) {
+            std::unique_lock<std::mutex> lock(sleep_mtx);
+            wake.wait(lock, [this] { return stop || queued.load(std::memory_order_acquire) > 0; });
+            if (stop && queued.load(std::memory_order_acquire) == 0) return;
+            continue;
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: uncaught exception in thread pool task: " << e.what() << "\n";
+        } catch (...) {
+            std::cerr << "Warning: uncaught exception of unknown type in thread pool task\n";
+        }
+
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(sleep_mtx);
+            idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,59 @@
+// ========================= ThreadPool.h =========================
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a task deque: it pushes and
+// pops its own tasks at the back (LIFO, cache friendly), while idle workers
+// steal from the front of other deques (oldest, usually largest, tasks first).
+// Tasks may submit further tasks; wait_idle() waits for all of them.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t nthreads, bool pin_threads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // From a worker of this pool the task goes to that worker's own deque,
+    // otherwise deques are filled round-robin.
+    void submit(Task task);
+
+    // Block until every submitted task, including tasks spawned by tasks, has finished.
+    void wait_idle();
+
+    size_t size() const { return threads.size(); }
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::atomic<size_t> queued{0};    // tasks sitting in deques
+    std::atomic<size_t> pending{0};   // tasks submitted and not finished
+    std::atomic<size_t> next_queue{0};
+    std::mutex sleep_mtx;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    bool stop = false;
+
+    void worker_loop(size_t self);
+    bool try_get(size_t self, Task& task);
+};
+
+#endif // THREADPOOL_H
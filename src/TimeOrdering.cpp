@@ -0,0 +1,170 @@
+#include "TimeOrdering.h"
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <queue>
+
+// ---------------- RolloverCounter ----------------
+
+uint64_t RolloverCounter::peek(uint32_t raw) const {
+    const uint64_t range = uint64_t(1) << bits;
+    raw &= static_cast<uint32_t>(range - 1);
+    if (!initialized) return raw;
+    // Signed distance from the last value, modulo the counter range
+    int64_t delta = static_cast<int64_t>((raw - last) & (range - 1));
+    if (delta >= static_cast<int64_t>(range / 2)) delta -= static_cast<int64_t>(range);
+    if (delta < 0 && static_cast<uint64_t>(-delta) > last) delta = 0;  // never before zero
+    return static_cast<uint64_t>(static_cast<int64_t>(last) + delta);
+}
+
+uint64_t RolloverCounter::extend(uint32_t raw) {
+    last = peek(raw);
+    initialized = true;
+    return last;
+}
+
+// ---------------- Hit edges ----------------
+
+uint32_t gts_window_tag(int current_gts_tag, int tag_id) {
+    const uint32_t mask = (uint32_t(1) << TimeConfig::GTS_TAG_BITS) - 1;
+    uint32_t current = static_cast<uint32_t>(current_gts_tag);
+    // Step back to the latest tag whose LSBs match tag_id (0...3 windows back)
+    uint32_t back = (current - static_cast<uint32_t>(tag_id)) & TimeConfig::TAG_ID_MASK;
+    return (current - back) & mask;
+}
+
+int64_t time_over_threshold(const HitTimeData& hit) {
+    if (hit.get_hit_time_rise() < 0 || hit.get_hit_time_fall() < 0) return -1;
+    const uint32_t range = uint32_t(1) << TimeConfig::GTS_TAG_BITS;
+    const uint32_t rise = gts_window_tag(hit.get_gts_tag_rise(), hit.get_tag_id_rise());
+    const uint32_t fall = gts_window_tag(hit.get_gts_tag_fall(), hit.get_tag_id_fall());
+    // Signed distance between the windows, modulo the tag range
+    int64_t windows = static_cast<int64_t>((fall - rise) & (range - 1));
+    if (windows >= static_cast<int64_t>(range / 2)) windows -= range;
+    return windows * static_cast<int64_t>(TimeConfig::TICKS_PER_GTS) + hit.get_hit_time_fall() - hit.get_hit_time_rise();
+}
+
+std::ostream& operator<<(std::ostream& out, const TimedHit& hit) {
+    out << hit.time << ' ' << hit.event_id << ' ' << hit.board_id << ' ' << hit.channel_id << ' '
+        << hit.hit_id << ' ' << hit.tot << ' ' << hit.amplitude_lg << ' ' << hit.amplitude_hg << ' '
+        << hit.gts_time << ' ' << hit.gate_time << '\n';
+    return out;
+}
+
+void print_timed_hit_header(std::ostream& out) {
+    out << "# time event board channel hit_id tot amplitude_lg amplitude_hg gts_time gate_time\n"
+        << "# time: GTS tag * " << TimeConfig::TICKS_PER_GTS << " + hit time, in hit-time ticks; the 28-bit tag is extended"
+        << " from the first one of the input. gts_time and gate_time are not part of it.\n";
+}
+
+// ---------------- TimeReconstructor ----------------
+
+TimeReconstructor::TimeReconstructor() : gts_tag(TimeConfig::GTS_TAG_BITS) {
+    gate_time.fill(RolloverCounter(TimeConfig::GATE_TIME_BITS));
+    gts_time.fill(RolloverCounter(TimeConfig::GTS_TIME_BITS));
+}
+
+uint64_t TimeReconstructor::resolve_gts_tag(int current_gts_tag, int tag_id) {
+    return gts_tag.extend(gts_window_tag(current_gts_tag, tag_id));
+}
+
+void TimeReconstructor::reconstruct(uint32_t event_id, const FEBDataPacket& feb, std::vector<TimedHit>& out) {
+    const size_t board = static_cast<size_t>(feb.board_id);
+    uint64_t gate = feb.gate_time >= 0 ? gate_time[board].extend(static_cast<uint32_t>(feb.gate_time)) : 0;
+
+    // Amplitudes are reported once per channel
+    std::map<int, const HitAmplitudeData*> amplitudes;
+    for (const auto& amp : feb.get_hit_amplitudes()) amplitudes[amp.get_channel_id()] = &amp;
+
+    for (const auto& hit : feb.get_hit_times()) {
+        if (hit.get_hit_time_rise() < 0) continue;
+        TimedHit t;
+        t.event_id = event_id;
+        t.board_id = static_cast<uint16_t>(feb.board_id);
+        t.channel_id = static_cast<uint16_t>(hit.get_channel_id());
+        t.hit_id = static_cast<uint16_t>(hit.get_hit_id());
+        t.gate_time = gate;
+
+        uint64_t tag = resolve_gts_tag(hit.get_gts_tag_rise(), hit.get_tag_id_rise());
+        t.time = tag * TimeConfig::TICKS_PER_GTS + static_cast<uint64_t>(hit.get_hit_time_rise());
+        auto window = feb.get_gts_times().find(static_cast<uint32_t>(tag & ((uint64_t(1) << TimeConfig::GTS_TAG_BITS) - 1)));
+        if (window != feb.get_gts_times().end()) t.gts_time = gts_time[board].extend(window->second);
+
+        t.tot = time_over_threshold(hit);
+
+        auto amp = amplitudes.find(hit.get_channel_id());
+        if (amp != amplitudes.end()) {
+            t.amplitude_lg = static_cast<int16_t>(amp->second->get_amplitude_lg());
+            t.amplitude_hg = static_cast<int16_t>(amp->second->get_amplitude_hg());
+        }
+        out.push_back(t);
+    }
+}
+
+// ---------------- TimeOrderedMerger ----------------
+
+void TimeOrderedMerger::push(const OCBDataPacket& event) {
+    uint64_t watermark = std::numeric_limits<uint64_t>::max();
+    bool any = false;
+
+    for (size_t board = 0; board < streams.size() && board < event.get_Nfebs_in_ocb(); ++board) {
+        if (!event.hasData(board)) continue;
+        const FEBDataPacket& feb = event[board];
+
+        scratch.clear();
+        reco.reconstruct(event.get_event_id(), feb, scratch);
+        std::sort(scratch.begin(), scratch.end(), [](const TimedHit& a, const TimedHit& b) { return a.time < b.time; });
+
+        auto& stream = streams[board];
+        for (const auto& hit : scratch) {
+            if (stream.empty() || stream.back().time <= hit.time) stream.push_back(hit);
+            else {
+                // Overlaps the previous event of this FEB: keep the queue sorted
+                auto pos = std::upper_bound(stream.begin(), stream.end(), hit.time,
+                                            [](uint64_t t, const TimedHit& h) { return t < h.time; });
+                stream.insert(pos, hit);
+            }
+        }
+
+        // A later hit may still refer to a GTS window up to 3 tags before the
+        // first window of this event (tag_id resolution). The windows are keyed
+        // by raw tag, so across a rollover the smallest key is not the first one:
+        // compare the extended tags.
+        if (!feb.get_gts_times().empty()) {
+            uint64_t first_tag = std::numeric_limits<uint64_t>::max();
+            for (const auto& window : feb.get_gts_times()) {
+                first_tag = std::min(first_tag, reco.extend_gts_tag(window.first));
+            }
+            uint64_t start = first_tag > TimeConfig::TAG_ID_MASK ? first_tag - TimeConfig::TAG_ID_MASK : 0;
+            watermark = std::min(watermark, start * TimeConfig::TICKS_PER_GTS);
+            any = true;
+        }
+    }
+    if (any) emit_until(watermark);
+}
+
+void TimeOrderedMerger::flush() {
+    emit_until(std::numeric_limits<uint64_t>::max());
+}
+
+void TimeOrderedMerger::emit_until(uint64_t watermark) {
+    // Min-heap of (head time, board) over the non-empty FEB streams
+    using Head = std::pair<uint64_t, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+    for (size_t b = 0; b < streams.size(); ++b) {
+        if (!streams[b].empty()) heap.emplace(streams[b].front().time, b);
+    }
+    while (!heap.empty()) {
+        auto [time, b] = heap.top();
+        if (time >= watermark) break;
+        heap.pop();
+
+        const TimedHit& hit = streams[b].front();
+        if (emitted > 0 && hit.time < last_emitted) ++late;
+        else last_emitted = hit.time;
+        sink(hit);
+        ++emitted;
+        streams[b].pop_front();
+        if (!streams[b].empty()) heap.emplace(streams[b].front().time, b);
+    }
+}
@@ -0,0 +1,131 @@
+// ========================= TimeOrdering.h =========================
+#ifndef TIMEORDERING_H
+#define TIMEORDERING_H
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include "OCBDecoder.h"
+
+namespace TimeConfig {
+    // Hit times are 13-bit fine-time ticks within one GTS window
+    inline constexpr int HIT_TIME_BITS = 13;
+    inline constexpr uint64_t TICKS_PER_GTS = uint64_t(1) << HIT_TIME_BITS;
+    inline constexpr int GTS_TAG_BITS = 28;    // GTS header/trailer1 tag counter
+    inline constexpr int GTS_TIME_BITS = 20;   // GTS trailer2 time
+    inline constexpr int GATE_TIME_BITS = 28;  // GATE_TIME word
+    // tag_id carries the 2 LSBs of the GTS tag a hit belongs to
+    inline constexpr uint32_t TAG_ID_MASK = 0x3;
+}
+
+// Extends a free-running N-bit counter to 64 bits. Successive values may
+// move backwards by less than half the counter range (e.g. FEBs reporting
+// slightly older GTS tags); larger forward steps are treated as rollover.
+class RolloverCounter {
+public:
+    explicit RolloverCounter(int bits = TimeConfig::GTS_TAG_BITS) : bits(bits) {}
+
+    uint64_t extend(uint32_t raw);
+
+    // What extend(raw) would return, without moving the counter
+    uint64_t peek(uint32_t raw) const;
+
+private:
+    int bits;
+    bool initialized = false;
+    uint64_t last = 0;
+};
+
+// Raw tag of the GTS window a hit edge belongs to: the latest tag up to
+// `current_gts_tag` (the tag when the edge was read) whose 2 LSBs equal `tag_id`
+uint32_t gts_window_tag(int current_gts_tag, int tag_id);
+
+// Time over threshold (fall - rise) of a hit in ticks, -1 without both edges.
+// Each edge is resolved to its GTS window as above, and the windows are
+// subtracted modulo the tag range, so a tag rollover in between is harmless.
+int64_t time_over_threshold(const HitTimeData& hit);
+
+// One time-matched hit with its 64-bit time
+struct TimedHit {
+    uint64_t time = 0;        // rising-edge time from the GTS tags, in hit-time ticks (see TimeReconstructor)
+    int64_t tot = -1;         // time over threshold (fall - rise) in ticks, -1 without falling edge
+    uint64_t gate_time = 0;   // extended GATE_TIME of the FEB packet
+    uint64_t gts_time = 0;    // extended GTS trailer time of the hit's GTS window
+    uint32_t event_id = 0;
+    uint16_t board_id = 0;
+    uint16_t channel_id = 0;
+    uint16_t hit_id = 0;
+    int16_t amplitude_lg = -1;
+    int16_t amplitude_hg = -1;
+};
+
+std::ostream& operator<<(std::ostream& out, const TimedHit& hit);
+
+// '#' comment lines naming the columns written by operator<< and what the time counts
+void print_timed_hit_header(std::ostream& out);
+
+// Computes absolute times of decoded hits. The GTS a hit edge belongs to is
+// the most recent GTS tag (at the time the edge was read) whose 2 LSBs equal
+// the edge's tag_id; its 28-bit tag is extended to 64 bits across rollovers,
+// starting from the first tag of the input.
+//     time = extended_gts_tag * TICKS_PER_GTS + hit_time
+// The time thus counts GTS tags, not DAQ clock time: gate and GTS trailer
+// times are extended the same way and attached to the hit, but not used in it.
+class TimeReconstructor {
+public:
+    TimeReconstructor();
+
+    // Extended GTS tag of the window a hit edge belongs to
+    uint64_t resolve_gts_tag(int current_gts_tag, int tag_id);
+
+    // Extended value of a raw GTS tag read near the current one, without moving the counter
+    uint64_t extend_gts_tag(uint32_t tag) const { return gts_tag.peek(tag); }
+
+    uint64_t absolute_time(int current_gts_tag, int tag_id, int hit_time) {
+        return resolve_gts_tag(current_gts_tag, tag_id) * TimeConfig::TICKS_PER_GTS + static_cast<uint64_t>(hit_time);
+    }
+
+    // Reconstruct all time hits of one FEB packet (amplitudes matched by channel)
+    void reconstruct(uint32_t event_id, const FEBDataPacket& feb, std::vector<TimedHit>& out);
+
+private:
+    RolloverCounter gts_tag;
+    std::array<RolloverCounter, OCBConfig::MAX_FEBS_PER_OCB> gate_time;
+    std::array<RolloverCounter, OCBConfig::MAX_FEBS_PER_OCB> gts_time;
+};
+
+// Streaming k-way merge of the per-FEB hit streams into one globally
+// time-ordered stream. Each FEB keeps a sorted queue; after every event, all
+// hits older than the watermark (start of the oldest GTS window a later hit
+// may still refer to) are emitted, so only about one event of hits is held.
+class TimeOrderedMerger {
+public:
+    using Sink = std::function<void(const TimedHit&)>;
+
+    explicit TimeOrderedMerger(Sink sink) : sink(std::move(sink)) {}
+
+    // Reconstruct and enqueue the hits of one event, emit what is complete
+    void push(const OCBDataPacket& event);
+
+    // End of stream: emit everything still queued
+    void flush();
+
+    uint64_t get_emitted() const { return emitted; }
+    // Hits that arrived after later hits were already emitted (emitted out of order)
+    uint64_t get_late() const { return late; }
+
+private:
+    Sink sink;
+    TimeReconstructor reco;
+    std::array<std::deque<TimedHit>, OCBConfig::MAX_FEBS_PER_OCB> streams;
+    std::vector<TimedHit> scratch;
+    uint64_t last_emitted = 0;
+    uint64_t emitted = 0;
+    uint64_t late = 0;
+
+    void emit_until(uint64_t watermark);
+};
+
+#endif // TIMEORDERING_H
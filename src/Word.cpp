@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <iomanip>
 #include <array>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
 #include "Word.h"
 
 // ----------------------
@@ -1,6 +1,8 @@
 #pragma once
 #include <cstdint>
 #include <ostream>
+#include <array>
+#include <memory>
 
 enum WordID {
     GATE_HEADER = 0x0,
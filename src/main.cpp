@@ -1,102 +1,978 @@
-#include <fstream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <iostream>
-#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <type_traits>
+#include <string>
+#include <signal.h>
 #include "OCBDecoder.h"
+#include "Archive.h"
+#include "InputSource.h"
+#include "Pipeline.h"
+#include "BatchRunner.h"
+#include "Calibration.h"
+#include "ChannelMask.h"
+#include "Checkpoint.h"
+#include "EventBus.h"
+#include "EventCache.h"
+#include "EventIndex.h"
+#include "FollowSource.h"
+#include "ClusterFinder.h"
+#include "Geometry.h"
+#include "Kernels.h"
+#include "LoadShedder.h"
+#include "Monitoring.h"
+#include "OCBFramer.h"
+#include "OCBWindowDecoder.h"
+#include "ShmRing.h"
+#include "TimeOrdering.h"
 
+struct Options {
+    PipelineConfig pipeline;
+    ReadConfig read;
+    std::string path;
+    std::string batch_list;          // --batch: list file or directory
+    std::string output_dir = ".";
+    std::string monitor_path;        // --monitor: snapshot file, empty = no monitoring
+    double monitor_interval = 10;
+    bool time_ordered = false;       // --time-ordered: print one globally time-ordered hit stream
+    bool monitor_only = false;       // --monitor-only: stream packets into the histograms, no event dump
+    std::string calibration_path;    // --calibration: per-channel constants, empty = no calibration
+    std::string archive_path;        // --archive: re-encode the input into this archive instead of decoding
+    uint64_t first_packet = 0;       // --packets FIRST:COUNT, archive input only
+    uint64_t packet_count = ArchiveSource::ALL;
+    std::string geometry_path;       // --geometry: channel -> cell map, empty = no clustering
+    ClusterConfig cluster;
+    std::string cache_dir;           // --cache: decoded-event cache directory, empty = no cache
+    uint64_t cache_size = CacheConfig::DEFAULT_SIZE_LIMIT;
+    CacheKey cache_key = CacheKey::CONTENT;
+    bool monitor_drop = false;       // --monitor-drop: monitoring skips batches rather than slowing the output
+    bool bus_stats = false;          // --bus-stats: print per-consumer event bus statistics
+    std::string output_path;         // --output: write the decoded output here instead of stdout
+    std::string checkpoint_path;     // --checkpoint: progress file, empty = no checkpoints
+    double checkpoint_interval = CheckpointConfig::DEFAULT_INTERVAL;
+    bool resume = false;             // --resume: continue from the checkpoint, if there is one
+    std::string mask_path;           // --mask: noisy channels to drop, empty = no mask
+    uint64_t mask_learn = 0;         // --mask-learn N: learn the mask from the first N events
+    double mask_threshold = MaskConfig::DEFAULT_THRESHOLD;
+    std::string mask_save_path;      // --mask-save: write the mask in use to this file
+    bool check_isa = false;          // --check-isa: compare every kernel variant with the scalar one
+    std::string shm_name;            // --shm: read from this shared-memory ring instead of a file
+    bool shm_latency = false;        // --shm-latency: print publish -> decoded latency statistics
+    bool gts_windows = false;        // --gts-windows: print hits as their GTS window closes
+    std::string index_path;          // --index: write a channel/error-bit bitmap index of the run
+    bool shed = false;               // --shed: degrade the decoding in tiers under overload
+    ShedPolicy shed_policy;
+    std::string record_path;         // --record: write every framed OCB packet, raw, to this file
+    bool follow = false;             // --follow: keep decoding the input file as it grows
+    double follow_idle = 0;          // --follow-idle: end after this many seconds without growth, 0 = never
+};
 
-static uint32_t bytes_to_uint32(const unsigned char buf[4]) {
-    // if (big_endian) {
-    //     return (uint32_t)buf[3]
-    //      | ((uint32_t)buf[2] << 8)
-    //      | ((uint32_t)buf[1] << 16)
-    //      | ((uint32_t)buf[0] << 24);
-    // }
-    // else {
-    return (uint32_t)buf[0]
-        | ((uint32_t)buf[1] << 8)
-        | ((uint32_t)buf[2] << 16)
-        | ((uint32_t)buf[3] << 24);
-    // }
-}
+// Optional stages run by the decoding threads on every decoded batch
+struct DecodeStages {
+    std::unique_ptr<Monitor> monitor;
+    std::unique_ptr<CalibrationManager> calibration;
+    std::unique_ptr<GeometryMap> geometry;
+    ClusterConfig cluster;
+    const EventCacheReader* cached = nullptr;  // events restored from the cache instead of decoded
+    bool from_packets = false;  // monitoring from the raw packets, no decoded events
+    bool monitor_events = true;  // fill the monitor from the decoded events here (false: an event bus consumer does)
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <binary-file>\n";
-        return 1;
+    explicit DecodeStages(const Options& opt) : cluster(opt.cluster), from_packets(opt.monitor_only) {
+        if (!opt.monitor_path.empty()) monitor = std::make_unique<Monitor>(opt.monitor_path, opt.monitor_interval, opt.pipeline.layout);
+        if (!opt.calibration_path.empty()) calibration = std::make_unique<CalibrationManager>(opt.calibration_path);
+        if (!opt.geometry_path.empty()) geometry = std::make_unique<GeometryMap>(GeometryMap::load(opt.geometry_path));
     }
 
-    const char* path = argv[1];
-    // bool big_endian = false;
-    // if (argc >= 3 && std::string(argv[2]) == "--be") big_endian = true;
+    bool empty() const { return !monitor && !calibration && !geometry && !cached; }
+
+    void operator()(PacketBatch& batch) const {
+        if (cached) cached->load(batch);
+        if (monitor && from_packets) {
+            // Streaming decode straight into the histograms, stopping at the first bad packet
+            size_t n = batch.error ? batch.error_index : batch.packets.size();
+            for (size_t i = 0; i < n; ++i) {
+                try {
+                    monitor->fill(batch.packets[i]);
+                } catch (...) {
+                    batch.error = std::current_exception();
+                    batch.error_index = i;
+                    break;
+                }
+            }
+        } else if (monitor && monitor_events) {
+            for (const auto& ev : batch.events) monitor->fill(ev);
+        }
+        // The table of the batch's file or run (see CalibrationManager)
+        if (calibration) calibrate_batch(batch, batch.calibration ? *batch.calibration : *calibration->current());
+        if (geometry) cluster_batch(batch, *geometry, cluster);
+    }
+};
 
-    std::ifstream in(path, std::ios::binary);
-    if (!in) {
-        std::cerr << "Failed to open file: " << path << "\n";
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <binary-file>\n"
+              << "       " << prog << " [options] --batch <list-file|directory>\n"
+              << "       " << prog << " [options] --shm <ring-name>\n"
+              << "Options:\n"
+              << "  -j, --threads N        number of decoder threads (default 1)\n"
+              << "  --batch-packets N      OCB packets per pipeline batch / batch-mode chunk (default 64)\n"
+              << "  --queue-depth N        batches buffered between stages (default 16)\n"
+              << "  --pin                  pin reader/decoder/writer threads to CPUs\n"
+              << "  --layout NAME          OCB readout layout: " << layout_names() << " (default: default)\n"
+              << "  --isa NAME             force a SIMD kernel variant: " << kernel_isa_names() << " (default: best supported)\n"
+              << "  --check-isa            check that every supported kernel variant matches the scalar one on the input\n"
+              << "  --async-read           read plain files with io_uring read-ahead and O_DIRECT (pread fallback)\n"
+              << "  --read-depth N         async reads kept in flight (default 8)\n"
+              << "  --read-block-kb N      size of each async read in KiB, multiple of 4 (default 1024)\n"
+              << "  --no-direct            async reads through the page cache (no O_DIRECT)\n"
+              << "  --batch PATH           decode every file of a list file or directory\n"
+              << "  --shm NAME             decode the live stream of the shared-memory ring NAME (see shm_producer)\n"
+              << "  --shm-latency          print the latency from ring publish to decoded batch output\n"
+              << "  --shed                 live input under overload: drop optional stages, then decode headers only, then prescale\n"
+              << "  --shed-pressure A,B,C  queue/ring fill (0-1) entering each --shed tier (default 0.5,0.75,0.9)\n"
+              << "  --shed-latency-ms A,B,C  output latency entering each --shed tier (default: not used)\n"
+              << "  --shed-hold S          seconds a --shed tier is held before stepping back (default 1)\n"
+              << "  --shed-prescale N      last --shed tier: decode 1 in N OCB packets (default 10)\n"
+              << "  --record FILE          write every OCB packet read, raw, to FILE (never shed)\n"
+              << "  --follow               keep decoding a raw file that is still being written, until Ctrl-C\n"
+              << "  --follow-idle S        --follow: end once the file has not grown for S seconds\n"
+              << "  --gts-windows          decode incrementally, printing the hits of every GTS window as it closes\n"
+              << "  --output-dir DIR       batch mode: directory for the per-file outputs (default .)\n"
+              << "  --monitor FILE         fill monitoring histograms, snapshot them to FILE\n"
+              << "  --monitor-interval S   seconds between monitoring snapshots (default 10)\n"
+              << "  --monitor-only         only fill the monitoring histograms, without building or printing events\n"
+              << "  --monitor-drop         monitoring skips batches when it falls behind instead of slowing the output\n"
+              << "  --bus-stats            print per-consumer statistics of the event bus feeding output and monitoring\n"
+              << "  --time-ordered         print hits of all FEBs as one stream ordered by time, counted in hit-time\n"
+              << "                         ticks from the GTS tags (extended from the first one, not gate or GTS time)\n"
+              << "  --calibration FILE     per-channel pedestal/gain/saturation table; print calibrated energies\n"
+              << "  --geometry FILE        channel -> (layer, row, column) map; find and print hit clusters\n"
+              << "  --cluster-window T     max rise-time difference of clustered neighbours, in ticks (default 16)\n"
+              << "  --ocb-id N             OCB id of the input in the geometry map (default 0)\n"
+              << "  --cache DIR            keep decoded events in DIR; later runs over the same file skip decoding\n"
+              << "  --cache-size-mb N      evict least recently used cache entries above N MiB (default 4096)\n"
+              << "  --cache-key MODE       content: hash the whole file (default); stat: size, mtime and first MiB\n"
+              << "  --mask FILE            drop the hit words of the (board channel) pairs listed in FILE undecoded\n"
+              << "  --mask-learn N         mask channels hit in more than --mask-threshold of the first N events\n"
+              << "  --mask-threshold F     occupancy above which --mask-learn masks a channel (default 0.5)\n"
+              << "  --mask-save FILE       write the channel mask in use to FILE\n"
+              << "  --index FILE           write a bitmap index of the channels and error bits of every event (see event_query)\n"
+              << "  --output FILE          write the decoded output to FILE instead of stdout\n"
+              << "  --checkpoint FILE      periodically record the progress of the job in FILE (requires --output)\n"
+              << "  --checkpoint-interval S  seconds between checkpoints (default 30)\n"
+              << "  --resume               continue from the --checkpoint FILE of an interrupted run\n"
+              << "  --archive OUT          write a compact lossless archive of the input to OUT, do not decode\n"
+              << "  --packets FIRST:COUNT  archive input: decode only OCB packets FIRST...FIRST+COUNT-1\n";
+}
+
+// Re-encode one (possibly compressed) raw file into an archive
+static int run_archive(const Options& opt) {
+    try {
+        std::unique_ptr<ByteSource> in = open_input(opt.path, opt.read);
+        ArchiveStats stats = write_archive(*in, opt.archive_path);
+        std::cout << "Archived " << stats.packets << " OCB packets (" << stats.words << " words, "
+                  << stats.blocks << " blocks): " << stats.input_bytes << " -> " << stats.output_bytes << " bytes ("
+                  << (stats.input_bytes ? 100.0 * stats.output_bytes / stats.input_bytes : 0.0) << "%)" << std::endl;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
         return 2;
     }
+    return 0;
+}
+
+// Run the pipeline with its decoded batches published on an event bus, consumed
+// by the output and the monitor on their own threads
+static uint64_t run_on_bus(Pipeline& pipeline, ByteSource& in, const Pipeline::Sink& output, Monitor& monitor,
+                           const Options& opt) {
+    EventBus bus(opt.pipeline.queue_depth);
+    const int output_id = bus.subscribe("output", EventBus::Policy::BLOCK);
+    const int monitor_id = bus.subscribe("monitor", opt.monitor_drop ? EventBus::Policy::DROP : EventBus::Policy::BLOCK);
+
+    std::exception_ptr output_error;
+    std::atomic<bool> output_failed{false};
+    std::thread output_thread([&] {
+        EventBus::Batch batch;
+        try {
+            while (bus.next(output_id, batch)) output(*batch);
+        } catch (...) {
+            output_error = std::current_exception();
+            output_failed = true;
+            bus.unsubscribe(output_id);
+        }
+    });
+    std::thread monitor_thread([&] {
+        EventBus::Batch batch;
+        while (bus.next(monitor_id, batch)) {
+            if (batch->shed_level != ShedLevel::FULL) continue;  // optional stage, shed first
+            for (const auto& ev : batch->events) monitor.fill(ev);
+        }
+    });
 
-    unsigned char buf[4];
-    std::vector<uint32_t> word_list;
+    uint64_t n_packets = 0;
+    std::exception_ptr error;
+    try {
+        n_packets = pipeline.run_shared(in, [&](const EventBus::Batch& batch) {
+            if (output_failed) throw std::runtime_error("Output consumer failed");
+            bus.publish(batch);
+        });
+    } catch (...) {
+        error = std::current_exception();
+    }
+    bus.close();
+    output_thread.join();
+    monitor_thread.join();
 
-    // First loop just to print all words once
-    while (in.read(reinterpret_cast<char*>(buf), 4)) {
-        uint32_t word = bytes_to_uint32(buf);
-        word_list.push_back(word);
+    for (const auto& s : bus.get_stats()) {
+        if (s.dropped == 0 && !opt.bus_stats) continue;
+        std::cerr << (s.dropped ? "Warning: slow consumer " : "Event bus consumer ") << s.name << ": "
+                  << s.delivered << " batches delivered, " << s.dropped << " dropped, max lag " << s.max_lag
+                  << " batches, publisher stalled " << s.stalled_seconds << " s\n";
     }
+    if (output_error) std::rethrow_exception(output_error);
+    if (error) std::rethrow_exception(error);
+    return n_packets;
+}
 
-    // Iterate OCB packets inside file
-    int index = 0;
-    int start_index = -1;
-    std::vector<OCBDataPacket> ocb_packets;
+// Decoding options that change the output of a job, recorded in its checkpoints. The
+// calibration table is identified by its contents, so a resume after it changed is refused.
+static std::string job_options(const Options& opt, const ChannelMask* mask, const CalibrationTable* table) {
+    std::ostringstream s;
+    s << "layout=" << get_layout_info(opt.pipeline.layout).name << " packets=" << opt.first_packet << ":"
+      << opt.packet_count << " calibration=" << opt.calibration_path;
+    if (table) s << "@" << std::hex << table->digest() << std::dec;
+    s << " geometry=" << opt.geometry_path
+      << " cluster_window=" << opt.cluster.time_window << " ocb_id=" << opt.cluster.ocb_id
+      << " mask=" << (mask ? mask->to_string() : "");
+    return s.str();
+}
 
-    for (auto& w : word_list) {
-        if (parse_word(w)->word_id == WordID::OCB_PACKET_HEADER) {
-            start_index = index;
+// Plain, gzip, zstd or archive input, a growing plain file, or a shared-memory ring;
+// compressed files are decompressed on a separate thread
+static std::unique_ptr<ByteSource> open_single_input(const Options& opt) {
+    if (!opt.shm_name.empty()) return std::make_unique<ShmRingSource>(opt.shm_name);
+    if (opt.follow) {
+        if (detect_compression(opt.path) != Compression::NONE) {
+            throw std::runtime_error("--follow requires an uncompressed raw file: " + opt.path);
+        }
+        return std::make_unique<FollowSource>(opt.path, opt.follow_idle);
+    }
+    if (opt.first_packet != 0 || opt.packet_count != ArchiveSource::ALL) {
+        // Random access through the archive's block index
+        if (detect_compression(opt.path) != Compression::ARCHIVE) {
+            throw std::runtime_error("--packets requires an archive input: " + opt.path);
         }
-        if (parse_word(w)->word_id == WordID::OCB_PACKET_TRAILER) {
-            if (start_index < 0) {
-                throw std::runtime_error("OCB Packet Trailer received without corresponding Header");
+        return std::make_unique<ArchiveSource>(opt.path, opt.first_packet, opt.packet_count);
+    }
+    return open_input(opt.path, opt.read);
+}
+
+// Noisy-channel mask from --mask, or learned from the occupancy of the first events (read
+// through a source of its own, so that the whole input is decoded with the same mask)
+static std::unique_ptr<ChannelMask> make_mask(const Options& opt) {
+    std::unique_ptr<ChannelMask> mask;
+    if (!opt.mask_path.empty()) {
+        mask = std::make_unique<ChannelMask>(ChannelMask::load(opt.mask_path));
+    } else if (opt.mask_learn > 0) {
+        std::unique_ptr<ByteSource> in = open_single_input(opt);
+        mask = std::make_unique<ChannelMask>(ChannelMask::learn(*in, opt.mask_learn, opt.mask_threshold, opt.pipeline.layout));
+        std::cerr << "Masked " << mask->count() << " noisy channels";
+        if (!mask->empty()) std::cerr << ": " << mask->to_string();
+        std::cerr << "\n";
+    }
+    if (mask && !opt.mask_save_path.empty()) mask->save(opt.mask_save_path);
+    return mask;
+}
+
+// Run every kernel variant the CPU supports against the scalar one, on the words and
+// amplitude hits of the first packets of the input and on generated edge cases
+static int run_check_isa(const Options& opt) {
+    constexpr size_t CHECK_PACKETS = 1000;
+    std::vector<uint32_t> words;
+    CalibratedHits hits;
+    std::shared_ptr<CalibrationTable> table = std::make_shared<CalibrationTable>();
+    try {
+        std::unique_ptr<ByteSource> in = open_single_input(opt);
+        OCBFramer framer(*in);
+        std::vector<uint32_t> packet;
+        for (size_t n = 0; n < CHECK_PACKETS && framer.next(packet); ++n) {
+            words.insert(words.end(), packet.begin(), packet.end());
+            try {
+                hits.append(OCBDataPacket(packet, /*debug=*/false, opt.pipeline.layout));
+            } catch (const std::runtime_error&) {
+                // Still compared as raw words
             }
+        }
+        if (!opt.calibration_path.empty()) table = CalibrationTable::load(opt.calibration_path);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+
+    int failed = 0;
+    for (KernelIsa isa : {KernelIsa::SCALAR, KernelIsa::SSE42, KernelIsa::AVX2, KernelIsa::AVX512}) {
+        const Kernels& variant = kernel_variant(isa);
+        std::cout << "Kernels " << variant.name << ": ";
+        if (!kernels_supported(isa)) {
+            std::cout << "not supported by this CPU\n";
+            continue;
+        }
+        std::string diff = compare_kernels(variant, words, hits, *table);
+        if (diff.empty()) {
+            std::cout << "identical to scalar (" << words.size() << " words, " << hits.size() << " hits)\n";
+        } else {
+            std::cout << "MISMATCH: " << diff << "\n";
+            failed++;
+        }
+    }
+    std::cout << "Default kernels: " << kernels().name << std::endl;
+    return failed == 0 ? 0 : 5;
+}
+
+// Median, p99 and max of publish -> output latencies of a ring input
+static void print_latency(std::vector<uint64_t>& latency_ns, const char* unit) {
+    if (latency_ns.empty()) return;
+    std::sort(latency_ns.begin(), latency_ns.end());
+    auto us = [&](double q) { return latency_ns[static_cast<size_t>(q * (latency_ns.size() - 1))] / 1000.0; };
+    std::cerr << "Ring latency over " << latency_ns.size() << " " << unit << ": median " << us(0.5) << " us, p99 "
+              << us(0.99) << " us, max " << us(1.0) << " us\n";
+}
+
+// Hits printed one per line as GTS windows close (--gts-windows):
+//   time      event board channel hit_id gts_rise tag_rise rise gts_fall tag_fall fall
+//   amplitude event board channel hit_id gts_lg tag_lg lg gts_hg tag_hg hg
+//   window    event board gts_tag      (all hits of the window were printed)
+//   event     event ocb_error_bits     (end of the OCB packet)
+struct WindowPrinter : WindowVisitor {
+    std::ostream& out;
+    bool live;  // flush every window
+    std::ostringstream text;
+    uint32_t event_id = 0;
+    std::function<void()> on_window;  // latency sampling
 
-            std::vector<uint32_t> ocb_packet_word_list;
-            for (int k = start_index; k < index+1; ++k) {
-                std::cout << *parse_word(word_list[k]);
-                ocb_packet_word_list.push_back(word_list[k]);
+    WindowPrinter(std::ostream& out, bool live) : out(out), live(live) {}
+
+    void on_event_begin(uint32_t id, const std::array<bool, 16>&) { event_id = id; }
+    void on_hit_time(const HitTimeData& h) {
+        text << "time " << event_id << ' ' << h.get_board_id() << ' ' << h.get_channel_id() << ' ' << h.get_hit_id()
+             << ' ' << h.get_gts_tag_rise() << ' ' << h.get_tag_id_rise() << ' ' << h.get_hit_time_rise() << ' '
+             << h.get_gts_tag_fall() << ' ' << h.get_tag_id_fall() << ' ' << h.get_hit_time_fall() << '\n';
+    }
+    void on_hit_amplitude(const HitAmplitudeData& h) {
+        text << "amplitude " << event_id << ' ' << h.get_board_id() << ' ' << h.get_channel_id() << ' ' << h.get_hit_id()
+             << ' ' << h.get_gts_tag_lg() << ' ' << h.get_tag_id_lg() << ' ' << h.get_amplitude_lg() << ' '
+             << h.get_gts_tag_hg() << ' ' << h.get_tag_id_hg() << ' ' << h.get_amplitude_hg() << '\n';
+    }
+    void on_window_end(const FEBInfo& feb, uint32_t gts_tag) {
+        text << "window " << event_id << ' ' << feb.board_id << ' ' << gts_tag << '\n';
+        write();
+        if (on_window) on_window();
+    }
+    void on_event_trailer(const std::array<bool, 16>& errors) {
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; ++i) bits |= uint32_t(errors[i]) << i;
+        text << "event " << event_id << ' ' << bits << '\n';
+        write();
+    }
+    void write() {
+        out << text.str();
+        text.str("");
+        if (live) out.flush();
+    }
+};
+
+// Decode one input incrementally, window by window (for live ring inputs)
+static int run_windows(const Options& opt) {
+    std::unique_ptr<ByteSource> in;
+    std::unique_ptr<ChannelMask> mask;
+    std::ofstream file;
+    try {
+        in = open_single_input(opt);
+        mask = make_mask(opt);
+        if (!opt.output_path.empty()) {
+            file.open(opt.output_path, std::ios::binary | std::ios::trunc);
+            if (!file) throw std::runtime_error("Failed to open output file: " + opt.output_path);
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    std::ostream& out = opt.output_path.empty() ? std::cout : file;
+
+    WindowPrinter printer(out, !opt.shm_name.empty() || opt.follow);
+    std::vector<uint64_t> latency_ns;
+    uint64_t n_packets = 0;
+    try {
+        with_layout(opt.pipeline.layout, [&](auto layout) {
+            OCBWindowDecoder<WindowPrinter, decltype(layout)> decoder(printer, mask.get());
+            if (opt.shm_latency) {
+                // Time from the publish of the window's GTS_TRAILER2 word to its output
+                const ShmRingSource* shm = static_cast<const ShmRingSource*>(in.get());
+                printer.on_window = [&] {
+                    uint64_t published = shm->publish_time(decoder.get_words_read() * 4 - 1);
+                    if (published) latency_ns.push_back(monotonic_ns() - published);
+                };
             }
+            n_packets = decoder.run(*in);
+        });
+    } catch (const std::runtime_error& e) {
+        printer.write();
+        out.flush();
+        std::cerr << "Runtime error: " << e.what() << '\n';
+        return 3;
+    }
+    print_latency(latency_ns, "GTS windows");
+    out << "Number of OCB packets: " << n_packets << std::endl;
+    return 0;
+}
 
-            OCBDataPacket ocb(ocb_packet_word_list, /*debug=*/false);
-            ocb_packets.push_back(std::move(ocb));
+// Calibration of a live input, for the SIGHUP run-boundary handler
+static CalibrationManager* live_calibration = nullptr;
 
-            // Print contents
-            const OCBDataPacket& ev = ocb_packets.back();
+static void mark_run_boundary(int) {
+    if (live_calibration) live_calibration->mark_run_boundary();
+}
 
-            std::cout << ev;
+// Decode one file on the reader -> decoder(s) -> writer pipeline
+static int run_single(const Options& opt) {
+    std::unique_ptr<ByteSource> in;
+    std::unique_ptr<ChannelMask> mask;
+    try {
+        in = open_single_input(opt);
+        mask = make_mask(opt);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
 
-            // std::cout << "OCB event " << ev.get_event_id() << " loaded.\n";
-            // for (size_t feb = 0; feb < ev.get_Nfebs_in_ocb(); ++feb) {
-            //     if (!ev.hasData(feb)) continue;
-            //     std::cout << " FEB " << feb << " present.\nHit times: " << ev[feb].get_hit_times().size() << "\n";
-            //     for (const auto& hit : ev[feb].get_hit_times()) {
-            //         hit.print();
-            //     }
-            //     std::cout << "Hit amplitudes: " << ev[feb].get_hit_times().size() << "\n";
-            //     for (const auto& hit : ev[feb].get_hit_amplitudes()) {
-            //         hit.print();
-            //     }
-            // }
+    std::unique_ptr<DecodeStages> stages;
+    try {
+        stages = std::make_unique<DecodeStages>(opt);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
 
-            start_index = -1;
+    // Checkpoints: continue after the last batch a previous run recorded as written, truncating
+    // whatever it wrote past that point; the output is then the same as that of a single run
+    PipelineConfig pipeline_config = opt.pipeline;
+    pipeline_config.mask = mask.get();
+    pipeline_config.calibration = stages->calibration.get();
+    if (stages->calibration && (!opt.shm_name.empty() || opt.follow)) {
+        // Live input: SIGHUP marks a run boundary, after which the table is reloaded if it changed
+        live_calibration = stages->calibration.get();
+        struct sigaction action{};
+        action.sa_handler = mark_run_boundary;
+        sigaction(SIGHUP, &action, nullptr);
+    }
+    pipeline_config.record_offsets = !opt.index_path.empty();
+    std::unique_ptr<EventIndexBuilder> index;
+    if (!opt.index_path.empty()) index = std::make_unique<EventIndexBuilder>();
+    CheckpointState checkpoint;
+    std::ofstream file;
+    try {
+        if (!opt.checkpoint_path.empty()) {
+            checkpoint.input = opt.path;
+            checkpoint.input_size = std::filesystem::file_size(opt.path);
+            checkpoint.options = job_options(opt, mask.get(),
+                                             stages->calibration ? stages->calibration->current().get() : nullptr);
+            CheckpointState resumed;
+            if (opt.resume && Checkpoint::load(opt.checkpoint_path, resumed)) {
+                if (!resumed.same_job(checkpoint)) {
+                    throw std::runtime_error("Checkpoint " + opt.checkpoint_path + " is for another input or other options");
+                }
+                if (!std::filesystem::exists(opt.output_path)
+                    || std::filesystem::file_size(opt.output_path) < resumed.output_offset) {
+                    throw std::runtime_error("Output " + opt.output_path + " is shorter than recorded in the checkpoint");
+                }
+                std::filesystem::resize_file(opt.output_path, resumed.output_offset);
+                checkpoint = resumed;
+                pipeline_config.start_offset = resumed.input_offset;
+                pipeline_config.start_packet = resumed.packets;
+            }
         }
+        if (!opt.output_path.empty()) {
+            file.open(opt.output_path, pipeline_config.start_packet ? std::ios::binary | std::ios::app
+                                                                    : std::ios::binary | std::ios::trunc);
+            if (!file) throw std::runtime_error("Failed to open output file: " + opt.output_path);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    std::ostream& out = opt.output_path.empty() ? std::cout : file;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+
+    // Live ring input: time from the publish of the last packet of a batch to its output
+    const ShmRingSource* shm = opt.shm_latency ? static_cast<const ShmRingSource*>(in.get()) : nullptr;
+    std::vector<uint64_t> latency_ns;
 
-        if (ocb_packets.size() >= 1) {
-                break;  // For testing, process only first OCB packets
+    // Event cache: restore the events of a file decoded before, or record them for the next run
+    std::unique_ptr<EventCache> cache;
+    std::unique_ptr<EventCacheReader> cached;
+    std::unique_ptr<EventCacheWriter> recording;
+    if (!opt.cache_dir.empty()) {
+        try {
+            cache = std::make_unique<EventCache>(opt.cache_dir, opt.cache_size, opt.cache_key);
+            std::string config = std::string(get_layout_info(opt.pipeline.layout).name) + " "
+                                 + std::to_string(opt.first_packet) + " " + std::to_string(opt.packet_count)
+                                 + (mask ? " mask " + mask->to_string() : "");
+            std::string entry = cache->entry_path(opt.path, config);
+            uint64_t input_size = std::filesystem::file_size(opt.path);
+            cached = EventCacheReader::open(entry, input_size);
+            if (cached) {
+                EventCache::touch(entry);
+                pipeline_config.build_events = false;
+                stages->cached = cached.get();
+            } else if (pipeline_config.start_packet == 0) {
+                recording = std::make_unique<EventCacheWriter>(entry, input_size);
             }
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: event cache disabled: " << e.what() << "\n";
+            cache.reset();
+        }
+    }
+    auto finish_cache = [&] {
+        if (!recording) return;
+        try {
+            if (recording->commit()) cache->evict();
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: " << e.what() << "\n";
+        }
+    };
+
+    // Event-level monitoring shares the decoded batches with the output through an event bus
+    const bool use_bus = stages->monitor && !opt.monitor_only;
+    if (use_bus) stages->monitor_events = false;
 
-        ++index;
+    // Load shedding: its decisions go into the monitoring snapshots and the final report
+    std::unique_ptr<LoadShedder> shedder;
+    if (opt.shed) {
+        shedder = std::make_unique<LoadShedder>(opt.shed_policy);
+        pipeline_config.shedder = shedder.get();
+        if (stages->monitor) stages->monitor->set_metrics([&shedder](std::ostream& o) { shedder->report(o); });
     }
 
-    std::cout << "Number of OCB packets: " << (int) ocb_packets.size() << std::endl;
+    // Raw record of every framed packet, whatever the shedding tier
+    std::ofstream record;
+    uint64_t n_recorded = 0;
+    if (!opt.record_path.empty()) {
+        record.open(opt.record_path, std::ios::binary | std::ios::trunc);
+        if (!record) {
+            std::cerr << "Failed to open raw record file: " << opt.record_path << "\n";
+            return 2;
+        }
+    }
+
+    // Each batch is formatted into a buffer first and written with a single call
+    Pipeline pipeline(pipeline_config);
+    if (!stages->empty()) pipeline.set_decode_hook([&stages](PacketBatch& batch) { (*stages)(batch); });
+    std::ostringstream text;
+    TimeOrderedMerger merger([&text](const TimedHit& hit) { text << hit; });
+    if (opt.time_ordered) print_timed_hit_header(out);
+    uint64_t n_packets = 0;
+    try {
+        Pipeline::Sink output = [&](const PacketBatch& batch) {
+            text.str("");
+            if (record.is_open()) {
+                for (const auto& packet : batch.packets) {
+                    record.write(reinterpret_cast<const char*>(packet.data()), packet.size() * sizeof(uint32_t));
+                }
+                if (!record) throw std::runtime_error("Failed to write raw record file: " + opt.record_path);
+                n_recorded += batch.packets.size();
+            }
+            if (recording) {
+                try {
+                    recording->append(batch);
+                } catch (const std::runtime_error& e) {
+                    std::cerr << "Warning: event cache disabled: " << e.what() << "\n";
+                    recording.reset();
+                }
+            }
+            if (index) {
+                for (size_t i = 0; i < batch.events.size(); ++i) {
+                    index->add(batch.first_packet + i, batch.offsets[i], static_cast<uint32_t>(batch.packets[i].size()),
+                               batch.events[i]);
+                }
+            }
+            if (shm && batch.input_end > 0) {
+                uint64_t published = shm->publish_time(batch.input_end - 1);
+                if (published) latency_ns.push_back(monotonic_ns() - published);
+            }
+            if (opt.monitor_only) return;
+            if (mask) {
+                for (const auto& ev : batch.events) checkpoint.masked_words += ev.get_masked_words();
+            }
+            if (opt.time_ordered) {
+                for (const auto& ev : batch.events) merger.push(ev);
+            } else if (batch.shed_level != ShedLevel::FULL) {
+                print_shed_batch(text, batch);
+            } else {
+                print_batch(text, batch);
+            }
+            out << text.str();
+            if (opt.follow) out.flush();
+            if (!out) {
+                throw std::runtime_error("Failed to write output" + (opt.output_path.empty() ? "" : " file: " + opt.output_path));
+            }
+
+            if (opt.checkpoint_path.empty() || batch.error) return;
+            checkpoint.output_offset += text.str().size();
+            auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration<double>(now - last_checkpoint).count() < opt.checkpoint_interval) return;
+            out.flush();
+            if (!out) throw std::runtime_error("Failed to write output file: " + opt.output_path);
+            Checkpoint::sync(opt.output_path);
+            checkpoint.packets = batch.first_packet + batch.packets.size();
+            checkpoint.input_offset = batch.input_end;
+            Checkpoint::save(opt.checkpoint_path, checkpoint);
+            last_checkpoint = now;
+        };
+        n_packets = use_bus ? run_on_bus(pipeline, *in, output, *stages->monitor, opt) : pipeline.run(*in, output);
+    } catch (const std::runtime_error& e) {
+        out.flush();
+        std::cerr << "Runtime error: " << e.what() << '\n';
+        if (recording && recording->has_decode_error()) finish_cache();
+        if (shedder) shedder->report(std::cerr);
+        return 3;
+    }
+    finish_cache();
+    if (shedder) shedder->report(std::cerr);
+    if (record.is_open()) {
+        record.close();
+        if (!record) {
+            std::cerr << "Failed to write raw record file: " << opt.record_path << "\n";
+            return 3;
+        }
+        std::cerr << "Recorded " << n_recorded << " OCB packets to " << opt.record_path << "\n";
+    }
+
+    if (opt.time_ordered) {
+        text.str("");
+        merger.flush();
+        out << text.str();
+        out << "Number of time-ordered hits: " << merger.get_emitted()
+            << " (out of order: " << merger.get_late() << ")\n";
+    }
+    print_latency(latency_ns, "batches");
+    if (index) {
+        try {
+            index->write(opt.index_path, std::filesystem::absolute(opt.path).string(), std::filesystem::file_size(opt.path));
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: event index not written: " << e.what() << "\n";
+        }
+    }
+    if (mask) out << "Number of masked hit words: " << checkpoint.masked_words << "\n";
+    out << "Number of OCB packets: " << (int) (pipeline_config.start_packet + n_packets) << std::endl;
+    if (!out) {
+        // Keep the checkpoint: the tail of the output is not known to be written
+        std::cerr << "Failed to write output" << (opt.output_path.empty() ? "" : " file: " + opt.output_path) << "\n";
+        return 3;
+    }
+
+    // The job is complete: a later --resume starts over
+    if (!opt.checkpoint_path.empty()) std::remove(opt.checkpoint_path.c_str());
 
     return 0;
 }
+
+// Decode a campaign of files, one output file and one status line per file
+static int run_batch(const Options& opt) {
+    std::vector<std::string> files;
+    try {
+        files = collect_batch_inputs(opt.batch_list);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+
+    BatchConfig config;
+    config.threads = opt.pipeline.decoder_threads;
+    config.chunk_packets = opt.pipeline.batch_packets;
+    config.max_chunks_ahead = opt.pipeline.queue_depth;
+    config.pin_threads = opt.pipeline.pin_threads;
+    config.output_dir = opt.output_dir;
+    config.read = opt.read;
+    config.layout = opt.pipeline.layout;
+
+    std::unique_ptr<ChannelMask> mask;
+    std::unique_ptr<DecodeStages> stages;
+    try {
+        mask = make_mask(opt);
+        stages = std::make_unique<DecodeStages>(opt);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    config.mask = mask.get();
+    config.calibration = stages->calibration.get();
+    BatchRunner runner(config);
+    if (!stages->empty()) runner.set_decode_hook([&stages](PacketBatch& batch) { (*stages)(batch); });
+    std::vector<FileResult> results = runner.run(files, std::cout);
+
+    size_t n_failed = 0;
+    uint64_t n_packets = 0;
+    for (const auto& r : results) {
+        if (!r.ok) n_failed++;
+        n_packets += r.packets;
+    }
+    std::cout << "Batch: " << results.size() << " files, " << results.size() - n_failed << " OK, "
+              << n_failed << " failed, " << n_packets << " OCB packets" << std::endl;
+    return n_failed == 0 ? 0 : 4;
+}
+
+// Numeric option value: the whole text must be a number of type T in [min, max]
+template <class T>
+static std::optional<T> parse_number(const std::string& text, T min, T max = std::numeric_limits<T>::max()) {
+    if (text.empty() || std::isspace(static_cast<unsigned char>(text[0]))) return std::nullopt;
+    char* end = nullptr;
+    errno = 0;
+    if constexpr (std::is_floating_point_v<T>) {
+        const long double v = std::strtold(text.c_str(), &end);
+        if (errno != 0 || *end != '\0' || !(v >= min && v <= max)) return std::nullopt;
+        return static_cast<T>(v);
+    } else if constexpr (std::is_signed_v<T>) {
+        const long long v = std::strtoll(text.c_str(), &end, 10);
+        if (errno != 0 || *end != '\0' || v < min || v > max) return std::nullopt;
+        return static_cast<T>(v);
+    } else {
+        // strtoull() would wrap a negative value around
+        if (text[0] == '-') return std::nullopt;
+        const unsigned long long v = std::strtoull(text.c_str(), &end, 10);
+        if (errno != 0 || *end != '\0' || v < min || v > max) return std::nullopt;
+        return static_cast<T>(v);
+    }
+}
+
+// Three comma-separated thresholds, one per shedding tier, multiplied by `scale`
+static bool parse_tiers(const std::string& text, double scale, std::array<double, 3>& tiers) {
+    std::array<double, 3> parsed;
+    std::istringstream in(text);
+    std::string item;
+    for (size_t k = 0; k < parsed.size(); ++k) {
+        if (!std::getline(in, item, ',')) return false;
+        const std::optional<double> threshold = parse_number(item, 0.0);
+        if (!threshold) return false;
+        parsed[k] = *threshold * scale;
+    }
+    if (std::getline(in, item, ',')) return false;
+    tiers = parsed;
+    return true;
+}
+
+// Why the combination of options is invalid, "" if it is valid
+static std::string invalid_options(const Options& opt) {
+    struct Flag {
+        const char* name;
+        bool set;
+    };
+    const bool packets = opt.first_packet != 0 || opt.packet_count != ArchiveSource::ALL;
+    const Flag batch{"--batch", !opt.batch_list.empty()}, archive{"--archive", !opt.archive_path.empty()},
+        time_ordered{"--time-ordered", opt.time_ordered}, monitor{"--monitor", !opt.monitor_path.empty()},
+        monitor_only{"--monitor-only", opt.monitor_only}, calibration{"--calibration", !opt.calibration_path.empty()},
+        geometry{"--geometry", !opt.geometry_path.empty()}, cache{"--cache", !opt.cache_dir.empty()},
+        checkpoint{"--checkpoint", !opt.checkpoint_path.empty()}, mask{"--mask", !opt.mask_path.empty()},
+        mask_learn{"--mask-learn", opt.mask_learn > 0}, packet_range{"--packets", packets},
+        gts_windows{"--gts-windows", opt.gts_windows}, index{"--index", !opt.index_path.empty()};
+
+    std::string error;
+    // `mode` (if given) excludes every flag of `others`
+    auto exclude = [&error](const Flag& mode, std::initializer_list<Flag> others) {
+        if (!error.empty() || !mode.set) return;
+        for (const Flag& other : others) {
+            if (other.set) {
+                error = std::string(mode.name) + " cannot be combined with " + other.name;
+                return;
+            }
+        }
+    };
+    // `mode` (if given) needs `what`
+    auto require = [&error](const Flag& mode, bool ok, const char* what) {
+        if (error.empty() && mode.set && !ok) error = std::string(mode.name) + " requires " + what;
+    };
+
+    const int n_inputs = !opt.path.empty() + !opt.batch_list.empty() + !opt.shm_name.empty();
+    if (n_inputs == 0) return "No input: give a raw file, --batch or --shm";
+    if (n_inputs > 1) return "Only one input allowed: a raw file, --batch or --shm";
+    const Flag shm{"--shm", !opt.shm_name.empty()}, file_input{"a raw file input", !opt.path.empty()};
+
+    require(monitor_only, monitor.set, "--monitor");
+    exclude(monitor_only, {batch, time_ordered, calibration, geometry});
+    exclude(cache, {monitor_only, batch});
+    exclude({"--output", !opt.output_path.empty()}, {batch, archive});
+    require(checkpoint, !opt.output_path.empty(), "--output");
+    exclude(checkpoint, {time_ordered, monitor});
+    require({"--resume", opt.resume}, checkpoint.set, "--checkpoint");
+    exclude(mask_learn, {mask, batch});
+    exclude(shm, {cache, checkpoint, archive, mask_learn, packet_range});
+    require({"--shm-latency", opt.shm_latency}, shm.set, "--shm");
+    exclude(gts_windows, {batch, archive, time_ordered, monitor, calibration, geometry, cache, checkpoint});
+    require(index, file_input.set, "a raw file input");
+    exclude(index, {monitor_only, archive, gts_windows, checkpoint});
+    const Flag shed{"--shed", opt.shed};
+    require(shed, shm.set, "--shm");
+    exclude(shed, {gts_windows, time_ordered});
+    const Flag follow{"--follow", opt.follow};
+    require(follow, file_input.set, "a raw file input");
+    exclude(follow, {archive, cache, checkpoint, index, mask_learn, packet_range});
+    exclude({"--record", !opt.record_path.empty()}, {batch, archive, gts_windows, checkpoint});
+    return error;
+}
+
+// --follow: the first Ctrl-C ends the input after the data written so far, the second one the process
+static void stop_following(int) {
+    FollowSource::stop();
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        // Value of type T in [min, max]; anything else ends with the usage
+        auto number = [&](auto min, decltype(min) max = std::numeric_limits<decltype(min)>::max()) {
+            const char* text = value();
+            const auto parsed = parse_number(text, min, max);
+            if (!parsed) {
+                std::cerr << "Invalid value for " << arg << ": " << text << "\n";
+                usage(argv[0]);
+                std::exit(1);
+            }
+            return *parsed;
+        };
+        if (arg == "-j" || arg == "--threads") opt.pipeline.decoder_threads = number(1);
+        else if (arg == "--batch-packets") opt.pipeline.batch_packets = number(size_t(1));
+        else if (arg == "--queue-depth") opt.pipeline.queue_depth = number(size_t(1));
+        else if (arg == "--pin") opt.pipeline.pin_threads = true;
+        else if (arg == "--layout") {
+            try {
+                opt.pipeline.layout = find_layout(value());
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--isa") {
+            try {
+                select_kernels(find_kernel_isa(value()));
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--check-isa") opt.check_isa = true;
+        else if (arg == "--async-read") opt.read.async = true;
+        else if (arg == "--read-depth") opt.read.queue_depth = number(1u);
+        else if (arg == "--read-block-kb") opt.read.block_size = number(size_t(1), std::numeric_limits<size_t>::max() >> 10) << 10;
+        else if (arg == "--no-direct") opt.read.direct = false;
+        else if (arg == "--batch") opt.batch_list = value();
+        else if (arg == "--shm") opt.shm_name = value();
+        else if (arg == "--shm-latency") opt.shm_latency = true;
+        else if (arg == "--gts-windows") opt.gts_windows = true;
+        else if (arg == "--index") opt.index_path = value();
+        else if (arg == "--shed") opt.shed = true;
+        else if (arg == "--shed-pressure" || arg == "--shed-latency-ms") {
+            const bool latency = arg == "--shed-latency-ms";
+            if (!parse_tiers(value(), latency ? 1e-3 : 1.0, latency ? opt.shed_policy.latency : opt.shed_policy.pressure)) {
+                std::cerr << arg << " needs three comma-separated thresholds\n";
+                return 1;
+            }
+            opt.shed = true;
+        }
+        else if (arg == "--shed-hold") { opt.shed_policy.hold_seconds = number(0.0); opt.shed = true; }
+        else if (arg == "--shed-prescale") { opt.shed_policy.prescale = number(uint32_t(1)); opt.shed = true; }
+        else if (arg == "--record") opt.record_path = value();
+        else if (arg == "--follow") opt.follow = true;
+        else if (arg == "--follow-idle") { opt.follow_idle = number(0.0); opt.follow = true; }
+        else if (arg == "--output-dir") opt.output_dir = value();
+        else if (arg == "--monitor") opt.monitor_path = value();
+        else if (arg == "--monitor-interval") opt.monitor_interval = number(1e-3);
+        else if (arg == "--monitor-only") opt.monitor_only = true;
+        else if (arg == "--monitor-drop") opt.monitor_drop = true;
+        else if (arg == "--bus-stats") opt.bus_stats = true;
+        else if (arg == "--time-ordered") opt.time_ordered = true;
+        else if (arg == "--calibration") opt.calibration_path = value();
+        else if (arg == "--geometry") opt.geometry_path = value();
+        else if (arg == "--cluster-window") opt.cluster.time_window = number(int64_t(0));
+        else if (arg == "--ocb-id") opt.cluster.ocb_id = number(0);
+        else if (arg == "--cache") opt.cache_dir = value();
+        else if (arg == "--cache-size-mb") opt.cache_size = number(uint64_t(1), std::numeric_limits<uint64_t>::max() >> 20) << 20;
+        else if (arg == "--cache-key") {
+            std::string mode = value();
+            if (mode == "content") opt.cache_key = CacheKey::CONTENT;
+            else if (mode == "stat") opt.cache_key = CacheKey::STAT;
+            else {
+                std::cerr << "Unknown cache key mode: " << mode << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--mask") opt.mask_path = value();
+        else if (arg == "--mask-learn") opt.mask_learn = number(uint64_t(0));
+        else if (arg == "--mask-threshold") opt.mask_threshold = number(0.0);
+        else if (arg == "--mask-save") opt.mask_save_path = value();
+        else if (arg == "--output") opt.output_path = value();
+        else if (arg == "--checkpoint") opt.checkpoint_path = value();
+        else if (arg == "--checkpoint-interval") opt.checkpoint_interval = number(0.0);
+        else if (arg == "--resume") opt.resume = true;
+        else if (arg == "--archive") opt.archive_path = value();
+        else if (arg == "--packets") {
+            std::string range = value();
+            size_t colon = range.find(':');
+            const std::optional<uint64_t> first = parse_number(range.substr(0, colon), uint64_t(0));
+            const std::optional<uint64_t> count =
+                colon == std::string::npos ? ArchiveSource::ALL : parse_number(range.substr(colon + 1), uint64_t(0));
+            if (!first || !count) {
+                std::cerr << "Invalid value for " << arg << ": " << range << "\n";
+                usage(argv[0]);
+                return 1;
+            }
+            opt.first_packet = *first;
+            opt.packet_count = *count;
+        }
+        else if (arg == "-h" || arg == "--help") { usage(argv[0]); return 0; }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            usage(argv[0]);
+            return 1;
+        }
+        else opt.path = arg;
+    }
+    const std::string invalid = invalid_options(opt);
+    if (!invalid.empty()) {
+        std::cerr << invalid << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+
+    opt.pipeline.build_events = !opt.monitor_only;
+    if (opt.follow) {
+        struct sigaction action{};
+        action.sa_handler = stop_following;
+        action.sa_flags = SA_RESETHAND;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
+    if (opt.check_isa) return run_check_isa(opt);
+    if (!opt.batch_list.empty()) return run_batch(opt);
+    if (!opt.archive_path.empty()) return run_archive(opt);
+    if (opt.gts_windows) return run_windows(opt);
+    return run_single(opt);
+}
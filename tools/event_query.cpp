@@ -0,0 +1,117 @@
+// Query the bitmap index written by `main --index` (see src/EventIndex.h).
+//
+//   event_query [--packets | --offsets | --count | --extract OUT] INDEX 'QUERY'
+//   e.g. event_query run.fcix '3:17 AND (feb:4 OR feb:5) AND NOT err:1'
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../src/EventIndex.h"
+#include "../src/RawExtract.h"
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [output] <index-file> <query>\n"
+              << "Query: terms B:C (board B, channel C hit), feb:B (board B has data), err:N (OCB trailer\n"
+              << "       error bit N), combined with AND, OR, NOT (or &, |, !) and parentheses\n"
+              << "Output (default: the event numbers, one per line):\n"
+              << "  --packets        OCB packet indices in the run\n"
+              << "  --offsets        input byte range 'begin end' of every packet\n"
+              << "  --count          number of matching packets only\n"
+              << "  --extract OUT    copy the matching packets of the (uncompressed) input file to OUT\n";
+}
+
+int main(int argc, char** argv) {
+    enum class Output { EVENTS, PACKETS, OFFSETS, COUNT, EXTRACT } output = Output::EVENTS;
+    std::string extract_path;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--packets") output = Output::PACKETS;
+        else if (arg == "--offsets") output = Output::OFFSETS;
+        else if (arg == "--count") output = Output::COUNT;
+        else if (arg == "--extract") {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << arg << "\n";
+                return 1;
+            }
+            output = Output::EXTRACT;
+            extract_path = argv[++i];
+        }
+        else if (arg == "-h" || arg == "--help") { usage(argv[0]); return 0; }
+        else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            usage(argv[0]);
+            return 1;
+        }
+        else args.push_back(arg);
+    }
+    if (args.size() != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        const auto start = std::chrono::steady_clock::now();
+        EventIndex index(args[0]);
+        std::vector<uint32_t> packets = index.query(args[1]).values();
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << packets.size() << " of " << index.get_packets() << " OCB packets match (" << ms << " ms)\n";
+
+        if (output == Output::EXTRACT) {
+            int in = ::open(index.get_input().c_str(), O_RDONLY | O_CLOEXEC);
+            if (in < 0) throw std::runtime_error("Failed to open indexed input file: " + index.get_input());
+            int out = ::open(extract_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (out < 0) {
+                ::close(in);
+                throw std::runtime_error("Failed to create output file: " + extract_path);
+            }
+            if (static_cast<uint64_t>(lseek(in, 0, SEEK_END)) != index.get_input_size()) {
+                std::cerr << "Warning: " << index.get_input() << " changed size since it was indexed\n";
+            }
+            // Runs of adjacent packets are copied at once
+            uint64_t begin = 0, end = 0;
+            try {
+                for (uint32_t p : packets) {
+                    EventIndex::Packet packet = index.packet(p);
+                    if (packet.offset != end) {
+                        copy_range(in, out, begin, end - begin);
+                        begin = packet.offset;
+                    }
+                    end = packet.offset + 4 * uint64_t(packet.words);
+                }
+                copy_range(in, out, begin, end - begin);
+            } catch (...) {
+                ::close(in);
+                ::close(out);
+                throw;
+            }
+            ::close(in);
+            ::close(out);
+            return 0;
+        }
+        if (output == Output::COUNT) {
+            std::cout << packets.size() << "\n";
+            return 0;
+        }
+        std::string text;
+        for (uint32_t p : packets) {
+            if (output == Output::PACKETS) {
+                text += std::to_string(p);
+            } else {
+                EventIndex::Packet packet = index.packet(p);
+                if (output == Output::EVENTS) text += std::to_string(packet.event_id);
+                else text += std::to_string(packet.offset) + " " + std::to_string(packet.offset + 4 * uint64_t(packet.words));
+            }
+            text += '\n';
+        }
+        std::cout << text << std::flush;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Check that every SIMD kernel variant the CPU supports gives the same results
+// as the scalar one (see src/Kernels.h), on generated data only.
+//
+//   kernel_check [ROUNDS]
+//
+// Each round generates a word stream shaped like OCB packets, amplitude hits
+// and a calibration table from its own seed; compare_kernels() adds its fixed
+// edge cases. Exits 1 on the first mismatch. Run by `make check`.
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/Kernels.h"
+#include "../src/Word.h"
+
+// Deterministic test data (xorshift)
+struct Random {
+    uint64_t state;
+    explicit Random(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return static_cast<uint32_t>(state >> 16);
+    }
+    int32_t range(int32_t lo, int32_t hi) { return lo + static_cast<int32_t>(next() % static_cast<uint32_t>(hi - lo)); }
+};
+
+static uint32_t word(WordID id, uint32_t payload) {
+    return uint32_t(id) << 28 | (payload & 0x0FFFFFFF);
+}
+
+// OCB packets (header, FEB gates with GTS windows of hits, trailer), with
+// occasional garbage words in between
+static std::vector<uint32_t> generate_words(Random& rnd) {
+    std::vector<uint32_t> words;
+    const int packets = rnd.range(1, 40);
+    for (int p = 0; p < packets; ++p) {
+        words.push_back(word(WordID::OCB_PACKET_HEADER, static_cast<uint32_t>(p)));
+        for (int feb = rnd.range(0, 9); feb > 0; --feb) {
+            words.push_back(word(WordID::GATE_HEADER, static_cast<uint32_t>(feb) << 20));
+            words.push_back(word(WordID::GATE_HEADER, static_cast<uint32_t>(feb) << 20 | 1u << 19));
+            for (int gts = rnd.range(0, 5); gts > 0; --gts) {
+                words.push_back(word(WordID::GTS_HEADER, rnd.next()));
+                for (int hit = rnd.range(0, 20); hit > 0; --hit) {
+                    words.push_back(word(rnd.next() % 2 ? WordID::HIT_TIME : WordID::HIT_AMPLITUDE, rnd.next()));
+                }
+                words.push_back(word(WordID::GTS_TRAILER1, rnd.next()));
+                words.push_back(word(WordID::GTS_TRAILER2, rnd.next()));
+            }
+            words.push_back(word(WordID::FEB_DATA_PACKET_TRAILER, rnd.next()));
+        }
+        if (rnd.next() % 4 == 0) words.push_back(rnd.next() << 4 | rnd.next() % 16);
+        words.push_back(word(WordID::OCB_PACKET_TRAILER, rnd.next() % 3 == 0 ? rnd.next() : 0));
+    }
+    return words;
+}
+
+static CalibratedHits generate_hits(Random& rnd) {
+    CalibratedHits hits;
+    for (int i = rnd.range(0, 3000); i > 0; --i) {
+        hits.board.push_back(rnd.range(-1, OCBConfig::MAX_FEBS_PER_OCB + 1));
+        hits.channel.push_back(rnd.range(-1, CalibConfig::NUM_CHANNELS + 1));
+        hits.amplitude_lg.push_back(rnd.next() % 7 == 0 ? -1 : rnd.range(0, 4096));
+        hits.amplitude_hg.push_back(rnd.next() % 7 == 0 ? -1 : rnd.range(0, 4097));
+    }
+    return hits;
+}
+
+// Every other round a table with extreme constants: zero gains, saturation at 0
+// or above the ADC range, pedestals above the amplitudes
+static CalibrationTable generate_table(Random& rnd, bool extreme) {
+    CalibrationTable table;
+    for (size_t k = 0; k < table.ped_lg.size(); ++k) {
+        if (extreme && rnd.next() % 3 == 0) {
+            table.gain_lg[k] = rnd.next() % 2 ? 0.f : -1.f;
+            table.gain_hg[k] = rnd.next() % 2 ? 0.f : 1e6f;
+            table.ped_lg[k] = 5000.f;
+            table.ped_hg[k] = -5000.f;
+            table.hg_saturation[k] = rnd.next() % 2 ? 0.f : 1e9f;
+            continue;
+        }
+        table.ped_lg[k] = static_cast<float>(rnd.range(0, 500)) * 0.29f;
+        table.gain_lg[k] = static_cast<float>(rnd.range(1, 2000)) * 0.011f;
+        table.ped_hg[k] = static_cast<float>(rnd.range(0, 500)) * 0.53f;
+        table.gain_hg[k] = static_cast<float>(rnd.range(1, 2000)) * 0.0013f;
+        table.hg_saturation[k] = static_cast<float>(rnd.range(2000, 4097));
+    }
+    return table;
+}
+
+int main(int argc, char** argv) {
+    int rounds = 16;
+    if (argc > 2 || (argc == 2 && (rounds = std::atoi(argv[1])) < 1)) {
+        std::cerr << "Usage: " << argv[0] << " [rounds]\n";
+        return 2;
+    }
+
+    int failed = 0;
+    for (KernelIsa isa : {KernelIsa::SCALAR, KernelIsa::SSE42, KernelIsa::AVX2, KernelIsa::AVX512}) {
+        const Kernels& variant = kernel_variant(isa);
+        if (!kernels_supported(isa)) {
+            std::cout << "Kernels " << variant.name << ": not supported by this CPU\n";
+            continue;
+        }
+        std::string diff;
+        for (int round = 0; round < rounds && diff.empty(); ++round) {
+            Random rnd(static_cast<uint64_t>(round) + 1);
+            const std::vector<uint32_t> words = generate_words(rnd);
+            const CalibratedHits hits = generate_hits(rnd);
+            const CalibrationTable table = generate_table(rnd, round % 2 == 1);
+            diff = compare_kernels(variant, words, hits, table);
+            if (!diff.empty()) diff = "round " + std::to_string(round) + ": " + diff;
+        }
+        if (diff.empty()) {
+            std::cout << "Kernels " << variant.name << ": identical to scalar (" << rounds << " rounds)\n";
+        } else {
+            std::cout << "Kernels " << variant.name << ": MISMATCH: " << diff << "\n";
+            failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Cut samples out of raw files without decoding them (see src/RawExtract.h).
+//
+//   raw_extract [--packets FIRST:COUNT] [--events FIRST:LAST] [--errors] INPUT OUTPUT
+//   raw_extract --split N INPUT PREFIX
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/RawExtract.h"
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [selection] <raw-file> <output-file>\n"
+              << "       " << prog << " --split N <raw-file> <output-prefix>\n"
+              << "Selection (all given criteria must hold):\n"
+              << "  --packets FIRST:COUNT  OCB packets FIRST...FIRST+COUNT-1 (COUNT omitted: to the end)\n"
+              << "  --events FIRST:LAST    OCB packets with event number FIRST...LAST\n"
+              << "  --errors               OCB packets with any trailer error bit set\n"
+              << "Split:\n"
+              << "  --split N              cut the file into N parts of about equal size at OCB packet\n"
+              << "                         headers, written to <output-prefix>_<k>.raw\n";
+}
+
+int main(int argc, char** argv) {
+    PacketSelection selection;
+    unsigned split = 0;  // --split N: number of parts, 0 = extract
+    bool selected = false;
+    std::vector<std::string> args;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) throw std::invalid_argument("Missing value for " + arg);
+                return argv[++i];
+            };
+            if (arg == "--packets" || arg == "--events" || arg == "--errors") selected = true;
+            if (arg == "--packets" || arg == "--events") {
+                std::string range = value();
+                size_t colon = range.find(':');
+                uint64_t first = std::stoull(range.substr(0, colon));
+                bool has_last = colon != std::string::npos && colon + 1 < range.size();
+                uint64_t last = has_last ? std::stoull(range.substr(colon + 1)) : 0;
+                if (arg == "--packets") {
+                    selection.first_packet = first;
+                    if (has_last) selection.packet_count = last;
+                } else {
+                    selection.first_event = static_cast<uint32_t>(first);
+                    if (has_last) selection.last_event = static_cast<uint32_t>(last);
+                }
+            }
+            else if (arg == "--errors") selection.errors_only = true;
+            else if (arg == "--split") {
+                split = static_cast<unsigned>(std::stoul(value()));
+                if (split < 1) throw std::invalid_argument("--split needs at least 1 part");
+            }
+            else if (arg == "-h" || arg == "--help") { usage(argv[0]); return 0; }
+            else if (!arg.empty() && arg[0] == '-') throw std::invalid_argument("Unknown option: " + arg);
+            else args.push_back(arg);
+        }
+    } catch (const std::logic_error& e) {
+        std::cerr << e.what() << "\n";
+        usage(argv[0]);
+        return 1;
+    }
+    if (args.size() != 2 || (split > 0 && selected)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        if (split > 0) {
+            for (const auto& part : split_raw(args[0], args[1], split)) std::cout << part << "\n";
+            return 0;
+        }
+        ExtractStats stats = extract_packets(args[0], args[1], selection);
+        std::cout << "Extracted " << stats.packets << " of " << stats.packets_scanned << " OCB packets scanned ("
+                  << stats.bytes << " bytes in " << stats.ranges << " ranges) to " << args[1] << std::endl;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Test producer for the shared-memory ring input: replays the OCB packets of a
+// raw file into a ring, as the acquisition process would, publishing each
+// packet as soon as it is written.
+//
+//   shm_producer [--size-mb N] [--rate PACKETS/S] [--wait-consumer] NAME FILE
+//   main --shm NAME
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/InputSource.h"
+#include "../src/OCBFramer.h"
+#include "../src/ShmRing.h"
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] <ring-name> <binary-file>\n"
+              << "Options:\n"
+              << "  --size-mb N        ring data size in MiB, a power of two (default 64)\n"
+              << "  --rate N           publish at most N OCB packets per second (default: as fast as possible)\n"
+              << "  --wait-consumer    wait until a decoder attaches before writing\n";
+}
+
+int main(int argc, char** argv) {
+    uint64_t capacity = ShmConfig::DEFAULT_CAPACITY;
+    double rate = 0;
+    bool wait_consumer = false;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "--size-mb" || arg == "--rate") && i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 1;
+        }
+        if (arg == "--size-mb") capacity = std::stoull(argv[++i]) << 20;
+        else if (arg == "--rate") rate = std::stod(argv[++i]);
+        else if (arg == "--wait-consumer") wait_consumer = true;
+        else if (arg == "-h" || arg == "--help") { usage(argv[0]); return 0; }
+        else if (!arg.empty() && arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << "\n";
+            usage(argv[0]);
+            return 1;
+        }
+        else args.push_back(arg);
+    }
+    if (args.size() != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        std::unique_ptr<ByteSource> in = open_input(args[1]);
+        ShmRingProducer ring(args[0], capacity);
+        if (wait_consumer) {
+            while (!ring.consumer_attached()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        OCBFramer framer(*in);
+        std::vector<uint32_t> packet;
+        uint64_t n_packets = 0;
+        const auto start = std::chrono::steady_clock::now();
+        while (framer.next(packet)) {
+            if (rate > 0) std::this_thread::sleep_until(start + std::chrono::duration<double>(n_packets / rate));
+            ring.write(packet.data(), packet.size() * sizeof(uint32_t));  // little-endian host
+            ring.publish();
+            n_packets++;
+        }
+        ring.close();
+        std::cerr << "Published " << n_packets << " OCB packets to " << args[0] << "\n";
+
+        // Keep the segment name until a consumer has read everything
+        while (!ring.drained()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 2;
+    }
+    return 0;
+}